@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ArduinoJson.h>
+
+// ============================================================
+//  COMMANDS — payload parsing and ack encoding, no Arduino
+//  dependency so env:native can benchmark it
+// ============================================================
+
+// Control → network: one per traced command, published on .../ack
+struct CmdAck {
+  uint32_t seq;
+  uint32_t devUs;      // receive → relay GPIO written
+  uint64_t originMs;
+  bool     state;
+  bool     changed;    // false if the relay was already there
+};
+
+// ON / on / 1 / true, surrounding whitespace ignored, else OFF
+bool   parseOnOff(const uint8_t* p, unsigned int len);
+// Plain ON/OFF, or traced {"state":…,"seq":…,"ts":…}; false = bad JSON.
+// Group commands may add "spread_ms" (→ *spreadMs, else 0).
+bool   parseCommand(const uint8_t* p, unsigned int len, bool& state, uint32_t& seq, uint64_t& originMs,
+                    uint32_t* spreadMs = nullptr);
+// {"seq","ts","state","changed","dev_us"} → buf, returns length
+size_t writeAckJson(char* buf, size_t cap, const CmdAck& ack);
+
+// Control task: order of relay sets by receipt time. A deferred group
+// switch (spread timer fired) loses to any set applied after it was
+// received; everything else is applied and becomes the newest.
+class SetOrder {
+public:
+  bool admit(int64_t rxUs, bool deferred) {
+    if (deferred && rxUs < _lastRxUs) return false;
+    _lastRxUs = rxUs;
+    return true;
+  }
+private:
+  int64_t _lastRxUs = 0;
+};
+
+// ── LAN batch — POST /api/batch {"ops":[{…},…]} ──────────────
+const size_t  BATCH_BODY_MAX       = 1024;
+const uint8_t BATCH_OPS_MAX        = 16;
+const uint8_t BATCH_OP_MEMBERS_MAX = 6;    // "policy": op + 5 settings
+// The body is parsed in place, so keys and strings stay in it and the
+// document only holds slots: the root, ops[] and every op at its widest
+const size_t  BATCH_DOC_SIZE = JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(BATCH_OPS_MAX) +
+                               BATCH_OPS_MAX * JSON_OBJECT_SIZE(BATCH_OP_MEMBERS_MAX);
+typedef StaticJsonDocument<BATCH_DOC_SIZE> BatchDoc;
+// NUL-terminated body (modified) → ops; NULL on success, else the error
+const char* parseBatch(char* body, BatchDoc& doc, JsonArray& ops);
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hal.h"
+
+// ============================================================
+//  EVENT LOG — append-only audit trail on a raw flash partition
+//  ("evlog", partitions.csv). Fixed 16-byte records written in
+//  a circle of erase sectors; the oldest sector is erased only
+//  when the head reaches it. No Arduino dependency (env:native).
+//
+//  Power-loss safety: every record carries a CRC-8, and a slot's
+//  seq is implied by its position (seq = first seq of the sector
+//  + slot index). A torn write is just an unreadable slot and
+//  its seq is skipped; the scan at begin() needs no journal.
+//
+//  One writer (append, network task), any number of readers: head
+//  and next seq move together under a spinlock, flash I/O is done
+//  outside it, and read() drops whatever was recycled meanwhile.
+// ============================================================
+enum EvType : uint8_t {
+  EV_BOOT = 1,     // value: esp_reset_reason()
+  EV_RELAY,        // value: state | source << 1 (EvSource)
+  EV_FAILSAFE,     // value: FailsafeWhy
+  EV_WIFI_UP,      // value: connect time, 100 ms units
+  EV_WIFI_DOWN,    // value: WiFi disconnect reason
+  EV_MQTT_UP,      // value: TLS handshake ms (saturated)
+  EV_MQTT_FAIL,    // value: failure class << 8 | (rc & 0xFF)
+  EV_CLOCK,        // first NTP sync — epoch - up dates this boot's earlier records
+  EV_RESTART,      // controlled restart (config, OTA, provisioning)
+  EV_TYPE_COUNT
+};
+
+// EVS_NET = anything the network task queued: MQTT, mesh, desired state
+enum EvSource : uint8_t { EVS_NET, EVS_LAN, EVS_SCHEDULE, EVS_FAILSAFE };
+// FS_REFUSED: the relay core kept a user OFF (FIX v9.2)
+enum FailsafeWhy : uint8_t { FS_WIFI = 1, FS_MQTT, FS_AP, FS_GATEWAY, FS_REFUSED = 0x80 };
+
+static const char* const EV_TYPE_NAMES[EV_TYPE_COUNT] = {
+  "?", "boot", "relay", "failsafe", "wifi_up", "wifi_down",
+  "mqtt_up", "mqtt_fail", "clock", "restart"
+};
+
+struct __attribute__((packed)) EvRecord {
+  uint32_t seq;        // 0xFFFFFFFF = erased slot
+  uint32_t epoch;      // unix seconds, 0 = wall clock not set yet
+  uint32_t upS;        // uptime, seconds
+  uint8_t  type;       // EvType
+  uint8_t  crc;        // CRC-8 of the other 15 bytes
+  uint16_t value;
+};
+
+class EventLog {
+public:
+  static const uint32_t REC_SIZE = sizeof(EvRecord);
+
+  explicit EventLog(hal::Flash& flash) : _flash(flash) {}
+
+  bool     begin();                      // find the head; false if the region is unusable
+  bool     ready() const { return _cap != 0; }
+  bool     append(uint8_t type, uint16_t value, uint32_t epoch, uint32_t upS);
+
+  uint32_t nextSeq()   const;
+  uint32_t oldestSeq() const;
+  uint32_t count()     const;
+  uint32_t capacity()  const { return _cap; }
+  uint32_t writeErrors() const { return _errors; }
+
+  // Reads up to n records from seq on, stopping at the end of the
+  // partition or the head; returns how many slots were read. Check
+  // each with valid(rec, seq + i) — a slot may be torn, and one
+  // recycled during the read comes back blank.
+  size_t   read(uint32_t seq, EvRecord* out, size_t n);
+  static bool valid(const EvRecord& r, uint32_t seq);
+
+private:
+  struct Pos { uint32_t head, nextSeq; };
+  static uint8_t crc8(const EvRecord& r);
+  Pos      pos() const;                  // consistent head/nextSeq pair
+  uint32_t countAt(const Pos& p) const;
+  uint32_t slotOf(const Pos& p, uint32_t seq) const { return (p.head + _cap - (p.nextSeq - seq)) % _cap; }
+
+  hal::Flash& _flash;
+  uint32_t    _cap       = 0;   // slots
+  uint32_t    _perSector = 0;
+  mutable hal::Spinlock _pos;   // guards _head + _nextSeq
+  uint32_t    _head      = 0;   // next slot to write
+  uint32_t    _nextSeq   = 1;
+  bool        _headErased = false;   // sector at _head already blank
+  uint32_t    _errors    = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#if defined(ARDUINO)
+#include <freertos/FreeRTOS.h>
+#endif
+
+// ============================================================
+//  HAL — the few hardware services the portable core needs.
+//  Firmware bindings live in hal_esp32.h; env:native supplies
+//  host fakes (src/bench/). Every call is one virtual dispatch,
+//  cheap next to the GPIO/NVS/MQTT work behind it.
+// ============================================================
+namespace hal {
+
+class Clock {
+public:
+  virtual ~Clock() {}
+  virtual uint64_t nowUs() = 0;          // monotonic, 64-bit, never wraps
+  uint64_t nowMs() { return nowUs() / 1000; }
+};
+
+class Gpio {
+public:
+  virtual ~Gpio() {}
+  virtual void write(int pin, int level) = 0;
+};
+
+// One NVS namespace, already opened
+class Nvs {
+public:
+  virtual ~Nvs() {}
+  virtual bool     has(const char* key) = 0;
+  virtual bool     getBool(const char* key, bool def) = 0;
+  virtual uint32_t getU32(const char* key, uint32_t def) = 0;
+  virtual uint64_t getU64(const char* key, uint64_t def) = 0;
+  virtual void     putBool(const char* key, bool v) = 0;
+  virtual void     putU64(const char* key, uint64_t v) = 0;
+};
+
+class Mqtt {
+public:
+  virtual ~Mqtt() {}
+  virtual bool connected() = 0;
+  virtual bool publish(const char* topic, const uint8_t* payload, size_t len, bool retain) = 0;
+  bool publish(const char* topic, const char* text, bool retain);
+};
+
+// A raw flash region (one data partition). Offsets are relative to
+// its start; erase() takes whole sectors and sets them to 0xFF.
+class Flash {
+public:
+  virtual ~Flash() {}
+  virtual uint32_t size() = 0;
+  virtual uint32_t sectorSize() = 0;
+  virtual bool     read(uint32_t off, void* dst, uint32_t len) = 0;
+  virtual bool     write(uint32_t off, const void* src, uint32_t len) = 0;
+  virtual bool     erase(uint32_t off, uint32_t len) = 0;
+};
+
+inline bool Mqtt::publish(const char* topic, const char* text, bool retain) {
+  size_t n = 0;
+  while (text[n]) n++;
+  return publish(topic, (const uint8_t*)text, n, retain);
+}
+
+// Guards 64-bit fields shared between tasks (they tear on the
+// 32-bit ESP32). Host builds are single-threaded: no-op.
+#if defined(ARDUINO)
+class Spinlock {
+public:
+  void lock()   { portENTER_CRITICAL(&_mux); }
+  void unlock() { portEXIT_CRITICAL(&_mux); }
+private:
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+#else
+class Spinlock {
+public:
+  void lock()   {}
+  void unlock() {}
+};
+#endif
+
+}  // namespace hal
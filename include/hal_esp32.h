@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include "hal.h"
+
+// ============================================================
+//  HAL bindings for the ESP32 Arduino core
+// ============================================================
+class EspClock : public hal::Clock {
+public:
+  uint64_t nowUs() override { return (uint64_t)esp_timer_get_time(); }
+};
+
+class ArduinoGpio : public hal::Gpio {
+public:
+  void write(int pin, int level) override { digitalWrite(pin, level); }
+};
+
+// Preferences namespace; begin() before first use, keeps it open
+class PrefsNvs : public hal::Nvs {
+public:
+  explicit PrefsNvs(const char* ns) : _ns(ns) {}
+  bool begin() { return _p.begin(_ns, false); }
+
+  bool     has(const char* key) override                   { return _p.isKey(key); }
+  bool     getBool(const char* key, bool def) override     { return _p.getBool(key, def); }
+  uint32_t getU32(const char* key, uint32_t def) override  { return _p.getULong(key, def); }
+  uint64_t getU64(const char* key, uint64_t def) override  { return _p.getULong64(key, def); }
+  void     putBool(const char* key, bool v) override       { _p.putBool(key, v); }
+  void     putU64(const char* key, uint64_t v) override    { _p.putULong64(key, v); }
+
+private:
+  const char* _ns;
+  Preferences _p;
+};
+
+// Data partition by label; begin() false if the table lacks it
+class PartitionFlash : public hal::Flash {
+public:
+  explicit PartitionFlash(const char* label) : _label(label) {}
+  bool begin() {
+    _p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, _label);
+    return _p != nullptr;
+  }
+
+  uint32_t size() override       { return _p ? _p->size : 0; }
+  uint32_t sectorSize() override { return SPI_FLASH_SEC_SIZE; }
+  bool read(uint32_t off, void* dst, uint32_t len) override {
+    return _p && esp_partition_read(_p, off, dst, len) == ESP_OK;
+  }
+  bool write(uint32_t off, const void* src, uint32_t len) override {
+    return _p && esp_partition_write(_p, off, src, len) == ESP_OK;
+  }
+  bool erase(uint32_t off, uint32_t len) override {
+    return _p && esp_partition_erase_range(_p, off, len) == ESP_OK;
+  }
+
+private:
+  const char*            _label;
+  const esp_partition_t* _p = nullptr;
+};
+
+class PubSubMqtt : public hal::Mqtt {
+public:
+  explicit PubSubMqtt(PubSubClient& c) : _c(c) {}
+  using hal::Mqtt::publish;
+  bool connected() override { return _c.connected(); }
+  bool publish(const char* topic, const uint8_t* payload, size_t len, bool retain) override {
+    return _c.publish(topic, payload, len, retain);
+  }
+
+private:
+  PubSubClient& _c;
+};
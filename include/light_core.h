@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include "hal.h"
+
+// ============================================================
+//  LightCore — relay state machine, on-time/energy accounting
+//  and coalesced NVS persistence, free of Arduino calls.
+//  The firmware owns one instance (control task writes, every
+//  task reads); env:native drives the same code against fakes.
+//
+//  FIX v9.2 semantics live here: set() records an explicit user
+//  OFF, and force() (fail-safe) will not override it.
+//
+//  The last applied desired-state version (MQTT .../desired)
+//  rides in the same coalesced flush as the relay state, so NVS
+//  never holds a relay state older than the version it answered.
+// ============================================================
+class LightCore {
+public:
+  struct Config {
+    int      pin;
+    int      levelOn;
+    int      levelOff;
+    uint32_t wattageMw;    // fixed rating → energy = power × on-time
+    uint32_t coalesceMs;   // NVS write delay after a change
+    uint32_t journalMs;    // max on-time lost to a power cut
+  };
+
+  // state: "ls" namespace (keys l1, dv), onTime: "ot" namespace (key ms)
+  LightCore(const Config& cfg, hal::Clock& clock, hal::Gpio& gpio,
+            hal::Nvs& state, hal::Nvs& onTime);
+
+  void begin();                          // restore last state + on-time, drive the pin
+  bool set(bool on, bool persist = true);   // true if the relay moved
+  bool force(bool on);                   // false if refused (user commanded OFF)
+  void setDesiredVersion(uint64_t v);    // any task; saved with the next state flush
+  void tick();                           // commit writes whose deadline passed
+  void flush();                          // commit pending writes now
+
+  bool     on()            const { return _on; }
+  bool     userForcedOff() const { return _userOff; }
+  int64_t  lastRelayUs()   const { return _lastRelayUs; }
+  uint64_t bootOnMs()      const { return _bootOnMs; }
+  uint32_t nvsWrites()     const { return _writes; }
+  uint64_t desiredVersion();
+  uint64_t onTimeMs();
+  // 150 W for 3 years ≈ 3.9e6 Wh → 1.4e16 in the product, far from 2^64
+  uint64_t energyMwh()           { return onTimeMs() * _cfg.wattageMw / 3600000ULL; }
+
+private:
+  void drive(bool on);
+  void onTimeStart();
+  void onTimeStop();
+  void markOnTime();
+
+  Config        _cfg;
+  hal::Clock&   _clock;
+  hal::Gpio&    _gpio;
+  hal::Nvs&     _stateNvs;
+  hal::Nvs&     _onNvs;
+
+  volatile bool _on          = false;  // flipped by onTimeStart/Stop under _acct
+  volatile bool _userOff     = false;
+  int64_t       _lastRelayUs = 0;      // set right after the GPIO write
+
+  // 64-bit ms; written by the control task, read everywhere.
+  // Also guards the desired version, which the network task sets.
+  hal::Spinlock _acct;
+  uint64_t      _onMsTotal   = 0;      // closed ON intervals incl. previous boots
+  uint64_t      _onSinceMs   = 0;      // start of the open ON interval, valid while _on
+  uint64_t      _bootOnMs    = 0;      // _onMsTotal as restored from NVS
+  uint64_t      _desiredV    = 0;
+  bool          _desiredDirty = false;
+  uint64_t      _desiredDirtyMs = 0;
+
+  // persistence bookkeeping (control task)
+  bool          _savedOn     = true;   // value currently in NVS
+  uint64_t      _savedOnMs   = 0;
+  uint64_t      _savedDesiredV = 0;
+  bool          _pendingOn   = true;
+  bool          _stateDirty  = false;
+  bool          _onDirty     = false;
+  uint64_t      _stateDirtyMs = 0;
+  uint64_t      _onDirtyMs   = 0;
+  uint64_t      _journalMs   = 0;
+  uint32_t      _writes      = 0;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+// ============================================================
+//  PHASE — deterministic per-device offsets and jitter, so a
+//  fleet that powered up (or lost the broker) together does not
+//  retry, beacon and report in lockstep. The same identity gives
+//  the same schedule every boot: field logs stay comparable.
+//  Portable, no Arduino dependency (env:native).
+//
+//  Provisioned lights use their fleet slot, which spaces the grid
+//  exactly evenly over any period; anything else (unprovisioned,
+//  or a slot past the grid) falls back to a hash of the eFuse MAC.
+// ============================================================
+// One salt per timer, so a device's timers don't share a phase
+enum PhaseSalt : uint8_t { PH_MQTT = 1, PH_WIFI, PH_TELE, PH_BEACON, PH_BATCH, PH_SWITCH, PH_REPORT };
+
+// murmur3 fmix32 — full avalanche, a few cycles
+inline uint32_t phaseMix(uint32_t x) {
+  x ^= x >> 16; x *= 0x85EBCA6Bu;
+  x ^= x >> 13; x *= 0xC2B2AE35u;
+  x ^= x >> 16;
+  return x;
+}
+
+class DevicePhase {
+public:
+  void begin(uint64_t mac, uint16_t slot, uint16_t slots) {
+    _seed  = phaseMix((uint32_t)mac ^ phaseMix((uint32_t)(mac >> 32)));
+    _slot  = slot;
+    _slots = slot < slots ? slots : 0;
+  }
+
+  // Fixed offset in [0, periodMs) for timer `salt`
+  uint32_t offset(uint32_t periodMs, uint8_t salt) const {
+    if (!periodMs) return 0;
+    if (_slots) {
+      // rotate the slot order per timer so slot 0 isn't first everywhere
+      uint16_t s = (uint16_t)((_slot + salt * 7u) % _slots);
+      return (uint32_t)((uint64_t)periodMs * s / _slots);
+    }
+    return phaseMix(_seed + salt) % periodMs;
+  }
+
+  // Group switch offset in [0, spreadMs): index i of `slots` starts
+  // at i/slots of the window (row: light / 6, fleet: slot / 36), so
+  // the group ramps evenly; an index past the grid (unprovisioned:
+  // pass 0xFFFF) takes this device's own PH_SWITCH phase
+  uint32_t spreadOffset(uint32_t spreadMs, uint16_t i, uint16_t slots) const {
+    if (i >= slots) return offset(spreadMs, PH_SWITCH);
+    return (uint32_t)((uint64_t)spreadMs * i / slots);
+  }
+
+  // Deterministic jitter in [0, spanMs) for the n-th event of `salt`
+  uint32_t jitter(uint32_t spanMs, uint8_t salt, uint32_t n) const {
+    return spanMs ? phaseMix(_seed ^ phaseMix(n * 0x9E3779B9u + salt)) % spanMs : 0;
+  }
+
+  // First point of this device's periodMs grid at least minMs after
+  // now. Intervals stay in [minMs, minMs + periodMs) and the devices
+  // keep their spacing however their publishes drift. The grid is
+  // anchored to millis(), so it hops once at the 49-day wrap.
+  uint32_t nextOnGrid(uint32_t now, uint32_t periodMs, uint32_t minMs, uint8_t salt) const {
+    if (!periodMs) return now + minMs;
+    uint32_t t   = now + minMs;
+    uint32_t off = offset(periodMs, salt);
+    if (t <= off) return off;
+    uint32_t r   = (t - off) % periodMs;
+    return r ? t + (periodMs - r) : t;
+  }
+
+private:
+  uint32_t _seed  = 0;
+  uint16_t _slot  = 0;
+  uint16_t _slots = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// ============================================================
+//  SCHEDULE — weekday/time switching rules, no Arduino
+//  dependency: parsing and next-event search are shared with
+//  env:native. The firmware owns the clock and the timer.
+//
+//  Retained on aipl/all/schedule, one message for the floor:
+//    {"v":7,"tz":"IST-5:30","rules":[
+//      {"days":62,"at":"06:00","state":"ON"},
+//      {"days":62,"at":"22:00","state":"OFF","rows":[0,1]}]}
+//  days  bitmask, bit 0 = Sunday … bit 6 = Saturday (tm_wday)
+//  rows / lights  optional 0-based filters; absent = every light
+//  An empty rules array clears the schedule.
+// ============================================================
+const uint8_t SCHED_MAX_RULES = 16;
+const uint8_t SCHED_TZ_MAX    = 32;
+const uint8_t SCHED_FILTER_MAX = 6;     // ids in one rows / lights list (6 × 6 floor)
+const size_t  SCHED_MSG_MAX   = 960;    // server.js cap: MQTT buffer 1024 incl. topic
+
+struct SchedRule {
+  uint8_t  days;
+  bool     state;
+  uint16_t minute;     // 0..1439, local time
+};
+
+struct Schedule {
+  uint32_t  version;   // "v" — a repeat is a retained redelivery
+  uint8_t   count;
+  char      tz[SCHED_TZ_MAX];   // POSIX TZ, e.g. "IST-5:30"
+  SchedRule rules[SCHED_MAX_RULES];
+};
+
+// Keeps only the rules addressed to (row, light), the first
+// SCHED_MAX_RULES of them; false = bad JSON or over the message caps.
+// Parses into a static document — one caller (network task) at a time.
+bool     parseSchedule(const uint8_t* p, unsigned int len, uint8_t row, uint8_t light, Schedule& out);
+// Seconds from (wday, secOfDay) to the next event strictly after it,
+// 0 if none. On a tie the later rule wins, like a replayed list.
+uint32_t scheduleNext(const Schedule& s, uint8_t wday, uint32_t secOfDay, bool& state);
+// Absolute time of the next event after now in the current TZ, 0 if
+// none. Days are counted on the local calendar, so a DST change in
+// between moves the instant, not the wall-clock time of the rule.
+time_t   scheduleNextAt(const Schedule& s, time_t now, bool& state);
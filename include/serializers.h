@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// ============================================================
+//  SERIALIZERS — JSON / CBOR straight into a caller buffer:
+//  no String, no JsonDocument, no heap. Portable (env:native).
+// ============================================================
+// Append-only JSON object writer over a fixed buffer. Never overruns:
+// if cap is too small the writer stops and finish() returns 0, like
+// CborWriter::length(). Keys and string values are trusted literals,
+// so no escaping is done.
+class JsonWriter {
+public:
+  JsonWriter(char* buf, size_t cap) : _buf(buf), _cap(cap) { raw("{"); }
+
+  void addBool (const char* k, bool v)                { key(k); raw(v ? "true" : "false"); }
+  void addInt  (const char* k, int32_t v)             { key(k); fmt("%ld", (long)v); }
+  void addUInt (const char* k, uint32_t v)            { key(k); fmt("%lu", (unsigned long)v); }
+  void addU64  (const char* k, uint64_t v)            { key(k); fmt("%llu", (unsigned long long)v); }
+  // Fixed-point v / 10^shift with dp (1..shift) digits, truncated — no float rounding
+  void addFixed(const char* k, uint64_t v, uint8_t shift, uint8_t dp) {
+    uint64_t div = 1, drop = 1;
+    for (uint8_t i = 0; i < shift; i++)      div  *= 10;
+    for (uint8_t i = dp; i < shift; i++)     drop *= 10;
+    key(k);
+    fmt("%llu.%0*llu", (unsigned long long)(v / div), (int)dp,
+        (unsigned long long)((v % div) / drop));
+  }
+  void addFloat(const char* k, float v, uint8_t dp)   { key(k); fmt("%.*f", dp, (double)v); }
+  void addStr  (const char* k, const char* v)         { key(k); raw("\""); raw(v); raw("\""); }
+  void addJson (const char* k, const char* v)         { key(k); raw(v); }   // v is already JSON
+  void beginObj(const char* k)                        { key(k); raw("{"); _first = true; }
+  void beginObj()                                     { sep();  raw("{"); _first = true; }   // array element
+  void endObj()                                       { raw("}"); _first = false; }
+  void beginArr(const char* k)                        { key(k); raw("["); _first = true; }
+  void endArr()                                       { raw("]"); _first = false; }
+  void item    (uint32_t v)                           { sep(); fmt("%lu", (unsigned long)v); }
+  size_t finish()                                     { raw("}"); return _overflow ? 0 : _len; }
+  bool   ok() const                                   { return !_overflow; }
+
+private:
+  void sep() {
+    if (!_first) raw(",");
+    _first = false;
+  }
+  void key(const char* k) {
+    sep();
+    raw("\""); raw(k); raw("\":");
+  }
+  void raw(const char* s) { fmt("%s", s); }
+  void fmt(const char* f, ...) {
+    if (_overflow) return;               // sticky: nothing after a cut-off piece
+    if (_len + 1 >= _cap) { _overflow = true; return; }
+    va_list ap;
+    va_start(ap, f);
+    int n = vsnprintf(_buf + _len, _cap - _len, f, ap);
+    va_end(ap);
+    if (n < 0 || _len + n >= _cap) { _overflow = true; _buf[_len] = 0; return; }
+    _len += n;
+  }
+
+  char*  _buf;
+  size_t _cap;
+  size_t _len      = 0;
+  bool   _first    = true;
+  bool   _overflow = false;
+};
+
+// Minimal definite-length CBOR (RFC 8949) encoder over a fixed
+// buffer — just the major types telemetry needs.
+class CborWriter {
+public:
+  CborWriter(uint8_t* buf, size_t cap) : _buf(buf), _cap(cap) {}
+
+  void map (uint32_t n)  { head(5, n); }
+  void array(uint32_t n) { head(4, n); }
+  void uint(uint32_t v)  { head(0, v); }
+  void sint(int32_t v)   { if (v >= 0) head(0, (uint32_t)v); else head(1, (uint32_t)(-1 - v)); }
+  void boolean(bool v)   { byte1(v ? 0xF5 : 0xF4); }
+  void f32(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, 4);
+    byte1(0xFA);
+    be(bits, 4);
+  }
+  size_t length() const  { return _overflow ? 0 : _len; }
+
+private:
+  void head(uint8_t major, uint32_t v) {
+    uint8_t mt = major << 5;
+    if      (v < 24)      { byte1(mt | v); }
+    else if (v <= 0xFF)   { byte1(mt | 24); be(v, 1); }
+    else if (v <= 0xFFFF) { byte1(mt | 25); be(v, 2); }
+    else                  { byte1(mt | 26); be(v, 4); }
+  }
+  void be(uint32_t v, uint8_t n) { while (n--) byte1((uint8_t)(v >> (8 * n))); }
+  void byte1(uint8_t b) {
+    if (_len < _cap) _buf[_len++] = b;
+    else             _overflow = true;
+  }
+
+  uint8_t* _buf;
+  size_t   _cap;
+  size_t   _len      = 0;
+  bool     _overflow = false;
+};
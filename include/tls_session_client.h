@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/x509_crt.h>
+
+// ============================================================
+//  TlsSessionClient — drop-in Client for PubSubClient that
+//  resumes TLS sessions instead of re-handshaking from scratch.
+//
+//  WiFiClientSecure tears down its mbedTLS context on every
+//  stop() and has no hook to offer a cached session, so each
+//  reconnect pays a full RSA/ECDHE handshake. This client:
+//    - parses the pinned CA and seeds the DRBG once (warm config)
+//    - caches the negotiated session (ID or ticket) after each
+//      handshake and offers it on the next connect()
+//    - mirrors the session into RTC memory so it also survives
+//      a software reset
+// ============================================================
+class TlsSessionClient : public Client {
+public:
+  TlsSessionClient();
+  ~TlsSessionClient();
+
+  // PEM must stay valid for the lifetime of the client
+  void setCACert(const char* pem)          { _caPem = pem; }
+  void setHandshakeTimeout(uint32_t ms)    { _handshakeTimeoutMs = ms; }
+
+  int     connect(IPAddress ip, uint16_t port) override;
+  int     connect(const char* host, uint16_t port) override;
+  size_t  write(uint8_t b) override;
+  size_t  write(const uint8_t* buf, size_t size) override;
+  int     available() override;
+  int     read() override;
+  int     read(uint8_t* buf, size_t size) override;
+  int     peek() override;
+  void    flush() override;
+  void    stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+  void     clearSession();                 // force a full handshake next time
+  uint32_t lastHandshakeMs() const { return _lastHandshakeMs; }
+  bool     lastResumed()     const { return _lastResumed; }
+  uint32_t resumedCount()    const { return _resumedCount; }
+  uint32_t fullCount()       const { return _fullCount; }
+  int      lastError()       const { return _lastError; }
+
+private:
+  bool warmUp();
+  int  handshake(const char* host, uint16_t port, bool tcpOk);
+  void cacheSession();
+  void loadRtcSession();
+  void saveRtcSession();
+
+  static int bioSend(void* ctx, const unsigned char* buf, size_t len);
+  static int bioRecv(void* ctx, unsigned char* buf, size_t len);
+
+  WiFiClient               _tcp;
+  mbedtls_ssl_context      _ssl;
+  mbedtls_ssl_config       _conf;
+  mbedtls_ctr_drbg_context _drbg;
+  mbedtls_entropy_context  _entropy;
+  mbedtls_x509_crt         _ca;
+  mbedtls_ssl_session      _session;
+
+  const char* _caPem              = nullptr;
+  uint32_t    _handshakeTimeoutMs = 10000;
+  bool        _warm               = false;
+  bool        _haveSession        = false;
+  bool        _open               = false;
+  int         _peeked             = -1;
+  int         _lastError          = 0;
+
+  uint32_t _lastHandshakeMs = 0;
+  bool     _lastResumed     = false;
+  uint32_t _resumedCount    = 0;
+  uint32_t _fullCount       = 0;
+};
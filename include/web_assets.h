@@ -0,0 +1,134 @@
+// GENERATED by tools/gzip_assets.py from web/ and public/ — do not edit
+#pragma once
+#include <Arduino.h>
+
+struct WebAsset {
+  const char*    type;
+  const uint8_t* gz;     // PROGMEM, served with Content-Encoding: gzip
+  size_t         len;
+  const char*    etag;   // quoted, as sent on the wire
+};
+
+// web/setup.html  1805 → 953 bytes
+static const uint8_t asset_setup_html_gz[] PROGMEM = {
+  0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x8d,0x55,0x6b,0x6f,0xdb,0x36,
+  0x14,0xfd,0xae,0x5f,0xc1,0x21,0xd8,0x68,0xaf,0xd5,0xcb,0x71,0xd2,0x4c,0x0f,0x03,
+  0x43,0xda,0x01,0x05,0x8a,0xd5,0x58,0x32,0x0c,0xc3,0x30,0x0c,0xb4,0x74,0x65,0x31,
+  0x91,0x48,0x95,0xa4,0xfc,0xa8,0xe1,0xdf,0xd5,0xef,0xfd,0x65,0xbb,0xa4,0x94,0x38,
+  0x29,0x0a,0xb4,0x5f,0x4c,0xdd,0x4b,0xf2,0xdc,0xc3,0xc3,0x73,0xe9,0xec,0x87,0xd7,
+  0xef,0xaf,0x6f,0xff,0x5e,0xbe,0x21,0xb5,0x69,0x9b,0x45,0x36,0xfe,0x02,0x2b,0x17,
+  0x5e,0xd6,0x82,0x61,0x44,0xb0,0x16,0x72,0xba,0xe1,0xb0,0xed,0xa4,0x32,0x94,0x14,
+  0x52,0x18,0x10,0x26,0xa7,0x5b,0x5e,0x9a,0x3a,0x2f,0x61,0xc3,0x0b,0xf0,0x5d,0xf0,
+  0x92,0x0b,0x6e,0x38,0x6b,0x7c,0x5d,0xb0,0x06,0xf2,0x98,0x86,0x08,0xd2,0x70,0x71,
+  0x4f,0x14,0x34,0x39,0xe5,0xb8,0x95,0x92,0x5a,0x41,0x95,0xd3,0xb0,0x62,0x1b,0x1b,
+  0x07,0x7a,0xb3,0x76,0xcb,0x0c,0x37,0x0d,0x2c,0x7e,0x7d,0xbb,0x7c,0x47,0x6e,0xc0,
+  0xf4,0x5d,0x16,0x0e,0x19,0x2f,0xd3,0x66,0x6f,0xc7,0x9f,0x0f,0x2b,0xb9,0xf3,0x35,
+  0xff,0xc8,0xc5,0x3a,0x59,0x49,0x55,0x82,0xf2,0x31,0x73,0xf4,0x56,0xb2,0xdc,0x1f,
+  0x2a,0x64,0xe5,0x57,0xac,0xe5,0xcd,0x3e,0xd1,0x4c,0x68,0x5f,0x83,0xe2,0x55,0xba,
+  0x62,0xc5,0xfd,0x5a,0xc9,0x5e,0x94,0xc9,0x59,0x74,0x19,0xfd,0x12,0x95,0x69,0x21,
+  0x1b,0xa9,0x92,0xb3,0xb2,0x84,0x39,0x40,0x5a,0x72,0xdd,0x35,0x6c,0x9f,0x54,0x0d,
+  0xec,0x52,0xd6,0xf0,0xb5,0xf0,0xb9,0x81,0x56,0x27,0x05,0x9e,0x11,0x54,0x7a,0xd7,
+  0x6b,0xc3,0xab,0xbd,0x3f,0x9e,0xfa,0x21,0xdd,0x72,0xe1,0xd7,0xc0,0xd7,0xb5,0x49,
+  0xe2,0x28,0xda,0xd4,0x69,0xcb,0xd4,0x9a,0x8b,0x24,0x3a,0x7a,0x41,0x71,0x78,0x56,
+  0x15,0xe2,0x8b,0x18,0xd2,0x81,0x70,0x12,0x77,0x3b,0xa2,0x65,0xc3,0x4b,0x72,0x16,
+  0x5f,0xcd,0xa2,0xf3,0x68,0x9c,0xf0,0x15,0x2b,0x79,0xaf,0x93,0xf8,0xb2,0xdb,0xa5,
+  0x1d,0x2b,0x4b,0x7b,0xc8,0xf3,0x19,0x06,0x2d,0xdb,0x0d,0xe2,0x26,0xe7,0x57,0x11,
+  0xc6,0xc3,0x37,0x16,0xfd,0xf1,0xe8,0xd5,0xb3,0xc3,0x50,0x17,0x85,0x30,0x46,0xb6,
+  0xc9,0xcc,0xae,0x18,0x0f,0x58,0x5d,0x14,0x57,0x51,0x94,0x36,0x60,0x90,0xb0,0xaf,
+  0x3b,0x56,0x38,0xcc,0x0e,0x15,0x6b,0xd8,0x0a,0x9a,0x41,0x32,0xd4,0x13,0x92,0x78,
+  0x76,0xda,0x36,0x67,0x97,0xd1,0xab,0xe8,0x51,0x97,0x55,0x23,0x8b,0xfb,0xf4,0x79,
+  0x95,0xb9,0xa3,0xe5,0x32,0x46,0x76,0x6e,0xf7,0xd1,0xe3,0xa2,0xeb,0xcd,0xe1,0xc4,
+  0xee,0xf1,0x14,0xb1,0xe5,0xf4,0x4c,0x91,0x55,0x1c,0xc5,0x57,0xdf,0xab,0xc8,0x15,
+  0xee,0x7e,0xc2,0x74,0x7e,0x62,0x3a,0xdc,0x20,0xde,0x7f,0x8f,0xac,0xc4,0xd3,0xd2,
+  0x4f,0xc8,0x39,0x45,0x1e,0xa9,0xcc,0xbe,0xa0,0x32,0x6a,0x34,0x02,0x8e,0x06,0x19,
+  0x89,0x09,0x29,0xe0,0xdb,0x5c,0x5c,0xb8,0x1d,0x9c,0xf0,0xca,0x42,0xf5,0x4a,0x23,
+  0x56,0x27,0xb9,0xf5,0x09,0xba,0x41,0x48,0x03,0x87,0xa7,0x6a,0xcd,0x9f,0x83,0xc4,
+  0xa7,0x03,0x9d,0x9f,0xcf,0xe7,0x17,0x17,0xa9,0x81,0x9d,0xf1,0x9d,0x15,0x47,0xb7,
+  0x1d,0xbd,0x2c,0x1c,0x9a,0x20,0x0b,0x5d,0x67,0x66,0xd6,0xf2,0x8b,0xac,0xe4,0x1b,
+  0x52,0x34,0x4c,0xeb,0x9c,0x16,0x14,0x1b,0xa5,0x9e,0x8d,0xfd,0xf3,0xe6,0xf6,0xcf,
+  0x25,0x2e,0x9d,0x61,0xae,0x92,0xaa,0x25,0xac,0x30,0x5c,0x0a,0x6c,0x3a,0xcd,0x36,
+  0x40,0x09,0xb6,0x75,0x2d,0xcb,0x9c,0x2e,0xdf,0xdf,0xdc,0xda,0x7d,0xce,0x0e,0x8b,
+  0xbf,0xf8,0x6f,0x9c,0xdc,0xdc,0xbc,0x7d,0x9d,0x85,0x43,0xc2,0xcb,0xdc,0x9d,0x12,
+  0xb3,0xef,0xf0,0x01,0xb0,0xac,0xe8,0xf8,0x18,0x68,0xcd,0x4b,0x8a,0x3d,0xfd,0xa1,
+  0xe7,0x0a,0x4a,0x82,0x46,0x29,0xa0,0x96,0x0d,0x2a,0x95,0xd3,0xdf,0xc1,0x6c,0xa5,
+  0xba,0x77,0x2b,0x87,0xfe,0x77,0x60,0x4b,0xa4,0x89,0xf9,0xf2,0xeb,0xe0,0xdd,0x38,
+  0xfb,0x50,0xe0,0x14,0x3f,0xc3,0x76,0x14,0x1f,0xe7,0x4e,0xe0,0x7f,0xc8,0xed,0xd7,
+  0x71,0x45,0xdf,0xae,0x40,0x51,0xc2,0xf1,0xb4,0x4a,0x6e,0x1f,0xe0,0xdd,0x27,0xb6,
+  0x70,0x4e,0x63,0x1c,0xd9,0x2e,0xa7,0xb3,0x8b,0xf9,0x17,0xb5,0xe2,0x27,0xf8,0xef,
+  0xec,0xf5,0x7e,0xbb,0x42,0x63,0x97,0x3d,0xd4,0x18,0x83,0xef,0xaa,0x32,0x38,0x78,
+  0x44,0xd4,0xfd,0xaa,0xe5,0x86,0x2e,0x6e,0xf0,0xae,0xc8,0x4f,0xac,0xed,0x52,0x72,
+  0x2d,0x85,0x80,0x02,0x19,0x0c,0x0b,0x71,0x47,0x68,0xef,0x15,0xc7,0xee,0xc1,0x00,
+  0xd6,0x66,0x03,0x0b,0xf7,0x85,0x4e,0xe9,0xec,0x32,0xb4,0x88,0x7d,0x41,0x0b,0xc5,
+  0x3b,0xb3,0xf0,0xc2,0x90,0x2c,0xd9,0x1a,0x08,0xd7,0x44,0x1b,0x66,0x78,0x41,0x26,
+  0xf8,0x4c,0x6e,0xf0,0x0a,0xd7,0x1f,0x79,0xd7,0xe1,0x58,0x29,0xd9,0x92,0x0a,0x21,
+  0xeb,0x69,0x8a,0x68,0x68,0x3f,0x6e,0xf6,0xf8,0xe4,0xb7,0xa0,0x87,0x39,0x53,0x03,
+  0x19,0x9e,0x7c,0xaf,0x02,0x53,0xd4,0x13,0x1a,0xb2,0x8e,0x87,0x16,0xae,0xd7,0x74,
+  0x1a,0xe0,0xbc,0x98,0xa8,0x7c,0xa1,0x82,0x3b,0x2d,0xc5,0x64,0x3a,0x66,0x74,0xbe,
+  0x38,0x78,0x84,0xf0,0x6a,0xa2,0x03,0x54,0x7f,0x91,0x47,0xd3,0x03,0x8e,0xc1,0x86,
+  0x35,0x3d,0xe4,0x2e,0xf7,0x22,0x4e,0x9d,0x66,0x8f,0x39,0x17,0xbd,0x88,0x8f,0xb8,
+  0xcf,0x9e,0x29,0xb0,0x0e,0xbc,0x1e,0xff,0x7c,0xfe,0xd1,0xc1,0xc0,0xe2,0x3f,0x5e,
+  0xbe,0xd4,0x41,0xcb,0x0a,0xfc,0xad,0xb8,0x6a,0xb7,0x4c,0xc1,0xbf,0xc1,0x1d,0xb6,
+  0xdf,0x84,0x92,0xcf,0x9f,0x08,0x9d,0x7a,0xc7,0x69,0x50,0x30,0x4b,0x75,0x32,0x45,
+  0x16,0xc7,0xa9,0xed,0xa6,0x51,0x10,0x54,0xd4,0x75,0x52,0xe8,0xfe,0xf6,0xbc,0xff,
+  0x01,0xdc,0xfa,0x10,0x24,0x0d,0x07,0x00,0x00,
+};
+static const WebAsset ASSET_SETUP_HTML = { "text/html", asset_setup_html_gz, sizeof(asset_setup_html_gz), "\"6e2bc08dc05a\"" };
+
+// web/saved.html  161 → 160 bytes
+static const uint8_t asset_saved_html_gz[] PROGMEM = {
+  0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x1d,0x8e,0x4b,0x0e,0x82,0x30,
+  0x14,0x00,0xf7,0x9c,0x02,0x43,0x22,0x2b,0xe0,0xf9,0x23,0xda,0x56,0x0e,0xa1,0x27,
+  0x28,0xed,0x2b,0x34,0x96,0x96,0xb4,0x4f,0x03,0xb7,0x17,0x5d,0xcd,0x66,0x32,0x19,
+  0x31,0xd2,0xe4,0x3a,0xd1,0x07,0xbd,0xe6,0x89,0x56,0x87,0xf7,0xd2,0x04,0x4f,0x95,
+  0x91,0x93,0x75,0x2b,0x4b,0xd2,0xa7,0x2a,0x61,0xb4,0x86,0x13,0x2e,0x54,0x49,0x67,
+  0x07,0xcf,0x14,0x7a,0xc2,0xc8,0x67,0xa9,0xb5,0xf5,0x03,0x3b,0xc3,0xbc,0xf0,0x5e,
+  0xaa,0xd7,0x10,0xc3,0xdb,0x6b,0x56,0x40,0x0b,0x37,0xd0,0x5c,0x05,0x17,0x22,0x2b,
+  0xcc,0x45,0x5d,0x01,0xca,0x2e,0x13,0xe3,0xb1,0xdb,0x17,0x07,0x00,0x38,0xf1,0xfc,
+  0x29,0x3f,0xa8,0x77,0xf9,0x03,0x13,0xc9,0x48,0x5b,0xa6,0xae,0x6b,0xd1,0x6c,0x86,
+  0x68,0x7e,0x33,0x1b,0xfe,0x67,0xd9,0x17,0x40,0xf9,0xef,0xa2,0xa1,0x00,0x00,0x00,
+};
+static const WebAsset ASSET_SAVED_HTML = { "text/html", asset_saved_html_gz, sizeof(asset_saved_html_gz), "\"a1fcefc82f18\"" };
+
+// public/favicon.svg  2082 → 611 bytes
+static const uint8_t asset_favicon_svg_gz[] PROGMEM = {
+  0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0xad,0x55,0xc1,0x8e,0xda,0x30,
+  0x10,0xbd,0xef,0x57,0x58,0x41,0x95,0xba,0xd2,0x96,0xd8,0x8e,0x1d,0x42,0x09,0x7b,
+  0x28,0x2d,0x7b,0x6a,0xa5,0xbd,0xf6,0x66,0x12,0x03,0x96,0x4c,0x12,0x39,0x66,0xc3,
+  0xfe,0x7d,0xc7,0x89,0x21,0xbb,0x50,0x2a,0xd8,0x82,0x90,0x67,0x70,0x3c,0xcf,0xef,
+  0x8d,0xe6,0x85,0xb4,0x7e,0x59,0xa1,0xdd,0x46,0x17,0xf5,0x34,0x58,0x5b,0x5b,0x7d,
+  0x0d,0xc3,0xa6,0x69,0x86,0x4d,0x34,0x2c,0xcd,0x2a,0xa4,0x18,0xe3,0x10,0x4e,0x04,
+  0xe8,0x45,0xc9,0xe6,0x5b,0xb9,0x9b,0x06,0x18,0x61,0x14,0x33,0xf8,0x06,0xa8,0x51,
+  0xb9,0x5d,0x4f,0x03,0x97,0xae,0xa5,0x5a,0xad,0x6d,0x9b,0x3f,0xde,0x21,0x94,0xe6,
+  0x72,0x59,0xbb,0x04,0x52,0x23,0x72,0x25,0xf4,0x93,0x0b,0xb2,0xb0,0x48,0xe5,0xd3,
+  0x60,0x01,0x80,0x19,0x60,0x71,0xfc,0x09,0x92,0x57,0x9f,0x98,0x2e,0x76,0x65,0x50,
+  0x58,0xdb,0xb2,0x42,0xe5,0x72,0x59,0x4b,0x00,0x76,0x07,0xdc,0xc6,0x97,0xac,0xd4,
+  0x25,0x9c,0x1c,0x60,0x49,0x04,0x95,0x41,0xf8,0xf7,0xe3,0x04,0x9f,0x16,0xc4,0x38,
+  0x27,0x62,0x5f,0x90,0x86,0xef,0x79,0x9d,0x27,0xab,0x65,0x51,0x1f,0xd1,0x65,0x9e,
+  0x6e,0x7c,0x39,0xdd,0xf9,0x7c,0xfe,0xfd,0x07,0x3e,0x47,0x97,0x9d,0x9e,0xe7,0xb3,
+  0x04,0xe3,0x2b,0xe4,0xcd,0x92,0x71,0xdc,0x17,0x5c,0x2e,0x6f,0x21,0xc5,0xe6,0x48,
+  0x9e,0x57,0xd7,0x5e,0x72,0xa9,0xbc,0x8e,0x6e,0xb7,0x59,0x56,0x22,0x53,0xd6,0x01,
+  0x0d,0x69,0x72,0x85,0x84,0x33,0x20,0xff,0xd2,0x94,0x86,0xfb,0x49,0x4b,0x33,0x65,
+  0x32,0x2d,0x5b,0x25,0x11,0xed,0x84,0xb8,0x68,0xba,0xb0,0x54,0x5a,0x4f,0x83,0xad,
+  0xd1,0x9f,0x07,0x8b,0xd5,0x7d,0x07,0x99,0x56,0xa5,0x7e,0x5d,0x95,0x05,0xaa,0x4a,
+  0x55,0x58,0x30,0x00,0x49,0x1e,0xa2,0x04,0xb1,0xd8,0xad,0x9c,0x3e,0xc4,0x14,0x11,
+  0xb7,0xbe,0xaf,0x86,0x7e,0xdd,0xfb,0xb6,0xa4,0xa2,0x50,0x1b,0x61,0x25,0x12,0xd6,
+  0x1a,0xb5,0xd8,0x5a,0xf9,0x4b,0x6c,0xe4,0x34,0xf0,0xdc,0xc1,0x35,0x42,0x6f,0x65,
+  0xed,0x1a,0x11,0x4f,0xc8,0x04,0xd6,0x00,0xe5,0x5b,0x60,0x44,0x61,0xa2,0x8c,0xac,
+  0xa4,0xb0,0xb3,0x72,0x5b,0x40,0x37,0x54,0x01,0x3a,0x54,0xa1,0xac,0x9f,0xe8,0x34,
+  0xf4,0xdc,0xda,0x1f,0x46,0x66,0x16,0x81,0x2e,0x3a,0x0e,0x10,0xc8,0x8a,0x7b,0xeb,
+  0xf5,0xce,0x83,0x47,0xc6,0x1d,0xd9,0x93,0x1d,0x50,0x1e,0x31,0xe6,0xdb,0x7f,0x40,
+  0x20,0xac,0x45,0x20,0xbd,0x7b,0xa3,0x37,0x18,0x49,0x87,0x11,0x1d,0x30,0x48,0x46,
+  0x73,0x46,0x8f,0x31,0xe2,0x16,0x83,0x92,0x03,0x06,0x3f,0xa1,0x41,0x86,0xbc,0x07,
+  0x21,0x64,0x19,0xe1,0x23,0x10,0x1a,0xdd,0x00,0x04,0x36,0x6e,0x00,0x32,0xba,0x01,
+  0x08,0x63,0xff,0x01,0x52,0x09,0xbb,0x46,0x60,0xc5,0x9f,0x84,0x21,0x3a,0x46,0xcf,
+  0x10,0x58,0x84,0x22,0xea,0xd6,0x67,0x8e,0x5d,0x80,0x15,0x9e,0xfc,0xee,0xeb,0x39,
+  0xc5,0x11,0xf7,0xf5,0x52,0x6b,0x55,0xd5,0x47,0xa3,0xbf,0xbf,0x14,0x88,0x99,0x6e,
+  0x66,0x7c,0xa9,0x77,0xd9,0xd5,0x13,0x8c,0x13,0x18,0x60,0x4a,0x27,0x2e,0xbb,0x74,
+  0x8c,0xcf,0x5f,0x60,0x76,0x3d,0x36,0x61,0x13,0x32,0x9a,0x38,0xa6,0x97,0x9a,0xc3,
+  0x2b,0x3e,0xaf,0xde,0x4f,0x32,0xc1,0x9d,0x7a,0xd6,0xb7,0xbe,0x35,0xb1,0x7b,0xa7,
+  0x7f,0xc0,0xc4,0x09,0x6f,0x5d,0x9c,0xf0,0x1b,0x32,0x1d,0x39,0x6a,0x8e,0x2b,0xef,
+  0xa8,0xf6,0x06,0x9e,0xbb,0x0f,0x08,0x78,0xf3,0x3a,0x1d,0x5f,0xcf,0x79,0xd4,0x52,
+  0x1e,0x7d,0x80,0x71,0xea,0xfe,0xf9,0x1f,0xef,0xfe,0x00,0x1f,0xca,0x67,0x5a,0x22,
+  0x08,0x00,0x00,
+};
+static const WebAsset ASSET_FAVICON_SVG = { "image/svg+xml", asset_favicon_svg_gz, sizeof(asset_favicon_svg_gz), "\"7d1910e8301c\"" };
@@ -22,9 +22,43 @@ const HIVEMQ_CLIENT   = 'aipl-server-' + Math.random().toString(16).slice(2, 8);
 //  TOPIC HELPERS — must match firmware snprintf patterns exactly
 //
 //  Firmware publishes  : aipl/row/{R}/light/{L}/state      payload: ON | OFF
+//                        aipl/row/{R}/light/{L}/telemetry       JSON
+//                        aipl/row/{R}/light/{L}/telemetry/cbor  CBOR map (see info.cbor_keys)
+//                        aipl/row/{R}/light/{L}/info            JSON, retained
+//                        aipl/row/{R}/light/{L}/telemetry/backlog  CBOR batches buffered during outages
+//                        aipl/row/{R}/light/{L}/ack       {"seq","ts","state","changed","dev_us"}
+//                          one per traced command; dev_us = receive → relay GPIO
+//                        aipl/row/{R}/light/{L}/mesh      {"applied","origin","seq","state"}
+//                          on reconnect, if ESP-NOW mesh commands changed the light offline
+//                        aipl/row/{R}/telemetry/batch      {"gateway":L,"members":[{"light","state",
+//                          "rssi","on_s","up_s","energy_wh","age_s"}]}  gateway mode only; the
+//                          gateway also publishes its members' .../state topics
 //  Firmware subscribes : aipl/row/{R}/light/{L}/command    payload: ON | OFF
+//                          or traced: {"state":"ON","seq":42,"ts":<sender ms>}
 //                        aipl/row/{R}/command              payload: ON | OFF
 //                        aipl/all/command                  payload: ON | OFF
+//                          row/all may add "spread_ms": light i switches i/6 (all: slot/36)
+//                          into the window — {"state":"ON","spread_ms":3000}
+//                        aipl/all/scene                    binary: [flags][seq hi][seq lo][state N][care N]
+//                          bit (row*6 + light), LSB first; flags bit0 = care mask present
+//                        aipl/row/{R}/light/{L}/config     JSON telemetry policy, retained
+//                          {"heartbeat_s":60,"min_gap_s":2,"rssi_deadband":6,
+//                           "mem_min_free":20000,"mem_min_block":12000}
+//                        aipl/provision/{MAC12}            {"row":R,"light":L} 0-based, retained
+//                        aipl/row/{R}/gateway              {"enabled":true|false}, retained — one
+//                          elected light per row holds the cloud session, relays over ESP-NOW
+//                        aipl/row/{R}/light/{L}/desired    {"v":<server ms>,"state":"ON"}, retained —
+//                          written with every command; on connect the light applies it only if
+//                          v is newer than the last one it acted on (persistent session, QoS 1)
+//                        aipl/all/schedule                 {"v":7,"tz":"IST-5:30","rules":[{"days":62,
+//                          "at":"06:00","state":"ON","rows":[0,1]}]}, retained — run on-device
+//                          from NTP time; days bit0 = Sunday, rows/lights optional 0-based
+//                        aipl/row/{R}/light/{L}/ota        {"url":"https://…","version":"v9.3",
+//                        aipl/row/{R}/ota                   "sha256":"<64 hex>","stagger_s":10}
+//                        aipl/all/ota                      row/all: light starts after slot × stagger_s
+//                        (OTA progress → aipl/row/{R}/light/{L}/ota/status, retained)
+//  Firmware announces  : aipl/provision/announce           {"mac","row","light","firmware"}
+//                          row/light are -1 until the device is provisioned
 //
 //  Server subscribes   : aipl/row/+/light/+/state  (wildcard, all 36 devices)
 //  Server publishes    : command topics above
@@ -32,7 +66,74 @@ const HIVEMQ_CLIENT   = 'aipl-server-' + Math.random().toString(16).slice(2, 8);
 const TOPIC_CMD_SINGLE = (r, l) => `aipl/row/${r}/light/${l}/command`;
 const TOPIC_CMD_ROW    = (r)    => `aipl/row/${r}/command`;
 const TOPIC_CMD_ALL    = ()     => `aipl/all/command`;
+const TOPIC_SCENE      = ()     => `aipl/all/scene`;
 const STATE_WILDCARD   = 'aipl/row/+/light/+/state';
+const ACK_WILDCARD     = 'aipl/row/+/light/+/ack';
+const MESH_WILDCARD    = 'aipl/row/+/light/+/mesh';
+const BATCH_WILDCARD   = 'aipl/row/+/telemetry/batch';
+const TOPIC_GATEWAY    = (r)    => `aipl/row/${r}/gateway`;
+const TOPIC_SCHEDULE   = ()     => `aipl/all/schedule`;
+const TOPIC_DESIRED    = (r, l) => `aipl/row/${r}/light/${l}/desired`;
+
+// ── Command tracing — opt in with CMD_TRACE=1 once the fleet runs
+//  firmware that understands JSON commands (older builds read it as OFF)
+const CMD_TRACE = process.env.CMD_TRACE === '1';
+// Default window for /api/row and /api/all, overridable per request (ms, ≤ 60000)
+const GROUP_SPREAD_MS = parseInt(process.env.GROUP_SPREAD_MS || '0', 10);
+let   cmdSeq    = 0;
+const LAT_WINDOW = 200;
+const latency    = { rtt: [], dev: [] };   // ms, most recent LAT_WINDOW acks
+
+function cmdPayload(s, spreadMs = 0) {
+  if (!CMD_TRACE && !spreadMs) return s ? 'ON' : 'OFF';
+  const msg = { state: s ? 'ON' : 'OFF' };
+  if (CMD_TRACE) {
+    cmdSeq = (cmdSeq % 0xFFFFFFFF) + 1;
+    msg.seq = cmdSeq;
+    msg.ts  = Date.now();
+  }
+  if (spreadMs) msg.spread_ms = spreadMs;
+  return JSON.stringify(msg);
+}
+
+function spreadArg(v) {
+  const ms = v === undefined ? GROUP_SPREAD_MS : parseInt(v, 10);
+  return isNaN(ms) ? 0 : Math.min(Math.max(ms, 0), 60000);
+}
+
+function pushSample(arr, v) {
+  arr.push(v);
+  if (arr.length > LAT_WINDOW) arr.shift();
+}
+
+function percentile(arr, p) {
+  if (!arr.length) return null;
+  const s = [...arr].sort((a, b) => a - b);
+  return s[Math.floor((s.length - 1) * p / 100)];
+}
+
+// ── Scene encoder — one publish for any subset of the grid ──
+//  desired[r][l]: true / false, or null to leave that light alone
+const SCENE_FLAG_CARE = 0x01;
+let sceneSeq = 0;
+
+function encodeScene(desired) {
+  const n     = Math.ceil(36 / 8);
+  const state = Buffer.alloc(n);
+  const care  = Buffer.alloc(n);
+  let partial = false;
+  for (let r = 0; r < 6; r++)
+    for (let l = 0; l < 6; l++) {
+      const v   = desired[r] ? desired[r][l] : null;
+      const bit = r * 6 + l;
+      if (v === null || v === undefined) { partial = true; continue; }
+      care[bit >> 3] |= 1 << (bit & 7);
+      if (v) state[bit >> 3] |= 1 << (bit & 7);
+    }
+  sceneSeq = (sceneSeq % 0xFFFF) + 1;           // 1..65535, 0 means "no seq"
+  const hdr = Buffer.from([partial ? SCENE_FLAG_CARE : 0, sceneSeq >> 8, sceneSeq & 0xFF]);
+  return partial ? Buffer.concat([hdr, state, care]) : Buffer.concat([hdr, state]);
+}
 
 // ============================================================
 //  IN-MEMORY GRID  [row 0-5][light 0-5]
@@ -64,6 +165,9 @@ mqttClient.on('connect', () => {
     if (err) console.error('[MQTT] Subscribe error:', err.message);
     else     console.log('[MQTT] Subscribed to', STATE_WILDCARD);
   });
+  mqttClient.subscribe(ACK_WILDCARD, { qos: 0 });
+  mqttClient.subscribe(MESH_WILDCARD, { qos: 0 });
+  mqttClient.subscribe(BATCH_WILDCARD, { qos: 0 });
 });
 
 // ── Incoming state from each ESP32 ─────────────────────────
@@ -71,6 +175,39 @@ mqttClient.on('message', (topic, payload) => {
   // Expected topic: aipl/row/R/light/L/state
   // parts:          [0]  [1] [2][3]   [4][5]
   const parts = topic.split('/');
+  if (parts.length === 6 && parts[0] === 'aipl' && parts[5] === 'ack') {
+    try {
+      const a = JSON.parse(payload.toString());
+      const dev = a.dev_us / 1000;
+      pushSample(latency.dev, dev);
+      if (a.ts) {
+        const rtt = Date.now() - a.ts;
+        pushSample(latency.rtt, rtt);
+        console.log(`[ACK] Row ${+parts[2]+1} Light ${+parts[4]+1} seq ${a.seq}: ` +
+                    `rtt ${rtt} ms, device ${dev.toFixed(2)} ms, broker+net ${(rtt - dev).toFixed(1)} ms`);
+      }
+    } catch (e) { /* malformed ack — ignore */ }
+    return;
+  }
+  if (parts.length === 5 && parts[0] === 'aipl' && parts[3] === 'telemetry' && parts[4] === 'batch') {
+    try {
+      const b   = JSON.parse(payload.toString());
+      const row = parseInt(parts[2], 10);
+      if (row >= 0 && row < 6)
+        for (const m of b.members || [])
+          if (m.light >= 0 && m.light < 6) grid[row][m.light] = !!m.state;
+    } catch (e) { /* malformed batch — ignore */ }
+    return;
+  }
+  if (parts.length === 6 && parts[0] === 'aipl' && parts[5] === 'mesh') {
+    // the state message that follows updates the grid; this only explains it
+    try {
+      const m = JSON.parse(payload.toString());
+      console.log(`[MESH] Row ${+parts[2]+1} Light ${+parts[4]+1}: ${m.applied} offline command(s), ` +
+                  `last from ${m.origin} seq ${m.seq} → ${m.state ? 'ON' : 'OFF'}`);
+    } catch (e) { /* malformed report — ignore */ }
+    return;
+  }
   if (
     parts.length === 6   &&
     parts[0] === 'aipl'  &&
@@ -94,17 +231,40 @@ mqttClient.on('reconnect', ()  => console.log  ('[MQTT] Reconnecting...'));
 mqttClient.on('offline',   ()  => console.warn ('[MQTT] Went offline'));
 
 // ── Publish helper ─────────────────────────────────────────
-function publish(topic, payload) {
+function publish(topic, payload, retain = false) {
   return new Promise((resolve, reject) => {
     if (!mqttClient.connected)
       return reject(new Error('MQTT not connected'));
-    mqttClient.publish(topic, payload, { qos: 1, retain: false }, (err) => {
+    mqttClient.publish(topic, payload, { qos: 1, retain }, (err) => {
       if (err) reject(err);
       else     resolve();
     });
   });
 }
 
+// ── Desired state — one retained, versioned message per light ─
+//  A light that missed commands resyncs from this on connect. v is
+//  wall-clock ms, kept strictly increasing so it survives restarts.
+let desiredV = 0;
+
+function publishDesired(cells) {   // cells: [[r, l, state], …]
+  desiredV = Math.max(Date.now(), desiredV + 1);
+  const v = desiredV;
+  return Promise.all(cells.map(([r, l, s]) =>
+    publish(TOPIC_DESIRED(r, l), JSON.stringify({ v, state: s ? 'ON' : 'OFF' }), true)))
+    .catch((e) => console.error('[DESIRED] publish error:', e.message));
+}
+
+const allCells = (fn) => {
+  const out = [];
+  for (let r = 0; r < 6; r++)
+    for (let l = 0; l < 6; l++) {
+      const s = fn(r, l);
+      if (s !== null) out.push([r, l, s]);
+    }
+  return out;
+};
+
 // ============================================================
 //  MIDDLEWARE
 // ============================================================
@@ -137,7 +297,8 @@ app.post('/api/light', async (req, res) => {
     return res.status(400).json({ error: 'row/light out of range (0–5)' });
 
   try {
-    await publish(TOPIC_CMD_SINGLE(r, l), s ? 'ON' : 'OFF');
+    await publish(TOPIC_CMD_SINGLE(r, l), cmdPayload(s));
+    publishDesired([[r, l, s]]);
     grid[r][l] = s;   // optimistic — real state confirmed when ESP32 publishes back
     console.log(`[CMD] Row ${r+1} Light ${l+1} → ${s ? 'ON' : 'OFF'}`);
     res.json({ grid, mqtt: mqttClient.connected });
@@ -148,9 +309,9 @@ app.post('/api/light', async (req, res) => {
 });
 
 // POST /api/row — set all 6 lights in one row
-// Body: { row: 0-5, state: true|false }
+// Body: { row: 0-5, state: true|false, spread_ms?: 0-60000 }
 app.post('/api/row', async (req, res) => {
-  const { row, state } = req.body;
+  const { row, state, spread_ms } = req.body;
   if (row === undefined || state === undefined)
     return res.status(400).json({ error: 'row, state required' });
 
@@ -162,7 +323,8 @@ app.post('/api/row', async (req, res) => {
 
   try {
     // One MQTT message → all 6 ESP32s in this row receive it
-    await publish(TOPIC_CMD_ROW(r), s ? 'ON' : 'OFF');
+    await publish(TOPIC_CMD_ROW(r), cmdPayload(s, spreadArg(spread_ms)));
+    publishDesired(allCells((rr) => rr === r ? s : null));
     for (let l = 0; l < 6; l++) grid[r][l] = s;
     console.log(`[CMD] Row ${r+1} ALL → ${s ? 'ON' : 'OFF'}`);
     res.json({ grid, mqtt: mqttClient.connected });
@@ -173,9 +335,9 @@ app.post('/api/row', async (req, res) => {
 });
 
 // POST /api/all — all 36 lights at once
-// Body: { state: true|false }
+// Body: { state: true|false, spread_ms?: 0-60000 }
 app.post('/api/all', async (req, res) => {
-  const { state } = req.body;
+  const { state, spread_ms } = req.body;
   if (state === undefined)
     return res.status(400).json({ error: 'state required' });
 
@@ -183,7 +345,8 @@ app.post('/api/all', async (req, res) => {
 
   try {
     // One MQTT message → all 36 ESP32s receive it
-    await publish(TOPIC_CMD_ALL(), s ? 'ON' : 'OFF');
+    await publish(TOPIC_CMD_ALL(), cmdPayload(s, spreadArg(spread_ms)));
+    publishDesired(allCells(() => s));
     for (let r = 0; r < 6; r++)
       for (let l = 0; l < 6; l++) grid[r][l] = s;
     console.log(`[CMD] ALL LIGHTS → ${s ? 'ON' : 'OFF'}`);
@@ -194,6 +357,82 @@ app.post('/api/all', async (req, res) => {
   }
 });
 
+// POST /api/scene — any set of lights in one MQTT message
+// Body: { grid: [[true|false|null × 6] × 6] }   null = unchanged
+app.post('/api/scene', async (req, res) => {
+  const desired = req.body && req.body.grid;
+  if (!Array.isArray(desired))
+    return res.status(400).json({ error: 'grid required' });
+
+  const norm = (v) => (v === null || v === undefined) ? null
+                    : (v === true || v === 'true' || v === 1 || v === '1');
+  const want = Array.from({ length: 6 }, (_, r) =>
+    Array.from({ length: 6 }, (_, l) => norm(Array.isArray(desired[r]) ? desired[r][l] : null)));
+
+  try {
+    await publish(TOPIC_SCENE(), encodeScene(want));
+    publishDesired(allCells((r, l) => want[r][l]));
+    for (let r = 0; r < 6; r++)
+      for (let l = 0; l < 6; l++)
+        if (want[r][l] !== null) grid[r][l] = want[r][l];
+    console.log(`[CMD] SCENE seq ${sceneSeq}`);
+    res.json({ grid, seq: sceneSeq, mqtt: mqttClient.connected });
+  } catch (e) {
+    console.error('[CMD] publish error:', e.message);
+    res.status(503).json({ error: 'MQTT publish failed', detail: e.message });
+  }
+});
+
+// POST /api/gateway — one cloud session per row instead of six
+// Body: { row: 0-5, enabled: true|false }   retained, so it survives reboots
+app.post('/api/gateway', async (req, res) => {
+  const { row, enabled } = req.body;
+  const r = parseInt(row, 10);
+  if (isNaN(r) || r < 0 || r > 5 || enabled === undefined)
+    return res.status(400).json({ error: 'row (0–5) and enabled required' });
+
+  const on = (enabled === true || enabled === 'true' || enabled === 1 || enabled === '1');
+  try {
+    await publish(TOPIC_GATEWAY(r), JSON.stringify({ enabled: on }), true);
+    console.log(`[CMD] Row ${r+1} gateway mode → ${on ? 'ON' : 'OFF'}`);
+    res.json({ row: r, enabled: on });
+  } catch (e) {
+    console.error('[CMD] publish error:', e.message);
+    res.status(503).json({ error: 'MQTT publish failed', detail: e.message });
+  }
+});
+
+// POST /api/schedule — shift switching runs on the lights themselves
+// Body: { tz?: "IST-5:30", rules: [{ days: 62, at: "06:00", state: "ON", rows?: [..], lights?: [..] }] }
+// Retained; rules: [] clears. Each light keeps the rules addressed to it in NVS.
+app.post('/api/schedule', async (req, res) => {
+  const { tz, rules } = req.body;
+  if (!Array.isArray(rules) || rules.length > 16)
+    return res.status(400).json({ error: 'rules array (max 16) required' });
+  for (const r of rules) {
+    if (!/^([01]\d|2[0-3]):[0-5]\d$/.test(r.at || '') || !(r.days > 0 && r.days < 128) || r.state === undefined)
+      return res.status(400).json({ error: 'each rule needs at "HH:MM", days 1–127 and state' });
+  }
+  const body = { v: Math.floor(Date.now() / 1000), tz: tz || 'IST-5:30', rules };
+  const json = JSON.stringify(body);
+  if (json.length > 960)   // firmware MQTT buffer is 1024 bytes including the topic
+    return res.status(413).json({ error: 'schedule too large', bytes: json.length });
+  try {
+    await publish(TOPIC_SCHEDULE(), json, true);
+    console.log(`[CMD] Schedule v${body.v} → ${rules.length} rule(s)`);
+    res.json(body);
+  } catch (e) {
+    console.error('[CMD] publish error:', e.message);
+    res.status(503).json({ error: 'MQTT publish failed', detail: e.message });
+  }
+});
+
+// GET /api/latency — rolling command latency from device acks (ms)
+app.get('/api/latency', (req, res) => {
+  const sum = (arr) => ({ n: arr.length, p50: percentile(arr, 50), p99: percentile(arr, 99) });
+  res.json({ trace: CMD_TRACE, rtt: sum(latency.rtt), device: sum(latency.dev) });
+});
+
 // GET /health — server + MQTT status
 app.get('/health', (req, res) => {
   res.json({
@@ -0,0 +1,162 @@
+// ============================================================
+//  HOST MICROBENCHMARKS — env:native
+//    pio run -e native && .pio/build/native/program
+//  Runs the portable core (relay state machine, accounting,
+//  command parsing, serializers) against in-memory fakes and
+//  prints ns/op and heap allocations per call.
+//  `pio test -e native` links test/ against the same sources and
+//  leaves this program (and its operator new) out.
+// ============================================================
+#ifndef PIO_UNIT_TESTING
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "commands.h"
+#include "event_log.h"
+#include "light_core.h"
+#include "schedule.h"
+#include "serializers.h"
+#include "../host/host_fakes.h"
+
+// ── Allocation counter — every operator new in the process ──
+static size_t g_allocs = 0;
+
+void* operator new(size_t n) {
+  g_allocs++;
+  void* p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void  operator delete(void* p) noexcept           { free(p); }
+void  operator delete(void* p, size_t) noexcept   { free(p); }
+
+// ── Fakes ────────────────────────────────────────────────────
+class NullMqtt : public hal::Mqtt {
+public:
+  using hal::Mqtt::publish;
+  bool connected() override { return true; }
+  bool publish(const char* topic, const uint8_t* payload, size_t len, bool retain) override {
+    msgs++;
+    bytes += len;
+    return true;
+  }
+  uint32_t msgs  = 0;
+  uint64_t bytes = 0;
+};
+
+// ── Harness ──────────────────────────────────────────────────
+static volatile uint64_t g_sink;          // keeps results observable
+
+template <typename F>
+static void bench(const char* name, uint32_t iters, F fn) {
+  for (uint32_t i = 0; i < iters / 10 + 1; i++) fn(i);   // warm-up
+  size_t a0 = g_allocs;
+  auto   t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iters; i++) fn(i);
+  auto   t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / iters;
+  printf("  %-28s %10.1f ns/op %8.2f allocs/op\n", name, ns, (double)(g_allocs - a0) / iters);
+}
+
+int main() {
+  const uint32_t N = 1000000;
+  HostClock    clock;
+  CountingGpio gpio;
+  MemNvs       lsNvs, otNvs;
+  NullMqtt     mqtt;
+  LightCore    relay({ 26, 0, 1, 150000, 2000, 60000 }, clock, gpio, lsNvs, otNvs);
+  relay.begin();
+
+  printf("AIPL host benchmarks (%lu iterations each)\n", (unsigned long)N);
+
+  printf("\n[relay core]\n");
+  bench("set() toggle", N, [&](uint32_t i) { g_sink += relay.set(i & 1); });
+  bench("set() unchanged", N, [&](uint32_t i) { g_sink += relay.set(true); });
+  relay.set(false);
+  bench("force(ON) refused", N, [&](uint32_t i) { g_sink += relay.force(true); });
+  bench("tick() idle", N, [&](uint32_t i) { relay.tick(); });
+  bench("set()+tick() +2 s", N / 10, [&](uint32_t i) {
+    relay.set(i & 1);
+    clock.skewUs += 2000000;             // past the coalesce window → one NVS write
+    relay.tick();
+  });
+  bench("onTimeMs()", N, [&](uint32_t i) { g_sink += relay.onTimeMs(); });
+  bench("energyMwh()", N, [&](uint32_t i) { g_sink += relay.energyMwh(); });
+
+  printf("\n[command parsing]\n");
+  static const char PLAIN[] = " ON\n";
+  static const char TRACED[] = "{\"state\":\"ON\",\"seq\":42,\"ts\":1718000000123}";
+  bench("parseOnOff(\" ON\\n\")", N, [&](uint32_t i) {
+    g_sink += parseOnOff((const uint8_t*)PLAIN, sizeof(PLAIN) - 1);
+  });
+  bench("parseCommand(plain)", N, [&](uint32_t i) {
+    bool s; uint32_t seq; uint64_t ts;
+    g_sink += parseCommand((const uint8_t*)PLAIN, sizeof(PLAIN) - 1, s, seq, ts) + s;
+  });
+  bench("parseCommand(traced JSON)", N, [&](uint32_t i) {
+    bool s; uint32_t seq; uint64_t ts;
+    g_sink += parseCommand((const uint8_t*)TRACED, sizeof(TRACED) - 1, s, seq, ts) + seq;
+  });
+
+  printf("\n[schedule]\n");
+  Schedule sch = {};
+  for (uint8_t i = 0; i < SCHED_MAX_RULES; i++)
+    sch.rules[sch.count++] = { (uint8_t)(1 << (i % 7)), (bool)(i & 1), (uint16_t)(i * 90) };
+  bench("scheduleNext() 16 rules", N, [&](uint32_t i) {
+    bool s;
+    g_sink += scheduleNext(sch, i % 7, i % 86400, s) + s;
+  });
+
+  printf("\n[event log]\n");
+  MemFlash evFlash(16 * 4096);           // the firmware's 64 KB "evlog" partition
+  EventLog evLog(evFlash);
+  evLog.begin();
+  bench("EventLog append (wraps)", N / 10, [&](uint32_t i) {
+    g_sink += evLog.append(EV_RELAY, i & 1, 1718000000 + i, i);
+  });
+  bench("EventLog read x8", N / 10, [&](uint32_t i) {
+    EvRecord recs[8];
+    uint32_t seq = evLog.oldestSeq() + i % (evLog.count() - 8);
+    size_t   n   = evLog.read(seq, recs, 8);
+    for (size_t k = 0; k < n; k++) g_sink += EventLog::valid(recs[k], seq + k);
+  });
+  EventLog rebooted(evFlash);            // same flash, fresh object: head found by the scan
+  bench("EventLog begin() scan", 1000, [&](uint32_t i) { g_sink += rebooted.begin(); });
+
+  printf("\n[serializers]\n");
+  bench("JsonWriter telemetry", N, [&](uint32_t i) {
+    char       buf[256];
+    JsonWriter w(buf, sizeof(buf));
+    w.addBool ("state",      i & 1);
+    w.addUInt ("on_seconds", i);
+    w.addUInt ("uptime_s",   i * 3);
+    w.addFixed("kwh_used",   (uint64_t)i * 150, 6, 3);
+    w.addInt  ("rssi",       -61);
+    g_sink += w.finish();
+  });
+  bench("CborWriter telemetry", N, [&](uint32_t i) {
+    uint8_t    bin[48];
+    CborWriter c(bin, sizeof(bin));
+    c.map(5);
+    c.uint(1); c.boolean(i & 1);
+    c.uint(2); c.uint(i);
+    c.uint(3); c.uint(i / 2);
+    c.uint(4); c.f32(i * 0.15f);
+    c.uint(5); c.sint(-61);
+    g_sink += c.length();
+  });
+  bench("writeAckJson + publish", N, [&](uint32_t i) {
+    CmdAck ack = { i, 180, 1718000000123ULL + i, true, true };
+    char   buf[128];
+    mqtt.publish("aipl/row/0/light/0/ack", (const uint8_t*)buf, writeAckJson(buf, sizeof(buf), ack), false);
+  });
+
+  printf("\nrelay GPIO writes %lu, NVS puts %lu, mqtt bytes %llu, flash erases %lu\n",
+         (unsigned long)gpio.writes, (unsigned long)(lsNvs.puts + otNvs.puts),
+         (unsigned long long)mqtt.bytes, (unsigned long)evFlash.erases);
+  return 0;
+}
+
+#endif  // PIO_UNIT_TESTING
@@ -0,0 +1,65 @@
+#include "commands.h"
+#include "serializers.h"
+#include <ArduinoJson.h>
+#include <ctype.h>
+#include <string.h>
+
+// Same accept set as before: ON / on / 1 / true, surrounding
+// whitespace ignored, anything else means OFF
+bool parseOnOff(const uint8_t* p, unsigned int len) {
+  while (len && isspace(p[0]))       { p++; len--; }
+  while (len && isspace(p[len - 1])) { len--; }
+  const char* s = (const char*)p;
+  switch (len) {
+    case 1: return s[0] == '1';
+    case 2: return memcmp(s, "ON", 2) == 0 || memcmp(s, "on", 2) == 0;
+    case 4: return memcmp(s, "true", 4) == 0;
+    default: return false;
+  }
+}
+
+// Plain ON/OFF as before, or traced:
+//   {"state":"ON","seq":42,"ts":1718000000123}   (state may also be true/false)
+//   {"state":"ON","spread_ms":3000}              row/all: switch within the window
+bool parseCommand(const uint8_t* p, unsigned int len, bool& state, uint32_t& seq, uint64_t& originMs,
+                  uint32_t* spreadMs) {
+  seq      = 0;
+  originMs = 0;
+  if (spreadMs) *spreadMs = 0;
+  unsigned int i = 0;
+  while (i < len && isspace(p[i])) i++;
+  if (i == len || p[i] != '{') {
+    state = parseOnOff(p, len);
+    return true;
+  }
+  StaticJsonDocument<192> doc;             // 4 members + copied keys, 64-bit hosts included
+  if (deserializeJson(doc, p, len)) return false;
+  JsonVariant s = doc["state"];
+  if      (s.is<bool>())        state = s.as<bool>();
+  else if (s.is<const char*>()) state = parseOnOff((const uint8_t*)s.as<const char*>(), strlen(s.as<const char*>()));
+  else return false;
+  seq      = doc["seq"] | (uint32_t)0;
+  originMs = doc["ts"]  | (uint64_t)0;
+  if (spreadMs) *spreadMs = doc["spread_ms"] | (uint32_t)0;
+  return true;
+}
+
+// ts is the sender's own clock, so sender RTT − dev_us = broker + network
+size_t writeAckJson(char* buf, size_t cap, const CmdAck& ack) {
+  JsonWriter w(buf, cap);
+  w.addUInt("seq",     ack.seq);
+  w.addU64 ("ts",      ack.originMs);
+  w.addBool("state",   ack.state);
+  w.addBool("changed", ack.changed);
+  w.addUInt("dev_us",  ack.devUs);
+  return w.finish();
+}
+
+const char* parseBatch(char* body, BatchDoc& doc, JsonArray& ops) {
+  DeserializationError e = deserializeJson(doc, body);   // char*: zero-copy
+  if (e == DeserializationError::NoMemory) return "too many ops or fields";
+  if (e) return "bad JSON";
+  ops = doc["ops"].as<JsonArray>();
+  if (ops.isNull() || ops.size() > BATCH_OPS_MAX) return "ops[] missing or too long";
+  return NULL;
+}
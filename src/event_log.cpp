@@ -0,0 +1,114 @@
+#include "event_log.h"
+#include <string.h>
+
+uint8_t EventLog::crc8(const EvRecord& r) {
+  EvRecord c = r;
+  c.crc = 0;
+  const uint8_t* p = (const uint8_t*)&c;
+  uint8_t crc = 0;
+  for (uint32_t i = 0; i < REC_SIZE; i++) {
+    crc ^= p[i];
+    for (int b = 0; b < 8; b++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+bool EventLog::valid(const EvRecord& r, uint32_t seq) {
+  return r.seq == seq && r.type && r.type < EV_TYPE_COUNT && r.crc == crc8(r);
+}
+
+static bool blank(const EvRecord& r) {
+  const uint8_t* p = (const uint8_t*)&r;
+  for (uint32_t i = 0; i < sizeof(r); i++) if (p[i] != 0xFF) return false;
+  return true;
+}
+
+bool EventLog::begin() {
+  uint32_t sector = _flash.sectorSize();
+  uint32_t n      = sector ? _flash.size() / sector : 0;
+  if (n < 2 || sector % REC_SIZE) return false;   // needs one sector to erase while the rest holds history
+  _perSector = sector / REC_SIZE;
+  _cap       = n * _perSector;
+
+  // Newest sector = highest valid seq in a first slot. A sector whose
+  // first write was torn is skipped and gets erased again below.
+  int32_t  best    = -1;
+  uint32_t bestSeq = 0;
+  for (uint32_t s = 0; s < n; s++) {
+    EvRecord r;
+    if (!_flash.read(s * sector, &r, REC_SIZE)) continue;
+    if (r.seq != 0xFFFFFFFF && valid(r, r.seq) && r.seq >= bestSeq) { best = (int32_t)s; bestSeq = r.seq; }
+  }
+  if (best < 0) {
+    _head = 0; _nextSeq = 1;
+    _headErased = _flash.erase(0, sector);
+    return true;
+  }
+
+  // Head = first blank slot; torn slots are passed over, keeping the
+  // seq ↔ position mapping intact
+  uint32_t first = (uint32_t)best * _perSector;
+  uint32_t i     = 1;
+  for (; i < _perSector; i++) {
+    EvRecord r;
+    if (_flash.read((first + i) * REC_SIZE, &r, REC_SIZE) && blank(r)) break;
+  }
+  _head       = (first + i) % _cap;
+  _nextSeq    = bestSeq + i;
+  _headErased = i < _perSector;
+  return true;
+}
+
+EventLog::Pos EventLog::pos() const {
+  _pos.lock();
+  Pos p = { _head, _nextSeq };
+  _pos.unlock();
+  return p;
+}
+
+uint32_t EventLog::countAt(const Pos& p) const {
+  if (!_cap) return 0;
+  uint32_t held = _cap - _perSector + p.head % _perSector;   // head sector holds only the new part
+  return p.nextSeq - 1 < held ? p.nextSeq - 1 : held;
+}
+
+uint32_t EventLog::count()     const { return countAt(pos()); }
+uint32_t EventLog::nextSeq()   const { return pos().nextSeq; }
+uint32_t EventLog::oldestSeq() const { Pos p = pos(); return p.nextSeq - countAt(p); }
+
+bool EventLog::append(uint8_t type, uint16_t value, uint32_t epoch, uint32_t upS) {
+  if (!_cap) return false;
+  if (_head % _perSector == 0 && !_headErased) {
+    if (!_flash.erase(_head * REC_SIZE, _perSector * REC_SIZE)) { _errors++; return false; }
+  }
+  EvRecord r = { _nextSeq, epoch, upS, type, 0, value };
+  r.crc = crc8(r);
+  bool ok = _flash.write(_head * REC_SIZE, &r, REC_SIZE);
+  if (!ok) _errors++;
+  // A failed write still spends its slot and seq — the slot may be
+  // half-programmed. Moving onto a sector boundary drops that sector
+  // from the readable range before the next append erases it.
+  _pos.lock();
+  _head       = (_head + 1) % _cap;
+  _nextSeq++;
+  _pos.unlock();
+  _headErased = false;
+  return ok;
+}
+
+size_t EventLog::read(uint32_t seq, EvRecord* out, size_t n) {
+  if (!_cap) return 0;
+  Pos p = pos();
+  if (seq < p.nextSeq - countAt(p) || seq >= p.nextSeq) return 0;
+  uint32_t slot = slotOf(p, seq);
+  uint32_t left = p.nextSeq - seq;
+  if (n > left)        n = left;
+  if (n > _cap - slot) n = _cap - slot;   // no wrap inside one flash read
+  if (!_flash.read(slot * REC_SIZE, out, n * REC_SIZE)) return 0;
+
+  // The writer may have moved on (and erased) while we read: blank
+  // every slot that fell out of the range, so valid() rejects it
+  uint32_t oldest = oldestSeq();
+  for (size_t i = 0; i < n && seq + i < oldest; i++) memset(&out[i], 0xFF, REC_SIZE);
+  return n;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include "hal.h"
+
+// ============================================================
+//  HOST FAKES — in-memory HAL for env:native and env:sim
+// ============================================================
+// Steady clock, optionally advanced by hand so accounting paths
+// see time pass without sleeping
+class HostClock : public hal::Clock {
+public:
+  uint64_t nowUs() override {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count() + skewUs;
+  }
+  uint64_t skewUs = 0;
+};
+
+// Moves only when told to — unit tests (test/) step through deadlines
+class ManualClock : public hal::Clock {
+public:
+  uint64_t nowUs() override   { return us; }
+  void     advanceMs(uint64_t ms) { us += ms * 1000; }
+  uint64_t us = 0;
+};
+
+class CountingGpio : public hal::Gpio {
+public:
+  void write(int pin, int level) override { writes++; lastLevel = level; }
+  uint32_t writes    = 0;
+  int      lastLevel = -1;
+};
+
+// NOR semantics: erase sets 0xFF, write can only clear bits
+class MemFlash : public hal::Flash {
+public:
+  explicit MemFlash(uint32_t bytes, uint32_t sector = 4096) : _mem(bytes, 0xFF), _sector(sector) {}
+  uint32_t size() override       { return (uint32_t)_mem.size(); }
+  uint32_t sectorSize() override { return _sector; }
+  bool read(uint32_t off, void* dst, uint32_t len) override {
+    if (off + len > _mem.size()) return false;
+    memcpy(dst, &_mem[off], len);
+    return true;
+  }
+  bool write(uint32_t off, const void* src, uint32_t len) override {
+    if (off + len > _mem.size()) return false;
+    const uint8_t* p = (const uint8_t*)src;
+    for (uint32_t i = 0; i < len; i++) _mem[off + i] &= p[i];
+    writes++;
+    return true;
+  }
+  bool erase(uint32_t off, uint32_t len) override {
+    if (off % _sector || len % _sector || off + len > _mem.size()) return false;
+    memset(&_mem[off], 0xFF, len);
+    erases++;
+    return true;
+  }
+  uint8_t* raw() { return _mem.data(); }
+  uint32_t writes = 0, erases = 0;
+
+private:
+  std::vector<uint8_t> _mem;
+  uint32_t             _sector;
+};
+
+// Fixed table, no heap — keys are the core's literals
+class MemNvs : public hal::Nvs {
+public:
+  bool     has(const char* key) override                  { return find(key) != nullptr; }
+  bool     getBool(const char* key, bool def) override    { Slot* s = find(key); return s ? s->v != 0 : def; }
+  uint32_t getU32(const char* key, uint32_t def) override { Slot* s = find(key); return s ? (uint32_t)s->v : def; }
+  uint64_t getU64(const char* key, uint64_t def) override { Slot* s = find(key); return s ? s->v : def; }
+  void     putBool(const char* key, bool v) override      { put(key, v); }
+  void     putU64(const char* key, uint64_t v) override   { put(key, v); }
+  uint32_t puts = 0;
+
+private:
+  struct Slot { char key[16]; uint64_t v; };
+  Slot* find(const char* key) {
+    for (int i = 0; i < _n; i++) if (strcmp(_slots[i].key, key) == 0) return &_slots[i];
+    return nullptr;
+  }
+  void put(const char* key, uint64_t v) {
+    puts++;
+    Slot* s = find(key);
+    if (!s && _n < 8) { s = &_slots[_n++]; strncpy(s->key, key, sizeof(s->key) - 1); s->key[sizeof(s->key) - 1] = 0; }
+    if (s) s->v = v;
+  }
+  Slot _slots[8];
+  int  _n = 0;
+};
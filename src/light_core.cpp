@@ -0,0 +1,148 @@
+#include "light_core.h"
+
+LightCore::LightCore(const Config& cfg, hal::Clock& clock, hal::Gpio& gpio,
+                     hal::Nvs& state, hal::Nvs& onTime)
+  : _cfg(cfg), _clock(clock), _gpio(gpio), _stateNvs(state), _onNvs(onTime) {}
+
+void LightCore::begin() {
+  _savedOn   = _stateNvs.getBool("l1", true);
+  // "ms" replaced the whole-second "t", which dropped remainders
+  _savedOnMs = _onNvs.has("ms") ? _onNvs.getU64("ms", 0)
+                                : (uint64_t)_onNvs.getU32("t", 0) * 1000;
+  _pendingOn = _savedOn;
+  _userOff   = !_savedOn;
+  _desiredV  = _savedDesiredV = _stateNvs.getU64("dv", 0);
+  _onMsTotal = _bootOnMs = _savedOnMs;
+  _journalMs = _clock.nowMs();
+  _on        = false;
+  if (_savedOn) onTimeStart();
+  drive(_on);
+}
+
+void LightCore::drive(bool on) {
+  _gpio.write(_cfg.pin, on ? _cfg.levelOn : _cfg.levelOff);
+}
+
+bool LightCore::set(bool on, bool persist) {
+  _userOff = !on;                        // always record what the user explicitly wants
+  if (_on == on) return false;
+
+  if (on) onTimeStart();
+  else    onTimeStop();
+  drive(on);
+  _lastRelayUs = (int64_t)_clock.nowUs();
+
+  if (persist) {
+    _pendingOn = on;
+    if (!_stateDirty) { _stateDirty = true; _stateDirtyMs = _clock.nowMs(); }
+  }
+  return true;
+}
+
+bool LightCore::force(bool on) {
+  if (on && _userOff) return false;
+  bool moved = _on != on;
+  if (moved) {
+    if (on) onTimeStart();
+    else    onTimeStop();
+  }
+  drive(on);                             // re-driven even if unchanged
+  if (moved) _lastRelayUs = (int64_t)_clock.nowUs();
+  return true;
+}
+
+void LightCore::setDesiredVersion(uint64_t v) {
+  uint64_t now = _clock.nowMs();
+  _acct.lock();
+  _desiredV = v;
+  if (!_desiredDirty) { _desiredDirty = true; _desiredDirtyMs = now; }
+  _acct.unlock();
+}
+
+uint64_t LightCore::desiredVersion() {
+  _acct.lock();
+  uint64_t v = _desiredV;
+  _acct.unlock();
+  return v;
+}
+
+// ============================================================
+//  ON-TIME — integer ms on the 64-bit clock, never wraps
+// ============================================================
+uint64_t LightCore::onTimeMs() {
+  uint64_t now = _clock.nowMs();
+  _acct.lock();
+  uint64_t ms = _onMsTotal + (_on ? now - _onSinceMs : 0);
+  _acct.unlock();
+  return ms;
+}
+
+void LightCore::onTimeStart() {
+  uint64_t now = _clock.nowMs();
+  _acct.lock();
+  if (!_on) { _onSinceMs = now; _on = true; }
+  _acct.unlock();
+}
+
+void LightCore::onTimeStop() {
+  uint64_t now = _clock.nowMs();
+  _acct.lock();
+  if (_on) _onMsTotal += now - _onSinceMs;
+  _on = false;
+  _acct.unlock();
+  markOnTime();
+}
+
+// ============================================================
+//  PERSISTENCE — coalesced: a burst of toggles is one write,
+//  on-time is also journaled every journalMs while ON
+// ============================================================
+void LightCore::markOnTime() {
+  if (!_onDirty) { _onDirty = true; _onDirtyMs = _clock.nowMs(); }
+}
+
+void LightCore::flush() {
+  if (_stateDirty) {
+    _stateDirty = false;
+    if (_pendingOn != _savedOn) {
+      _stateNvs.putBool("l1", _pendingOn);
+      _savedOn = _pendingOn;
+      _writes++;
+    }
+  }
+  _acct.lock();
+  bool     dvDirty = _desiredDirty;
+  uint64_t dv      = _desiredV;
+  _desiredDirty = false;
+  _acct.unlock();
+  if (dvDirty && dv != _savedDesiredV) {
+    _stateNvs.putU64("dv", dv);
+    _savedDesiredV = dv;
+    _writes++;
+  }
+  if (_onDirty) {
+    _onDirty = false;
+    uint64_t t = onTimeMs();
+    if (t != _savedOnMs) {
+      _onNvs.putU64("ms", t);
+      _savedOnMs = t;
+      _journalMs = _clock.nowMs();
+      _writes++;
+    }
+  }
+}
+
+void LightCore::tick() {
+  uint64_t now = _clock.nowMs();
+  if (_on && now - _journalMs >= _cfg.journalMs) markOnTime();
+  _acct.lock();
+  bool dvDue = _desiredDirty && now - _desiredDirtyMs >= _cfg.coalesceMs;
+  _acct.unlock();
+
+  if (dvDue ||
+      (_stateDirty && now - _stateDirtyMs >= _cfg.coalesceMs) ||
+      (_onDirty    && now - _onDirtyMs    >= _cfg.coalesceMs) ||
+      (_onDirty    && now - _journalMs    >= _cfg.journalMs)) {
+    flush();
+  }
+}
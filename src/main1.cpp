@@ -2,12 +2,37 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
+#include <ESPmDNS.h>
+#include <LittleFS.h>
 #include <Preferences.h>
-#include <WiFiClientSecure.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
 #include <esp_task_wdt.h>
+#include <esp_attr.h>
+#include <esp_ota_ops.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <Update.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/md.h>
+#include <esp_now.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
+#include <time.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include "tls_session_client.h"
+#include "web_assets.h"        // generated by tools/gzip_assets.py
+#include "hal_esp32.h"
+#include "serializers.h"
+#include "commands.h"
+#include "light_core.h"
+#include "schedule.h"
+#include "phase.h"
+#include "event_log.h"
 
 // ============================================================
 //  USER CONFIG — edit before flashing each device
@@ -21,65 +46,88 @@
 #define HIVEMQ_USERNAME  "Highbaylight"
 #define HIVEMQ_PASSWORD  "Naveen235623@@"
 
+// ── Pinned CA — HiveMQ Cloud chains to Let's Encrypt ISRG Root X1
+//    (valid until 2035-06-04). Replaces tlsClient.setInsecure().
+static const char HIVEMQ_CA_PEM[] = R"PEM(
+-----BEGIN CERTIFICATE-----
+MIIFazCCA1OgAwIBAgIRAIIQz7DSQONZRGPgu2OCiwAwDQYJKoZIhvcNAQELBQAw
+TzELMAkGA1UEBhMCVVMxKTAnBgNVBAoTIEludGVybmV0IFNlY3VyaXR5IFJlc2Vh
+cmNoIEdyb3VwMRUwEwYDVQQDEwxJU1JHIFJvb3QgWDEwHhcNMTUwNjA0MTEwNDM4
+WhcNMzUwNjA0MTEwNDM4WjBPMQswCQYDVQQGEwJVUzEpMCcGA1UEChMgSW50ZXJu
+ZXQgU2VjdXJpdHkgUmVzZWFyY2ggR3JvdXAxFTATBgNVBAMTDElTUkcgUm9vdCBY
+MTCCAiIwDQYJKoZIhvcNAQEBBQADggIPADCCAgoCggIBAK3oJHP0FDfzm54rVygc
+h77ct984kIxuPOZXoHj3dcKi/vVqbvYATyjb3miGbESTtrFj/RQSa78f0uoxmyF+
+0TM8ukj13Xnfs7j/EvEhmkvBioZxaUpmZmyPfjxwv60pIgbz5MDmgK7iS4+3mX6U
+A5/TR5d8mUgjU+g4rk8Kb4Mu0UlXjIB0ttov0DiNewNwIRt18jA8+o+u3dpjq+sW
+T8KOEUt+zwvo/7V3LvSye0rgTBIlDHCNAymg4VMk7BPZ7hm/ELNKjD+Jo2FR3qyH
+B5T0Y3HsLuJvW5iB4YlcNHlsdu87kGJ55tukmi8mxdAQ4Q7e2RCOFvu396j3x+UC
+B5iPNgiV5+I3lg02dZ77DnKxHZu8A/lJBdiB3QW0KtZB6awBdpUKD9jf1b0SHzUv
+KBds0pjBqAlkd25HN7rOrFleaJ1/ctaJxQZBKT5ZPt0m9STJEadao0xAH0ahmbWn
+OlFuhjuefXKnEgV4We0+UXgVCwOPjdAvBbI+e0ocS3MFEvzG6uBQE3xDk3SzynTn
+jh8BCNAw1FtxNrQHusEwMFxIt4I7mKZ9YIqioymCzLq9gwQbooMDQaHWBfEbwrbw
+qHyGO0aoSCqI3Haadr8faqU9GY/rOPNk3sgrDQoo//fb4hVC1CLQJ13hef4Y53CI
+rU7m2Ys6xt0nUW7/vGT1M0NPAgMBAAGjQjBAMA4GA1UdDwEB/wQEAwIBBjAPBgNV
+HRMBAf8EBTADAQH/MB0GA1UdDgQWBBR5tFnme7bl5AFzgAiIyBpY9umbbjANBgkq
+hkiG9w0BAQsFAAOCAgEAVR9YqbyyqFDQDLHYGmkgJykIrGF1XIpu+ILlaS/V9lZL
+ubhzEFnTIZd+50xx+7LSYK05qAvqFyFWhfFQDlnrzuBZ6brJFe+GnY+EgPbk6ZGQ
+3BebYhtF8GaV0nxvwuo77x/Py9auJ/GpsMiu/X1+mvoiBOv/2X/qkSsisRcOj/KK
+NFtY2PwByVS5uCbMiogziUwthDyC3+6WVwW6LLv3xLfHTjuCvjHIInNzktHCgKQ5
+ORAzI4JMPJ+GslWYHb4phowim57iaztXOoJwTdwJx4nLCgdNbOhdjsnvzqvHu7Ur
+TkXWStAmzOVyyghqpZXjFaH3pO3JLF+l+/+sKAIuvtd7u+Nxe5AW0wdeRlN8NwdC
+jNPElpzVmbUq4JUagEiuTDkHzsxHpFKVK7q4+63SM1N95R1NbdWhscdCb+ZAJzVc
+oyi3B43njTOQ5yOf+1CceWxG1bQVs5ZufpsMljq4Ui0/1lvh+wjChP4kqKOJ2qxq
+4RgqsahDYVvTH9w7jXbyLeiNdd8XM2w9U/t7y0Ff/9yi0GE44Za4rF2LN9d11TPA
+mRGunUHBcnWEvgJBQl9nJEiU0Zsnvgc/ubhPgXRR4Xq37Z0j4r7g1SgEEzwxA57d
+emyPxgcYxn/eR44/KJ4EBs+lVDR3veyJm+kXQ99b21/+jh5Xos1AnX5iItreGCc=
+-----END CERTIFICATE-----
+)PEM";
+
+// ── OTA file server — its chain must end in this CA as well
+#define OTA_CA_PEM       HIVEMQ_CA_PEM
+
+// ── ESP-NOW mesh — shared by every fixture and handheld; frames
+//    are signed with it (HMAC-SHA256), not encrypted
+#define MESH_KEY         "aipl-mesh-change-me"
+
 // ══════════════════════════════════════════════════════════════
-//  DEVICE IDENTITY — uncomment ONLY ONE line before flashing
-//  Format: AIPL/HighBay/Row_<R>/Light_<L>
+//  DEVICE IDENTITY — one binary for the whole fleet
+//  Row/light (0-based, same as the topics) live in NVS "id" and
+//  are set from the AP setup page or by publishing
+//    aipl/provision/<MAC12>   {"row":2,"light":5}
+//  An unprovisioned device announces itself on
+//  aipl/provision/announce and waits.
+//  DEFAULT_ROW / DEFAULT_LIGHT (1-based build flags) only seed an
+//  empty NVS, e.g. when migrating a per-device build.
 // ══════════════════════════════════════════════════════════════
+#ifndef DEFAULT_ROW
+#define DEFAULT_ROW      0       // 0 = no seed
+#endif
+#ifndef DEFAULT_LIGHT
+#define DEFAULT_LIGHT    0
+#endif
 
-// ── ROW 1 ──────────────────────────────────────────────────
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_1/Light_1";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_1/Light_2";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_1/Light_3";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_1/Light_4";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_1/Light_5";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_1/Light_6";
-
-// ── ROW 2 ──────────────────────────────────────────────────
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_2/Light_1";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_2/Light_2";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_2/Light_3";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_2/Light_4";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_2/Light_5";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_2/Light_6";
-
-// ── ROW 3 ──────────────────────────────────────────────────
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_3/Light_1";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_3/Light_2";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_3/Light_3";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_3/Light_4";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_3/Light_5"; 
-constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_3/Light_6";    // completed
-
-// ── ROW 4 ──────────────────────────────────────────────────
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_4/Light_1";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_4/Light_2";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_4/Light_3";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_4/Light_4";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_4/Light_5";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_4/Light_6";
-
-// ── ROW 5 ──────────────────────────────────────────────────
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_5/Light_1";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_5/Light_2";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_5/Light_3";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_5/Light_4";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_5/Light_5";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_5/Light_6";
-
-// ── ROW 6 ──────────────────────────────────────────────────
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_6/Light_1";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_6/Light_2";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_6/Light_3";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_6/Light_4";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_6/Light_5";
-// constexpr const char* DEVICE_ID = "AIPL/HighBay/Row_6/Light_6";
-
-// ── Parse ROW_INDEX and LIGHT_INDEX from DEVICE_ID at compile time ──
-#define ROW_INDEX   (DEVICE_ID[17] - '1')
-#define LIGHT_INDEX (DEVICE_ID[25] - '1')
+// Grid geometry: fleet slot / scene bit = row * LIGHTS_PER_ROW + light
+const uint8_t LIGHTS_PER_ROW = 6;
+const uint8_t GRID_ROWS      = 6;   // slots past the grid phase by MAC hash
 
 #define FIRMWARE_VERSION "v9.2"
 
+// ── Fast boot — rejoin the last AP by BSSID/channel, skipping the
+//    scan. 1 also reuses the last DHCP lease as a static address and
+//    skips DHCP: only where the router reserves each light's address,
+//    since a reused lease is never renewed.
+#ifndef FAST_BOOT_STATIC_IP
+#define FAST_BOOT_STATIC_IP  0
+#endif
+
+// ── Telemetry encoding ────────────────────────────────────────
+//  TELE_FMT_JSON : .../telemetry        (full JSON, dashboard default)
+//  TELE_FMT_CBOR : .../telemetry/cbor   (compact, dynamic fields only)
+//  TELE_FMT_BOTH : both topics
+//  Static fields always go to the retained .../info message.
+#define TELE_FORMAT      TELE_FMT_JSON
+#define TELE_INCLUDE_METRICS  1   // add worst loop/net iteration to JSON telemetry
+
 // ============================================================
 //  AP MODE
 // ============================================================
@@ -98,116 +146,1184 @@ const int RELAY_OFF = HIGH;
 
 const float WATTAGE = 150.0f;
 const float VOLTAGE = 120.0f;
+const uint32_t WATTAGE_MW = (uint32_t)(WATTAGE * 1000.0f + 0.5f);   // fixed-point for energy
 
 // ============================================================
 //  MQTT TOPICS
 // ============================================================
-char TOPIC_CMD_SINGLE[64];
-char TOPIC_CMD_ROW[48];
-char TOPIC_CMD_ALL[]  = "aipl/all/command";
-char TOPIC_STATE[64];
-char TOPIC_TELE[64];
+//  Built once in setupMQTT() into one static arena — no per-topic
+//  fixed-size arrays, nothing to resize when rows are added.
+// ============================================================
+const size_t TOPIC_ARENA_SIZE = 704;
+char         topicArena[TOPIC_ARENA_SIZE];
+size_t       topicArenaUsed = 0;
+
+const char* TOPIC_CMD_SINGLE = "";
+const char* TOPIC_CMD_ROW    = "";
+const char* TOPIC_CMD_ALL    = "aipl/all/command";
+const char* TOPIC_STATE      = "";
+const char* TOPIC_TELE       = "";
+const char* TOPIC_TELE_CBOR  = "";
+const char* TOPIC_INFO       = "";
+const char* TOPIC_CONFIG     = "";
+const char* TOPIC_BACKLOG    = "";
+const char* TOPIC_PROVISION  = "";          // aipl/provision/<MAC12>
+const char* TOPIC_ANNOUNCE   = "aipl/provision/announce";
+const char* TOPIC_OTA        = "";          // .../ota       — this light, no stagger
+const char* TOPIC_OTA_ROW    = "";          // aipl/row/R/ota
+const char* TOPIC_OTA_ALL    = "aipl/all/ota";
+const char* TOPIC_OTA_STATUS = "";          // .../ota/status, retained
+const char* TOPIC_SCENE      = "aipl/all/scene";   // binary grid bitmask
+const char* TOPIC_ACK        = "";          // .../ack — traced command receipts
+const char* TOPIC_MESH       = "";          // .../mesh — what the mesh did while offline
+const char* TOPIC_GW_CFG     = "";          // aipl/row/R/gateway, retained {"enabled":true}
+const char* TOPIC_GW_LIGHTS  = "";          // aipl/row/R/light/+/command — gateway only
+const char* TOPIC_GW_BATCH   = "";          // aipl/row/R/telemetry/batch — members' telemetry
+const char* TOPIC_SCHEDULE   = "aipl/all/schedule";   // retained rules, see schedule.h
+const char* TOPIC_DESIRED    = "";          // .../desired, retained {"v":<ms>,"state":"ON"}
+const char* DEVICE_ID        = "";
+
+// ── Inbound command topics → enum, matched by length + FNV-1a ─
+enum CmdTopic : uint8_t {
+  CT_NONE, CT_SINGLE, CT_ROW, CT_ALL, CT_CONFIG, CT_PROVISION,
+  CT_OTA, CT_OTA_ROW, CT_OTA_ALL, CT_SCENE, CT_GATEWAY, CT_SCHEDULE, CT_DESIRED
+};
+const int NUM_CMD_TOPICS = 12;
+
+struct TopicKey {
+  const char* str;
+  uint16_t    len;
+  uint32_t    hash;
+  CmdTopic    id;
+};
+TopicKey cmdTopics[NUM_CMD_TOPICS];   // filled once in setupMQTT()
 
 // ============================================================
 //  INTERVALS
 // ============================================================
-const unsigned long TELE_INTERVAL = 5000;
-const unsigned long WIFI_CHECK_MS = 10000;
+const unsigned long TELE_SAMPLE_MS = 1000;  // RSSI deadband check period
+const unsigned long DRAIN_INTERVAL_MS = 250; // backlog: ≤ 1 batch per interval
+const unsigned long PERSIST_COALESCE_MS = 2000;  // NVS write delay after a change
+const unsigned long ONTIME_JOURNAL_S    = 60;    // max on-time lost to a power cut
+const unsigned long MEM_SAMPLE_MS       = 10000;
+const uint8_t       MEM_GUARD_STREAK    = 3;     // consecutive low samples → restart
+const unsigned long WIFI_RETRY_MS        = 10000;  // re-issue begin() if still down
+const unsigned long MQTT_RETRY_MS        = 5000;   // first-attempt phase window
+const unsigned long WIFI_BOOT_TIMEOUT_MS = 20000;  // first connect → else AP mode
+const unsigned long WIFI_FAST_TIMEOUT_MS = 3000;   // cached-AP join → else full scan
+const uint32_t      SPREAD_MAX_MS        = 60000;  // cap on a group command's spread_ms
+const unsigned long REPORT_SETTLE_MS     = 250;    // state change → one merged report
+const unsigned long GROUP_REPORT_SPREAD_MS = 2000; // unspread group switch: reports fan out
 const unsigned long WDT_TIMEOUT_S = 30;
+const unsigned long MDNS_BROWSE_MS       = 60000;  // neighbour re-discovery
+const uint32_t      MDNS_BROWSE_WAIT_MS  = 3000;   // one async browse window
+const unsigned long NEIGHBOUR_TTL_MS     = 300000; // forget after ~5 missed browses
+const uint8_t       MESH_TTL             = 4;      // hops; corner to corner of the 6×6 grid
+const uint8_t       MESH_ORIGINS         = 48;     // senders tracked for replay/dup checks
+const unsigned long GW_BEACON_MS         = 2000;   // row beacon, also the members' report
+const unsigned long GW_FAILOVER_MS       = 7000;   // gateway silent this long → re-elect
+const unsigned long GW_ELECT_MS          = 5000;   // listen window before claiming the row
+const uint8_t       GW_RELAY_TTL         = 2;      // gateway → members, one bay
+
+// ============================================================
+//  TASKS — network on core 0, relay control on core 1
+//  HTTP runs in AsyncTCP's async_tcp task (pinned to core 1 via
+//  CONFIG_ASYNC_TCP_RUNNING_CORE); loopTask has nothing left to do.
+// ============================================================
+const BaseType_t  NET_CORE   = 0;
+const BaseType_t  CTRL_CORE  = 1;
+const uint32_t    NET_STACK  = 8192;   // TLS handshake needs the headroom
+const uint32_t    CTRL_STACK = 4096;
+const UBaseType_t NET_PRIO   = 1;
+const UBaseType_t CTRL_PRIO  = 4;      // above async_tcp (3) → preempts HTTP
+const TickType_t  NET_TICK   = pdMS_TO_TICKS(10);
+const uint32_t    OTA_STACK  = 8192;   // second TLS session + 1 KB chunk
+const UBaseType_t OTA_PRIO   = 1;      // shares core 0 with the network task
+
+// ============================================================
+//  OTA — pull update, staggered across the fleet
+// ============================================================
+const uint32_t      OTA_STAGGER_S   = 10;       // default gap between slots
+const size_t        OTA_CHUNK       = 1024;
+const unsigned long OTA_STALL_MS    = 15000;    // no bytes for this long → abort
+const unsigned long OTA_TRIAL_MS    = 300000;   // new image must reach the broker in time
+const uint8_t       OTA_TRIAL_BOOTS = 3;        // ...and within this many boots
+
+// ============================================================
+//  COMMAND QUEUE — lock-free, single producer / single consumer
+//  One queue per producing task (network, HTTP); the control
+//  task is the only consumer. N must be a power of two.
+// ============================================================
+enum CmdType : uint8_t {
+  CMD_SET,        // user/cloud command → setLightState()
+  CMD_FAILSAFE,   // WiFi/MQTT loss    → forceLight(true)
+  CMD_FLUSH,      // commit pending NVS writes; state = notify the network task when done
+  CMD_SCHEDULE    // schedule timer fired → scheduleLight()
+};
+
+struct LightCmd {
+  CmdType  type;
+  bool     state;
+  uint32_t seq;        // 0 = untraced
+  uint64_t originMs;   // sender's clock, echoed back untouched
+  int64_t  rxUs;       // esp_timer at receipt → receive-to-GPIO time
+  EvSource src;        // which producer, for the event log
+  uint32_t deferUs;    // deliberate wait (group spread), kept out of the latency
+};
+
+template <typename T, uint8_t N>
+class SpscQueue {
+public:
+  bool push(const T& v) {
+    uint8_t h    = head.load(std::memory_order_relaxed);
+    uint8_t next = (h + 1) & (N - 1);
+    if (next == tail.load(std::memory_order_acquire)) return false;  // full
+    buf[h] = v;
+    head.store(next, std::memory_order_release);
+    return true;
+  }
+  bool pop(T& v) {
+    uint8_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;     // empty
+    v = buf[t];
+    tail.store((t + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+private:
+  static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+  T                    buf[N];
+  std::atomic<uint8_t> head{0};
+  std::atomic<uint8_t> tail{0};
+};
 
 // ============================================================
 //  STATE
 // ============================================================
-bool          lightState      = true;
-bool          userForcedOff   = false;  // FIX v9.2: true when user explicitly commanded OFF
 bool          apMode          = true;
 
-Preferences   prefs;
+// ── Identity — loaded once in setup(), read-only afterwards ─
+const uint8_t NO_INDEX        = 0xFF;
+uint8_t       rowIndex        = NO_INDEX;
+uint8_t       lightIndex      = NO_INDEX;
+bool          provisioned     = false;
+char          macHex[13]      = "";
+volatile bool mqttOnline      = false;  // mirror of mqtt.connected(), owned by network task
+DevicePhase   devPhase;                 // per-device timer phases — seeded after loadIdentity()
+
+// ── MQTT reconnect policy — network task writes, HTTP reads ─
+//  Capped exponential backoff per failure class: a credential
+//  reject retries in minutes, not every 5 s with a fresh TLS
+//  handshake. Jitter comes from devPhase; success resets it.
+enum MqttFail : uint8_t { MF_NONE, MF_NETWORK, MF_TLS, MF_BROKER, MF_AUTH, MF_COUNT };
+const char* const MQTT_FAIL_NAMES[MF_COUNT] = { "none", "network", "tls", "broker", "auth" };
+
+struct MqttBackoffClass {
+  uint32_t baseMs;
+  uint32_t capMs;
+};
+const MqttBackoffClass MQTT_BACKOFF[MF_COUNT] = {
+  {  5000,    5000 },      // none
+  {  5000,   60000 },      // network — TCP refused/timeout, link lost
+  { 30000,  600000 },      // tls — handshake/certificate, rarely heals by itself
+  { 15000,  300000 },      // broker — rc 3, server unavailable
+  { 60000, 1800000 },      // auth — rc 1/2/4/5, needs a config change
+};
+
+struct MqttLink {
+  uint32_t      attempts;
+  uint32_t      failures;
+  uint16_t      streak;       // consecutive failures of lastClass
+  int8_t        lastRc;       // mqtt.state() of the last failure
+  MqttFail      lastClass;
+  uint32_t      backoffMs;    // delay chosen after the last failure
+  unsigned long nextTryMs;
+  bool          phased;       // first attempt of this outage scheduled
+};
+MqttLink mqttLink = {};
+
+// ── Desired state — last retained .../desired version applied ─
+// The version itself lives in LightCore (relay.desiredVersion()),
+// saved in the same coalesced flush as the relay state
+uint32_t      desiredResyncs  = 0;      // desired differed from the relay
+
+Preferences   prefs;                    // WiFi credentials (setup, then HTTP)
 String        savedSSID       = "";
 String        savedPass       = "";
 
-unsigned long lightOnStart    = 0;
-unsigned long totalOnSeconds  = 0;
-unsigned long sessionStartMs  = 0;
+std::atomic<uint32_t> nvsWrites{0};     // NVS commits outside the relay core, any task
+
+// ── Relay, on-time and energy — see light_core.h ───────────
+//  Only the control task calls set()/force()/tick()/flush();
+//  on()/userForcedOff()/onTimeMs() are safe from any task.
+EspClock      espClock;
+ArduinoGpio   relayGpio;
+PrefsNvs      lsNvs("ls");              // light state — control task
+PrefsNvs      otNvs("ot");              // on-time     — control task
+LightCore     relay({ LIGHT_PIN, RELAY_ON, RELAY_OFF, WATTAGE_MW,
+                      PERSIST_COALESCE_MS, ONTIME_JOURNAL_S * 1000UL },
+                    espClock, relayGpio, lsNvs, otNvs);
+uint64_t      sessionStartMs  = 0;
 unsigned long lastTelemetryMs = 0;
-unsigned long lastWiFiCheckMs = 0;
-
-WiFiClientSecure tlsClient;
+unsigned long teleNextBeatMs  = 0;      // heartbeat deadline on this device's phase
+unsigned long lastTeleSampleMs = 0;
+int8_t        lastTeleRssi    = 0;
+
+// ── Telemetry reporting policy — set over .../config ───────
+//  State changes always publish at once; otherwise publish when
+//  RSSI moves by rssiDeadband (at most every minGapMs) or when
+//  the heartbeat expires.
+struct TelePolicy {
+  uint32_t heartbeatMs;
+  uint32_t minGapMs;
+  uint8_t  rssiDeadband;   // dB
+};
+TelePolicy telePolicy = { 60000, 2000, 6 };
+
+// ── Memory health — sampled by network task ────────────────
+//  Restart (state flushed, clean MQTT disconnect) when free heap
+//  or the largest free block stays under threshold for
+//  MEM_GUARD_STREAK samples. A TLS handshake needs ~16 KB contiguous.
+struct MemGuard {
+  uint32_t minFree;    // bytes, 0 = disabled
+  uint32_t minBlock;   // bytes, 0 = disabled
+};
+MemGuard memGuard = { 20000, 12000 };
+
+struct MemStats {
+  uint32_t freeHeap;
+  uint32_t maxBlock;
+  uint32_t minFree;              // lowest ever since boot
+  uint32_t stackHwm[3];          // bytes left: net, ctrl, http
+  uint8_t  lowStreak;
+};
+MemStats      memStats       = {};
+unsigned long lastMemSampleMs = 0;
+const char* const STACK_NAMES[3] = { "net", "ctrl", "http" };
+
+// Survives the controlled restart so the next boot can report it
+const uint32_t GUARD_MAGIC = 0x4D454D47;   // "MEMG"
+RTC_NOINIT_ATTR uint32_t rtcGuardRestart;
+bool          guardRestarted = false;
+
+// ── OTA — job written by network task, executed by OTA task ─
+enum OtaState : uint8_t {
+  OTA_IDLE, OTA_WAITING, OTA_DOWNLOADING, OTA_READY, OTA_FAILED, OTA_TRIAL
+};
+const char* const OTA_STATE_NAMES[] = {
+  "idle", "waiting", "downloading", "ready", "failed", "trial"
+};
+struct OtaJob {
+  char          url[192];
+  char          version[24];
+  uint8_t       sha256[32];
+  unsigned long startAtMs;
+};
+OtaJob               otaJob         = {};
+volatile OtaState    otaState       = OTA_IDLE;
+volatile uint8_t     otaPct         = 0;
+const char* volatile otaError       = "";
+char                 otaBadVersion[24] = "";   // rolled back once — never retry it
+std::atomic<bool>    otaReport{false};         // OTA task → network task: publish status
+TaskHandle_t         otaTaskHandle  = NULL;
+
+// ── LAN fallback — neighbours found via mDNS _aipl._tcp ────
+//  Written by the network task, read by /api/neighbours, so the
+//  table is guarded like metrics. The dashboard in LittleFS uses
+//  it to reach every light directly when the cloud is down.
+const uint8_t NEIGHBOUR_MAX = 48;          // 36 lights + spares
+struct Neighbour {
+  uint8_t       row;
+  uint8_t       light;
+  uint32_t      ip;                        // lwIP byte order, like WiFi.localIP()
+  unsigned long seenMs;
+};
+Neighbour           neighbours[NEIGHBOUR_MAX];
+uint8_t             neighbourCount = 0;
+portMUX_TYPE        neighbourMux   = portMUX_INITIALIZER_UNLOCKED;
+bool                mdnsStarted    = false;
+mdns_search_once_t* mdnsBrowse     = NULL;
+unsigned long       lastBrowseMs   = 0;
+bool                dashboardOnFs  = false;
+
+// ── ESP-NOW mesh — command relay that needs no AP or broker ─
+//  Frame (40 bytes, little-endian), broadcast on the STA channel:
+//    magic ttl kind row light state sceneLen pad
+//    origin(u32) seq(u32) body[16] tag[8]
+//  tag = first 8 bytes of HMAC-SHA256(MESH_KEY, frame[0..32) with
+//  ttl = 0), so relays can decrement ttl without re-signing.
+//  seq must grow per origin (fixtures use boot << 16 | counter);
+//  anything not above the last seq seen from that origin is a
+//  duplicate copy or a replay and is dropped.
+enum MeshKind : uint8_t { MK_ALL, MK_ROW, MK_LIGHT, MK_SCENE, MK_BEACON };
+const uint8_t MESH_MAGIC     = 0xA7;
+const uint8_t MESH_BODY_MAX  = 16;        // scene payload as on aipl/all/scene, or a GwBeacon
+const uint8_t MESH_TAG_LEN   = 8;
+
+struct __attribute__((packed)) MeshFrame {
+  uint8_t  magic;
+  uint8_t  ttl;
+  uint8_t  kind;                          // MeshKind
+  uint8_t  row;                           // MK_ROW / MK_LIGHT
+  uint8_t  light;                         // MK_LIGHT
+  uint8_t  state;
+  uint8_t  sceneLen;
+  uint8_t  pad;
+  uint32_t origin;                        // sender MAC, low 32 bits
+  uint32_t seq;
+  uint8_t  body[MESH_BODY_MAX];
+  uint8_t  tag[MESH_TAG_LEN];
+};
+static_assert(sizeof(MeshFrame) == 40, "MeshFrame layout is on the air");
+
+struct MeshRx {
+  MeshFrame f;
+  int64_t   rxUs;
+};
+struct MeshOrigin {
+  uint32_t      origin;
+  uint32_t      seq;
+  unsigned long seenMs;
+};
+struct MeshStats {
+  uint32_t rx, tx, relayed, dup, badTag, applied;
+};
+
+SpscQueue<MeshRx, 16>   meshRxQ;          // producer: WiFi task (recv callback)
+SpscQueue<MeshFrame, 8> meshTxQ;          // producer: async_tcp (/api/mesh)
+MeshOrigin    meshOrigins[MESH_ORIGINS];  // network task only
+uint8_t       meshOriginCount = 0;
+MeshStats     meshStats       = {};
+uint32_t      meshRxDropped   = 0;        // WiFi task only
+uint16_t      meshCounter     = 0;
+bool          meshUp          = false;
+// applied while MQTT was down — reported on reconnect
+uint32_t      meshOffline     = 0;
+uint32_t      meshLastOrigin  = 0;
+uint32_t      meshLastSeq     = 0;
+
+// ── Row gateway — one cloud session per row ─────────────────
+//  With gateway mode on, the lights of a row elect one of them
+//  (lowest light index that has WiFi) to hold the MQTT/TLS
+//  session. It subscribes to the row on everyone's behalf, relays
+//  commands over the mesh and publishes the members' state and a
+//  batched telemetry message. Members never open TLS; if the
+//  gateway's beacon stops they re-elect.
+enum GwRole : uint8_t { GW_OFF, GW_ELECT, GW_GATEWAY, GW_MEMBER };
+const char* const GW_ROLE_NAMES[] = { "off", "elect", "gateway", "member" };
+const uint8_t GB_GATEWAY = 0x01;          // sender holds the row's cloud session
+const uint8_t GB_CLOUD   = 0x02;          // ...and MQTT is up
+const uint8_t GB_MODE    = 0x04;          // gateway mode on at the sender
+const uint8_t GB_WIFI    = 0x08;          // STA up — sender can take over
+const uint8_t GW_ROW_MAX = 16;            // light indices tracked per row
+
+struct __attribute__((packed)) GwBeacon { // MK_BEACON body, 16 bytes
+  uint8_t  flags;
+  uint8_t  state;
+  int8_t   rssi;
+  uint8_t  pad;
+  uint32_t onS;
+  uint32_t upS;
+  uint32_t energyWh;
+};
+static_assert(sizeof(GwBeacon) <= MESH_BODY_MAX, "GwBeacon must fit a mesh frame");
+
+struct GwPeer {
+  unsigned long seenMs;                   // 0 = never heard
+  GwBeacon      b;
+  int8_t        published;                // state last published for it, -1 = none
+};
+GwPeer          gwPeers[GW_ROW_MAX];      // network task only, by light index
+volatile GwRole gwRole        = GW_OFF;
+bool            gwMode        = false;    // NVS "gw"/"on"
+uint8_t         gwLeader      = NO_INDEX;
+unsigned long   gwLeaderMs    = 0;
+bool            gwLeaderCloud = true;
+unsigned long   gwPhaseMs     = 0;
+uint8_t         gwRounds      = 0;
+unsigned long   gwBeaconMs    = 0;
+unsigned long   gwNextBeaconMs = 0;       // periodic beacon, on this light's phase
+unsigned long   gwNextBatchMs  = 0;
+bool            gwBeaconNow   = false;
+unsigned long   gwBatchMs     = 0;
+unsigned long   gwAnnounceOff = 0;        // keep beaconing "mode off" until then
+int8_t          gwModeWanted  = -1;       // from .../gateway, applied outside mqtt.loop()
+uint32_t        gwRelayed     = 0;
+uint32_t        gwFailovers   = 0;
+
+// ── Schedule — weekday/time rules run from NTP time ─────────
+const char*  NTP_SERVER_1     = "pool.ntp.org";
+const char*  NTP_SERVER_2     = "time.google.com";
+const time_t SCHED_TIME_VALID = 1700000000;   // earlier = RTC not set since boot
+
+Schedule            sched;                    // network task
+esp_timer_handle_t  schedTimer    = NULL;
+time_t              schedNextAt   = 0;        // epoch of the armed event, 0 = none
+std::atomic<bool>   schedNextState{false};    // network → timer callback
+std::atomic<bool>   schedRearm{true};         // rules, clock or armed event changed
+std::atomic<bool>   schedDue{false};          // armed event has fired
+uint32_t            schedFired    = 0;        // control task
+uint32_t            schedSkipped  = 0;        // control task
+bool                schedOwnsOff  = false;    // control task: last OFF was the schedule's
+
+// ── Event log — audit trail on the "evlog" partition ───────
+//  Any task calls logEvent(); records wait in a small RAM ring,
+//  stamped at the moment they happened, and the network task —
+//  the only flash writer — appends them (evTick).
+struct PendingEvent {
+  uint32_t epoch;
+  uint32_t upS;
+  uint8_t  type;
+  uint16_t value;
+};
+const uint8_t  EV_PENDING_MAX = 32;
+const uint8_t  EV_READ_BATCH  = 8;        // records per flash read when streaming
+const uint32_t EV_QUERY_LIMIT = 1000;     // default ?limit=
+
+PartitionFlash    evFlash("evlog");
+EventLog          eventLog(evFlash);
+PendingEvent      evPending[EV_PENDING_MAX];
+uint8_t           evPendHead  = 0;        // guarded by evLock
+uint8_t           evPendCount = 0;
+uint32_t          evDropped   = 0;        // ring full, or no partition
+hal::Spinlock     evLock;
+std::atomic<bool> evClockLogged{false};
+
+// ── Group switching — row/all commands with "spread_ms" ────
+//  Each light waits its own offset in the window (by index), so a
+//  floor switches as a ramp, not one inrush spike; the state report
+//  that follows is merged and deferred (serviceTelemetry).
+// MK_ROW / MK_ALL mesh body; all zero (older senders) = at once
+struct __attribute__((packed)) MeshSpread {
+  uint16_t spread10ms;       // window, 10 ms units
+  uint8_t  fleet;            // 1 = offsets across the fleet (aipl/all), 0 = within the row
+};
+esp_timer_handle_t spreadTimer   = NULL;
+LightCmd           spreadCmd;               // network → timer callback, under spreadLock
+hal::Spinlock      spreadLock;
+bool               spreadState   = false;   // network task: what is armed...
+int64_t            spreadDueUs   = 0;       // ...and when it fires
+uint32_t           spreadDeferred = 0;      // network task
+uint32_t           spreadSuperseded = 0;    // control task
+SetOrder           setOrder;                // control task: supersedes stale deferred sets
+bool               reportArmed   = false;   // network task: merged report pending
+unsigned long      reportDueMs   = 0;
+unsigned long      groupAtMs     = 0;       // last unspread group command, 0 = none
+
+// ── Store-and-forward backlog — owned by network task ──────
+//  Samples and state changes captured while MQTT is down, drained
+//  in rate-limited CBOR batches after reconnect. When the RAM ring
+//  fills, the oldest SPILL_BLOCK records move to an NVS slot.
+enum TeleRecKind : uint8_t { REC_SAMPLE = 0, REC_STATE = 1 };
+
+struct TeleRecord {            // 12 bytes
+  uint32_t uptimeS;            // seconds since boot `boot`
+  uint32_t onSeconds;
+  int8_t   rssi;
+  uint8_t  kind;               // TeleRecKind
+  uint8_t  state;
+  uint8_t  pad;
+};
+
+template <typename T, uint16_t N>
+class RingBuffer {
+public:
+  uint16_t size() const { return _count; }
+  bool     full() const { return _count == N; }
+  const T& at(uint16_t i) const { return _buf[(_head + i) % N]; }
+  void push(const T& v) {          // overwrites oldest when full
+    _buf[(_head + _count) % N] = v;
+    if (_count < N) _count++;
+    else            _head = (_head + 1) % N;
+  }
+  void drop(uint16_t n) {
+    if (n > _count) n = _count;
+    _head   = (_head + n) % N;
+    _count -= n;
+  }
+private:
+  T        _buf[N];
+  uint16_t _head  = 0;
+  uint16_t _count = 0;
+};
+
+const uint16_t TELE_RING_SIZE   = 128;   // ~2 h at 60 s heartbeat
+const uint16_t SPILL_BLOCK      = 64;    // records per NVS slot
+const uint8_t  TELE_SPILL_SLOTS = 4;     // 0 = RAM only
+const uint16_t DRAIN_BATCH      = 16;    // records per publish
+
+struct SpillSlot {
+  uint16_t   boot;
+  uint16_t   n;
+  TeleRecord recs[SPILL_BLOCK];
+};
+
+RingBuffer<TeleRecord, TELE_RING_SIZE> teleRing;
+Preferences   tqPrefs;                   // own handle: prefs belongs to control task
+uint16_t      bootNo       = 0;
+uint8_t       spillHead    = 0;          // oldest occupied slot
+uint8_t       spillCount   = 0;
+SpillSlot     drainSlot;                 // slot currently being drained
+uint16_t      drainPos     = 0;
+bool          drainLoaded  = false;
+uint32_t      teleDropped  = 0;          // records lost since last drain
+unsigned long lastDrainMs  = 0;
+
+// ── WiFi connection manager — driven by WiFi.onEvent() ─────
+enum WiFiPhase : uint8_t {
+  WIFI_PH_IDLE,        // nothing to do (no credentials yet)
+  WIFI_PH_START,       // begin() not issued yet
+  WIFI_PH_CONNECTING,  // waiting for GOT_IP
+  WIFI_PH_UP,          // associated + IP
+  WIFI_PH_START_AP,    // switch to setup AP on next tick
+  WIFI_PH_AP           // setup AP running
+};
+WiFiPhase         wifiPhase    = WIFI_PH_IDLE;   // owned by network task
+unsigned long     wifiPhaseMs  = 0;
+unsigned long     wifiBootMs   = 0;
+uint32_t          wifiRetries  = 0;              // begin() re-issues, indexes the jitter
+bool              wifiEverUp   = false;
+// Last good association, NVS "wfc" — the fast-boot path
+struct WifiCache {
+  uint32_t ssidHash;         // changed credentials invalidate it
+  uint8_t  bssid[6];
+  uint8_t  channel;
+  uint8_t  pad;
+  uint32_t ip, gw, mask, dns;
+};
+WifiCache         wifiCache;
+bool              wifiCacheOk  = false;
+bool              wifiFastTry  = false;          // current begin() used the cache
+
+// Boot phases, ms since reset (esp_timer); 0 = not reached yet.
+// Sent once in the first telemetry message, always in /api/status.
+struct BootTimes {
+  uint32_t relayMs;          // relay driven from NVS
+  uint32_t ipMs;             // first GOT_IP
+  uint32_t mqttMs;           // first broker CONNACK (TLS included)
+  bool     fastWifi;         // joined through the cache
+};
+BootTimes         bootTimes    = {};
+bool              bootTimesSent = false;         // network task
+
+std::atomic<bool> wifiEvtUp{false};              // set from WiFi event task
+std::atomic<bool> wifiEvtDown{false};
+volatile uint8_t  wifiDiscReason = 0;
+
+TlsSessionClient tlsClient;      // resumes cached TLS sessions
 PubSubClient     mqtt(tlsClient);
-WebServer        server(80);
+PubSubMqtt       cloudMqtt(mqtt);   // hal::Mqtt view for portable publishers
+AsyncWebServer   server(80);     // handlers run in the async_tcp task
+
+SpscQueue<LightCmd, 16> netCmdQ;          // producer: network task
+SpscQueue<LightCmd, 16> webCmdQ;          // producer: async_tcp (HTTP handlers)
+SpscQueue<LightCmd, 16> timerCmdQ;        // producer: esp_timer task (schedule)
+SpscQueue<CmdAck, 16>   ackQ;             // control → network
+uint32_t                ackDropped = 0;   // control task only
+std::atomic<bool>       reportPending{false};  // control → network: publish state
+TaskHandle_t            netTaskHandle  = NULL;
+TaskHandle_t            ctrlTaskHandle = NULL;
+TaskHandle_t            httpTaskHandle = NULL;     // async_tcp
+std::atomic<uint32_t>   flushCount{0};             // bumped once each persistFlush() has committed
+
+// HTTP handlers never block: a restart is requested here and
+// carried out by the network task once the response is out.
+std::atomic<bool>       restartPending{false};
+unsigned long           restartAtMs    = 0;
+const char*             restartWhy     = "";
+
+// Telemetry policy from the LAN batch API — applied (and .../info
+// republished) by the network task, which owns MQTT
+char                    lanConfig[192];
+size_t                  lanConfigLen   = 0;
+std::atomic<bool>       lanConfigPending{false};
+
+// ============================================================
+//  STATUS MODEL
+// ============================================================
+// /api/neighbours: header plus NEIGHBOUR_MAX entries, each at its widest
+const size_t NEIGHBOUR_HDR_MAX   = 64;   // with the closing "]}" and the NUL
+const size_t NEIGHBOUR_ENTRY_MAX = 66;
+static_assert(sizeof("{\"row\":255,\"light\":255,\"ip\":\"255.255.255.255\",\"devices\":[]}")
+              <= NEIGHBOUR_HDR_MAX, "NEIGHBOUR_HDR_MAX below the widest header");
+static_assert(sizeof("{\"row\":255,\"light\":255,\"ip\":\"255.255.255.255\",\"age_s\":4294967295},") - 1
+              <= NEIGHBOUR_ENTRY_MAX, "NEIGHBOUR_ENTRY_MAX below the widest device entry");
+const size_t NEIGHBOUR_JSON_MAX  = NEIGHBOUR_HDR_MAX + NEIGHBOUR_MAX * NEIGHBOUR_ENTRY_MAX;
+const size_t STATUS_JSON_MAX = 640;
+// {"results":[ … ]} — every op answers in at most BATCH_RESULT_MAX
+// ({"ok":false,"error":"queue full or no mesh"}, is the longest);
+// one status op per batch carries the snapshot on top of that
+const size_t BATCH_RESULT_MAX   = 48;
+const size_t BATCH_JSON_MAX     = 32 + BATCH_OPS_MAX * BATCH_RESULT_MAX + STATUS_JSON_MAX;
+
+const size_t CBOR_TELE_MAX   = 48;
+// /api/metrics with every counter at UINT32_MAX and every signed field
+// at INT32_MIN renders 2021 bytes; grow this with new metrics objects
+const size_t METRICS_JSON_MAX = 2048;
+
+enum StatusView : uint8_t {
+  VIEW_HTTP,        // /api/status
+  VIEW_TELEMETRY,   // .../telemetry (JSON)
+  VIEW_INFO         // .../info, retained, once per connect
+};
+
+enum TeleFormat : uint8_t { TELE_FMT_JSON, TELE_FMT_CBOR, TELE_FMT_BOTH };
+
+// CBOR telemetry keys — small uints keep each sample ~30 bytes.
+// Listed in the .../info message as "cbor_keys" for decoders.
+enum CborKey : uint8_t {
+  CK_STATE    = 1,   // bool
+  CK_ON_S     = 2,   // uint  on_seconds
+  CK_OFF_S    = 3,   // uint  off_seconds
+  CK_KWH      = 4,   // f32   kwh_used
+  CK_RSSI     = 5,   // int   dBm
+  CK_UPTIME_S = 6    // uint
+};
+#define CBOR_KEY_LEGEND "1=state,2=on_s,3=off_s,4=kwh,5=rssi,6=uptime_s"
+
+struct StatusSnapshot {
+  bool          state;
+  bool          userForcedOff;
+  bool          mqtt;
+  int8_t        rssi;
+  uint32_t      ip;
+  uint32_t      onSeconds;
+  uint32_t      offSeconds;
+  uint32_t      uptimeS;
+  uint64_t      energyMwh;
+  uint32_t      tlsMs;
+  bool          tlsResumed;
+  uint32_t      nvsWrites;
+  uint32_t      heapFree;
+  uint32_t      heapMaxBlock;
+  uint32_t      heapMinFree;
+  uint32_t      httpIterMaxUs;   // peek, not reset — /api/metrics owns the window
+  uint32_t      netIterMaxUs;
+  uint32_t      cmdP50Us;
+  uint32_t      cmdP99Us;
+};
+
+// ============================================================
+//  METRICS — per-stage timing + log2 iteration histograms
+//  esp_timer_get_time() (µs); each stage has a single writer
+//  task, the spinlock only guards the reset-on-read in HTTP.
+// ============================================================
+enum Stage : uint8_t {
+  ST_HTTP,            // one HTTP request handler
+  ST_WIFI,            // wifiManagerTick()
+  ST_MQTT_LOOP,       // mqtt.loop()
+  ST_MQTT_RECONNECT,  // mqttReconnect() incl. TLS handshake
+  ST_TELEMETRY,       // publishTelemetry()
+  ST_COUNT
+};
+const char* const STAGE_NAMES[ST_COUNT] = { "http", "wifi", "mqtt_loop", "mqtt_reconnect", "telemetry" };
+
+enum IterLoop : uint8_t { IT_HTTP, IT_NET, IT_COUNT };
+const char* const ITER_NAMES[IT_COUNT] = { "http_hist", "net_hist" };
+const uint8_t ITER_BUCKETS = 24;   // bucket i = [2^i, 2^(i+1)) µs, last ≥ 8.4 s
+
+struct StageStat {
+  uint32_t n;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t sumUs;
+};
+
+struct Metrics {
+  StageStat stage[ST_COUNT];
+  uint32_t  hist[IT_COUNT][ITER_BUCKETS];
+  uint32_t  iterMaxUs[IT_COUNT];
+  int64_t   sinceUs;
+};
+
+Metrics      metrics;
+portMUX_TYPE metricsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// ── Command latency — receive → relay GPIO, rolling window ──
+//  Control task writes, readers sort a copy; not reset by
+//  /api/metrics so p99 stays meaningful between scrapes.
+const uint8_t CMD_LAT_WINDOW = 128;
+struct CmdLatency {
+  uint32_t us[CMD_LAT_WINDOW];
+  uint8_t  head;
+  uint8_t  n;
+  uint32_t total;          // commands since boot
+};
+struct LatencySummary {
+  uint32_t n;
+  uint32_t p50Us;
+  uint32_t p99Us;
+  uint32_t maxUs;
+};
+CmdLatency cmdLatency = {};
+
+// Times the enclosing scope into one stage
+struct StageTimer {
+  explicit StageTimer(Stage st) : s(st), t0(esp_timer_get_time()) {}
+  ~StageTimer();
+  Stage   s;
+  int64_t t0;
+};
+
+// Times one HTTP request into ST_HTTP and the http histogram
+struct HttpTimer {
+  HttpTimer() : t0(esp_timer_get_time()) {}
+  ~HttpTimer();
+  int64_t t0;
+};
 
 // ============================================================
 //  FORWARD DECLARATIONS
 // ============================================================
 void          setLightState(bool state, bool saveToFlash = true);
+void          cmdLatencyAdd(uint32_t us);
+LatencySummary cmdLatencySummary();
+void          publishAcks();
 void          forceLight(bool state);
-void          saveLightState(bool s);
-bool          loadLightState();
-void          saveOnTime(unsigned long s);
-unsigned long loadOnTime();
-unsigned long getOnSeconds();
-unsigned long getOffSeconds();
-float         getKwh();
+void          persistFlush();
+uint64_t      nowMs();
+uint64_t      uptimeMs();
+uint64_t      onTimeMs();
+uint32_t      getOnSeconds();
+uint32_t      getOffSeconds();
+uint64_t      getEnergyMwh();
 void          publishTelemetry();
 void          publishState();
+void          publishInfo();
+bool          telemetryDue();
+void          teleBeatSchedule(unsigned long from);
+void          applyDeviceConfig(byte* payload, unsigned int len);
+void          initBacklog();
+void          bufferRecord(TeleRecKind kind);
+void          spillOldest();
+bool          publishBacklog(const TeleRecord* recs, uint16_t n, uint16_t boot);
+void          drainBacklog();
+void          serviceTelemetry();
+void          memGuardTick();
+void          controlledRestart(const char* why);
+void          otaRequest(byte* payload, unsigned int len, CmdTopic via);
+void          otaTask(void* arg);
+const char*   otaDownload();
+void          otaTick();
+void          otaBootCheck();
+void          otaConfirm();
+void          otaRollback(const char* why);
+void          publishOtaStatus();
 void          mqttCallback(char* topic, byte* payload, unsigned int len);
 void          mqttReconnect();
+MqttFail      mqttClassify(int rc);
+void          mqttBackoff(unsigned long now);
 void          setupMQTT();
+void          loadIdentity();
+void          saveIdentity(uint8_t row, uint8_t light);
+const char*   arenaTopic(const char* fmt, ...);
+void          applyProvisioning(byte* payload, unsigned int len);
+uint16_t      fleetSlot();
+void          applyScene(const byte* payload, unsigned int len, int64_t rxUs);
+void          applyDesired(const byte* payload, unsigned int len, int64_t rxUs);
+void          groupCommand(bool state, uint32_t spreadMs, bool fleet, uint32_t seq, uint64_t originMs, int64_t rxUs);
+uint32_t      spreadOffsetMs(uint32_t spreadMs, bool fleet);
+bool          spreadPending(bool state);
 void          startAPMode();
 void          setupWebServer();
-void          checkWiFiHealth();
-String        getStatusJson();
+void          mdnsBegin();
+void          lanTick();
+void          neighbourSeen(const mdns_result_t* r);
+void          sendNeighboursJson(AsyncWebServerRequest* req);
+void          lanConfigTick();
+void          handleBatch(AsyncWebServerRequest* req);
+void          batchBody(AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total);
+void          meshBegin();
+void          meshTick();
+void          meshReconcile();
+bool          meshFrameFromRequest(AsyncWebServerRequest* req, MeshFrame& f);
+void          meshOriginate(MeshFrame& f, uint8_t ttl);
+void          gwInit();
+void          gwTick();
+void          gwBeacon(const MeshFrame& f);
+void          gwOnConnect();
+void          gwApplyConfig(byte* payload, unsigned int len);
+void          gwRelay(MeshKind kind, uint8_t light, bool state, const byte* body, unsigned int len);
+bool          gwMemberTopic(const char* topic, uint8_t& light);
+bool          gwCloudAllowed();
+void          schedBegin();
+void          schedTick();
+void          schedApply(const byte* payload, unsigned int len);
+void          schedSetOwnsOff(bool v);
+void          scheduleLight(bool state);
+void          evBegin();
+void          logEvent(EvType type, uint16_t value);
+void          evTick();
+void          sendEvents(AsyncWebServerRequest* req);
+void          onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+void          wifiManagerTick();
+void          wifiBegin(unsigned long now);
+void          wifiCacheLoad();
+void          wifiCacheSave();
+uint32_t      sinceResetMs();
+void          takeSnapshot(StatusSnapshot& st);
+size_t        writeStatusJson(char* buf, size_t cap, StatusView view);
+void          writeBootTimes(JsonWriter& w);
+size_t        writeStatusCbor(uint8_t* buf, size_t cap);
+void          sendJson(AsyncWebServerRequest* req, const char* buf, size_t n);
+bool          publishJson(const char* topic, const char* buf, size_t n, bool retain);
+void          sendStatusJson(AsyncWebServerRequest* req);
+void          metricsReset();
+void          metricsStage(Stage s, uint32_t us);
+void          metricsIter(IterLoop l, uint32_t us);
+void          sendMetricsJson(AsyncWebServerRequest* req);
+void          sendAsset(AsyncWebServerRequest* req, const WebAsset& a);
+void          requestRestart(const char* why, unsigned long delayMs);
+void          restartTick();
+uint32_t      fnv1a32(const char* s, size_t n);
+CmdTopic      matchCmdTopic(const char* topic);
+bool          parseOnOff(const byte* p, unsigned int len);
+bool          queueCommand(SpscQueue<LightCmd, 16>& q, CmdType type, bool state,
+                           uint32_t seq = 0, uint64_t originMs = 0, int64_t rxUs = 0,
+                           uint32_t deferUs = 0);
+void          controlTask(void* arg);
+void          networkTask(void* arg);
 
 // ============================================================
-//  PREFERENCES
+//  PERSISTENCE + TIME — delegated to the relay core
+//  Handles stay open for the whole uptime; writes are coalesced
+//  PERSIST_COALESCE_MS and on-time journaled every ONTIME_JOURNAL_S
+//  (see LightCore). Time is 64-bit esp_timer ms, never wraps.
 // ============================================================
-void saveLightState(bool s) {
-  prefs.begin("ls", false); prefs.putBool("l1", s); prefs.end();
-}
-bool loadLightState() {
-  prefs.begin("ls", true); bool s = prefs.getBool("l1", true); prefs.end(); return s;
+void persistFlush() {
+  relay.flush();
+  flushCount++;                          // after the commit: waiters may restart on it
 }
-void saveOnTime(unsigned long s) {
-  prefs.begin("ot", false); prefs.putULong("t", s); prefs.end();
-}
-unsigned long loadOnTime() {
-  prefs.begin("ot", true); unsigned long t = prefs.getULong("t", 0); prefs.end(); return t;
+
+uint64_t nowMs()        { return espClock.nowMs(); }
+uint64_t uptimeMs()     { return nowMs() - sessionStartMs; }
+uint64_t onTimeMs()     { return relay.onTimeMs(); }
+uint64_t getEnergyMwh() { return relay.energyMwh(); }
+
+uint32_t getOnSeconds() { return (uint32_t)(onTimeMs() / 1000); }
+
+// This boot only: uptime minus the on-time accrued since boot
+uint32_t getOffSeconds() {
+  uint64_t up = uptimeMs();
+  uint64_t on = onTimeMs() - relay.bootOnMs();
+  return (uint32_t)((up > on ? up - on : 0) / 1000);
 }
 
 // ============================================================
-//  TIME HELPERS
+//  STATUS MODEL — one snapshot, two views (HTTP / telemetry)
+//  Serialized by JsonWriter straight into a caller buffer:
+//  no String, no JsonDocument, no heap.
 // ============================================================
-unsigned long getOnSeconds() {
-  unsigned long s = totalOnSeconds;
-  if (lightState && lightOnStart > 0)
-    s += (millis() - lightOnStart) / 1000;
-  return s;
+void takeSnapshot(StatusSnapshot& st) {
+  st.state         = relay.on();
+  st.userForcedOff = relay.userForcedOff();
+  st.mqtt          = mqttOnline;
+  st.rssi          = WiFi.RSSI();
+  st.ip            = WiFi.localIP();
+  st.onSeconds     = getOnSeconds();
+  st.offSeconds    = getOffSeconds();
+  st.uptimeS       = (uint32_t)(uptimeMs() / 1000);
+  st.energyMwh     = getEnergyMwh();
+  st.tlsMs         = tlsClient.lastHandshakeMs();
+  st.tlsResumed    = tlsClient.lastResumed();
+  st.nvsWrites     = nvsWrites.load() + relay.nvsWrites();
+  st.heapFree      = memStats.freeHeap;
+  st.heapMaxBlock  = memStats.maxBlock;
+  st.heapMinFree   = memStats.minFree;
+  st.httpIterMaxUs = metrics.iterMaxUs[IT_HTTP];
+  st.netIterMaxUs  = metrics.iterMaxUs[IT_NET];
+  LatencySummary lat = cmdLatencySummary();
+  st.cmdP50Us      = lat.p50Us;
+  st.cmdP99Us      = lat.p99Us;
 }
-unsigned long getOffSeconds() {
-  unsigned long up = (millis() - sessionStartMs) / 1000;
-  unsigned long on = getOnSeconds();
-  return (up > on) ? (up - on) : 0;
+
+void ipToStr(uint32_t ip, char* out) {   // out: 16 bytes
+  snprintf(out, 16, "%u.%u.%u.%u",
+           (unsigned)(ip & 0xFF),         (unsigned)((ip >> 8) & 0xFF),
+           (unsigned)((ip >> 16) & 0xFF), (unsigned)(ip >> 24));
+}
+
+void writeBootTimes(JsonWriter& w) {
+  w.beginObj("boot");
+  w.addUInt("relay_ms",  bootTimes.relayMs);
+  w.addUInt("ip_ms",     bootTimes.ipMs);
+  w.addUInt("mqtt_ms",   bootTimes.mqttMs);
+  w.addBool("fast_wifi", bootTimes.fastWifi);
+  w.addBool("static_ip", bootTimes.fastWifi && FAST_BOOT_STATIC_IP);
+  w.endObj();
+}
+
+size_t writeStatusJson(char* buf, size_t cap, StatusView view) {
+  StatusSnapshot st;
+  takeSnapshot(st);
+
+  char ip[16];
+  ipToStr(st.ip, ip);
+
+  JsonWriter w(buf, cap);
+  if (view == VIEW_HTTP) {
+    w.addBool ("state",         st.state);
+    w.addBool ("userForcedOff", st.userForcedOff);
+    w.addInt  ("row",           provisioned ? rowIndex   : -1);
+    w.addInt  ("light",         provisioned ? lightIndex : -1);
+    w.addUInt ("on_seconds",    st.onSeconds);
+    w.addUInt ("off_seconds",   st.offSeconds);
+    w.addFixed("kwh",           st.energyMwh, 6, 4);
+    w.addInt  ("rssi",          st.rssi);
+    w.addStr  ("ip",            ip);
+    w.addBool ("mqtt",          st.mqtt);
+    w.addUInt ("mqtt_attempts", mqttLink.attempts);
+    w.addUInt ("mqtt_failures", mqttLink.failures);
+    w.addInt  ("mqtt_last_rc",  mqttLink.lastRc);
+    w.addStr  ("mqtt_last_fail", MQTT_FAIL_NAMES[mqttLink.lastClass]);
+    w.addUInt ("mqtt_streak",   mqttLink.streak);
+    w.addUInt ("mqtt_backoff_ms", st.mqtt ? 0 : mqttLink.backoffMs);
+    w.addU64  ("desired_v",     relay.desiredVersion());
+    w.addUInt ("desired_resyncs", desiredResyncs);
+    w.addStr  ("firmware",      FIRMWARE_VERSION);
+    w.addStr  ("ota",           OTA_STATE_NAMES[otaState]);
+    w.addStr  ("device_id",     DEVICE_ID);
+    w.addStr  ("mac",           macHex);
+    writeBootTimes(w);
+  } else if (view == VIEW_INFO) {
+    w.addInt  ("row",           provisioned ? rowIndex   : -1);
+    w.addInt  ("light",         provisioned ? lightIndex : -1);
+    w.addFloat("wattage",       WATTAGE, 1);
+    w.addFloat("voltage",       VOLTAGE, 1);
+    w.addFloat("current_amps",  WATTAGE / VOLTAGE, 3);
+    w.addStr  ("firmware",      FIRMWARE_VERSION);
+    w.addStr  ("ip",            ip);
+    w.addUInt ("tls_ms",        st.tlsMs);
+    w.addBool ("tls_resumed",   st.tlsResumed);
+    w.addStr  ("device_id",     DEVICE_ID);
+    w.addStr  ("mac",           macHex);
+    w.addStr  ("cbor_keys",     CBOR_KEY_LEGEND);
+    w.addInt  ("reset_reason",  (int32_t)esp_reset_reason());
+    w.addBool ("guard_restart", guardRestarted);
+    w.addUInt ("heartbeat_s",   telePolicy.heartbeatMs / 1000);
+    w.addUInt ("min_gap_s",     telePolicy.minGapMs / 1000);
+    w.addUInt ("rssi_deadband", telePolicy.rssiDeadband);
+  } else {
+    w.addBool ("light_state",   st.state);
+    w.addInt  ("row",           provisioned ? rowIndex   : -1);
+    w.addInt  ("light",         provisioned ? lightIndex : -1);
+    w.addUInt ("on_seconds",    st.onSeconds);
+    w.addUInt ("off_seconds",   st.offSeconds);
+    w.addFixed("kwh_used",      st.energyMwh, 6, 4);
+    w.addInt  ("rssi",          st.rssi);
+    w.addUInt ("uptime_s",      st.uptimeS);
+    w.addFloat("wattage",       WATTAGE, 1);
+    w.addFloat("voltage",       VOLTAGE, 1);
+    w.addFloat("current_amps",  WATTAGE / VOLTAGE, 3);
+    w.addStr  ("firmware",      FIRMWARE_VERSION);
+    w.addUInt ("tls_ms",        st.tlsMs);
+    w.addBool ("tls_resumed",   st.tlsResumed);
+    w.addUInt ("nvs_writes",    st.nvsWrites);
+    w.addUInt ("heap_free",     st.heapFree);
+    w.addUInt ("heap_max_block", st.heapMaxBlock);
+    w.addUInt ("heap_min_free", st.heapMinFree);
+    if (TELE_INCLUDE_METRICS) {
+      w.addUInt("http_iter_max_us", st.httpIterMaxUs);
+      w.addUInt("net_iter_max_us",  st.netIterMaxUs);
+      w.addUInt("cmd_p50_us",       st.cmdP50Us);
+      w.addUInt("cmd_p99_us",       st.cmdP99Us);
+    }
+    if (!bootTimesSent) writeBootTimes(w);
+  }
+  return w.finish();
 }
-float getKwh() {
-  return (WATTAGE / 1000.0f) * (getOnSeconds() / 3600.0f);
+
+// Per-sample CBOR: dynamic fields only, static ones live in .../info
+size_t writeStatusCbor(uint8_t* buf, size_t cap) {
+  StatusSnapshot st;
+  takeSnapshot(st);
+
+  CborWriter c(buf, cap);
+  c.map(6);
+  c.uint(CK_STATE);    c.boolean(st.state);
+  c.uint(CK_ON_S);     c.uint(st.onSeconds);
+  c.uint(CK_OFF_S);    c.uint(st.offSeconds);
+  c.uint(CK_KWH);      c.f32((float)((double)st.energyMwh / 1e6));
+  c.uint(CK_RSSI);     c.sint(st.rssi);
+  c.uint(CK_UPTIME_S); c.uint(st.uptimeS);
+  return c.length();
+}
+
+// The response is sent after the handler returns, so the stack
+// buffer is copied once into the response — still no String
+// n == 0: the JsonWriter overflowed — never serve a cut-off document
+void sendJson(AsyncWebServerRequest* req, const char* buf, size_t n) {
+  if (!n) {
+    Serial.printf("[HTTP] %s: JSON overflow — 500\n", req->url().c_str());
+    req->send(500, "application/json", "{\"error\":\"response too large\"}");
+    return;
+  }
+  AsyncResponseStream* res = req->beginResponseStream("application/json", n);
+  res->write((const uint8_t*)buf, n);
+  req->send(res);
+}
+
+void sendStatusJson(AsyncWebServerRequest* req) {
+  char   buf[STATUS_JSON_MAX];
+  size_t n = writeStatusJson(buf, sizeof(buf), VIEW_HTTP);
+  sendJson(req, buf, n);
 }
 
 // ============================================================
-//  STATUS JSON
+//  METRICS
 // ============================================================
-String getStatusJson() {
-  return String("{") +
-    "\"state\":"           + (lightState    ? "true" : "false") +
-    ",\"userForcedOff\":"  + (userForcedOff ? "true" : "false") +
-    ",\"row\":"            + String(ROW_INDEX)    +
-    ",\"light\":"          + String(LIGHT_INDEX)  +
-    ",\"on_seconds\":"     + String(getOnSeconds())   +
-    ",\"off_seconds\":"    + String(getOffSeconds())  +
-    ",\"kwh\":"            + String(getKwh(), 4)  +
-    ",\"rssi\":"           + String(WiFi.RSSI())  +
-    ",\"ip\":\""           + WiFi.localIP().toString() + "\"" +
-    ",\"mqtt\":"           + (mqtt.connected() ? "true" : "false") +
-    ",\"firmware\":\""     + FIRMWARE_VERSION + "\"}";
+StageTimer::~StageTimer() {
+  metricsStage(s, (uint32_t)(esp_timer_get_time() - t0));
+}
+
+HttpTimer::~HttpTimer() {
+  uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+  metricsStage(ST_HTTP, us);
+  metricsIter(IT_HTTP, us);
+}
+
+void metricsReset() {
+  memset(&metrics, 0, sizeof(metrics));
+  for (int i = 0; i < ST_COUNT; i++) metrics.stage[i].minUs = UINT32_MAX;
+  metrics.sinceUs = esp_timer_get_time();
+}
+
+void metricsStage(Stage s, uint32_t us) {
+  portENTER_CRITICAL(&metricsMux);
+  StageStat& st = metrics.stage[s];
+  st.n++;
+  st.sumUs += us;
+  if (us < st.minUs) st.minUs = us;
+  if (us > st.maxUs) st.maxUs = us;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+void cmdLatencyAdd(uint32_t us) {
+  portENTER_CRITICAL(&metricsMux);
+  cmdLatency.us[cmdLatency.head] = us;
+  cmdLatency.head = (cmdLatency.head + 1) % CMD_LAT_WINDOW;
+  if (cmdLatency.n < CMD_LAT_WINDOW) cmdLatency.n++;
+  cmdLatency.total++;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+// Nearest-rank percentiles over the window
+LatencySummary cmdLatencySummary() {
+  uint32_t v[CMD_LAT_WINDOW];
+  portENTER_CRITICAL(&metricsMux);
+  uint8_t n = cmdLatency.n;
+  memcpy(v, cmdLatency.us, n * sizeof(uint32_t));   // order is irrelevant once sorted
+  portEXIT_CRITICAL(&metricsMux);
+
+  LatencySummary s = { n, 0, 0, 0 };
+  if (!n) return s;
+  std::sort(v, v + n);
+  s.p50Us = v[(n - 1) * 50 / 100];
+  s.p99Us = v[(n - 1) * 99 / 100];
+  s.maxUs = v[n - 1];
+  return s;
+}
+
+void metricsIter(IterLoop l, uint32_t us) {
+  uint8_t b = us ? 31 - __builtin_clz(us) : 0;
+  if (b >= ITER_BUCKETS) b = ITER_BUCKETS - 1;
+  portENTER_CRITICAL(&metricsMux);
+  metrics.hist[l][b]++;
+  if (us > metrics.iterMaxUs[l]) metrics.iterMaxUs[l] = us;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+// GET /api/metrics — snapshot and reset, so each read is one window
+void sendMetricsJson(AsyncWebServerRequest* req) {
+  Metrics m;
+  portENTER_CRITICAL(&metricsMux);
+  m = metrics;
+  metricsReset();
+  portEXIT_CRITICAL(&metricsMux);
+
+  uint32_t worstUs = m.iterMaxUs[IT_HTTP] > m.iterMaxUs[IT_NET] ? m.iterMaxUs[IT_HTTP] : m.iterMaxUs[IT_NET];
+
+  char       buf[METRICS_JSON_MAX];
+  JsonWriter w(buf, sizeof(buf));
+  w.addUInt("window_ms",      (uint32_t)((esp_timer_get_time() - m.sinceUs) / 1000));
+  w.addUInt("wdt_timeout_ms", WDT_TIMEOUT_S * 1000);
+  w.addUInt("worst_iter_ms",  worstUs / 1000);
+  w.beginObj("stages");
+  for (int i = 0; i < ST_COUNT; i++) {
+    const StageStat& st = m.stage[i];
+    w.beginObj(STAGE_NAMES[i]);
+    w.addUInt("n",      st.n);
+    w.addUInt("min_us", st.n ? st.minUs : 0);
+    w.addUInt("max_us", st.maxUs);
+    w.addUInt("avg_us", st.n ? (uint32_t)(st.sumUs / st.n) : 0);
+    w.endObj();
+  }
+  w.endObj();
+  for (int l = 0; l < IT_COUNT; l++) {
+    w.beginArr(ITER_NAMES[l]);
+    for (int b = 0; b < ITER_BUCKETS; b++) w.item(m.hist[l][b]);
+    w.endArr();
+  }
+  LatencySummary lat = cmdLatencySummary();
+  w.beginObj("cmd_latency");
+  w.addUInt("n",      lat.n);
+  w.addUInt("total",  cmdLatency.total);
+  w.addUInt("p50_us", lat.p50Us);
+  w.addUInt("p99_us", lat.p99Us);
+  w.addUInt("max_us", lat.maxUs);
+  w.addUInt("ack_dropped", ackDropped);
+  w.endObj();
+  w.beginObj("mesh");
+  w.addBool("up",         meshUp);
+  w.addUInt("rx",         meshStats.rx);
+  w.addUInt("tx",         meshStats.tx);
+  w.addUInt("relayed",    meshStats.relayed);
+  w.addUInt("dup",        meshStats.dup);
+  w.addUInt("bad_tag",    meshStats.badTag);
+  w.addUInt("applied",    meshStats.applied);
+  w.addUInt("rx_dropped", meshRxDropped);
+  w.addUInt("origins",    meshOriginCount);
+  w.endObj();
+  w.beginObj("gateway");
+  w.addBool("mode",      gwMode);
+  w.addStr ("role",      GW_ROLE_NAMES[gwRole]);
+  w.addInt ("leader",    gwRole == GW_GATEWAY ? lightIndex : (gwLeader == NO_INDEX ? -1 : gwLeader));
+  w.addUInt("relayed",   gwRelayed);
+  w.addUInt("failovers", gwFailovers);
+  w.endObj();
+  time_t now = time(NULL);
+  w.beginObj("schedule");
+  w.addUInt("version",    sched.version);
+  w.addUInt("rules",      sched.count);
+  w.addBool("ntp",        now >= SCHED_TIME_VALID);
+  w.addInt ("next_in_s",  schedNextAt ? (int32_t)(schedNextAt - now) : -1);
+  w.addBool("next_state", schedNextState.load());
+  w.addUInt("fired",      schedFired);
+  w.addUInt("skipped",    schedSkipped);
+  w.addBool("owns_off",   schedOwnsOff);
+  w.endObj();
+  w.beginObj("group");
+  w.addUInt("deferred",   spreadDeferred);
+  w.addUInt("superseded", spreadSuperseded);
+  w.endObj();
+  w.beginObj("evlog");
+  w.addBool("ready",      eventLog.ready());
+  w.addUInt("next_seq",   eventLog.nextSeq());
+  w.addUInt("count",      eventLog.count());
+  w.addUInt("capacity",   eventLog.capacity());
+  w.addUInt("dropped",    evDropped);
+  w.addUInt("write_errors", eventLog.writeErrors());
+  w.endObj();
+  w.beginObj("mem");
+  w.addUInt("free",      memStats.freeHeap);
+  w.addUInt("max_block", memStats.maxBlock);
+  w.addUInt("min_free",  memStats.minFree);
+  w.addUInt("low_streak", memStats.lowStreak);
+  w.endObj();
+  w.beginObj("stack_hwm");
+  for (int i = 0; i < 3; i++) w.addUInt(STACK_NAMES[i], memStats.stackHwm[i]);
+  w.endObj();
+  size_t n = w.finish();
+  sendJson(req, buf, n);
 }
 
 // ============================================================
@@ -216,19 +1332,13 @@ String getStatusJson() {
 // ============================================================
 void forceLight(bool state) {
   // FIX v9.2: Do NOT force ON if user explicitly turned OFF
-  if (state && userForcedOff) {
+  bool was = relay.on();
+  if (!relay.force(state)) {
     Serial.println("[FAIL-SAFE] Skipped — user commanded OFF, respecting intent");
+    logEvent(EV_FAILSAFE, FS_REFUSED);
     return;
   }
-
-  if (!lightState && state) lightOnStart = millis();
-  if (lightState && !state && lightOnStart > 0) {
-    totalOnSeconds += (millis() - lightOnStart) / 1000;
-    saveOnTime(totalOnSeconds);
-    lightOnStart = 0;
-  }
-  lightState = state;
-  digitalWrite(LIGHT_PIN, state ? RELAY_ON : RELAY_OFF);
+  if (was != state) logEvent(EV_RELAY, state | EVS_FAILSAFE << 1);
   Serial.printf("[FORCE] Light %s (fail-safe)\n", state ? "ON" : "OFF");
 }
 
@@ -237,78 +1347,810 @@ void forceLight(bool state) {
 //  FIX v9.2: saves userForcedOff so power cycle knows intent
 // ============================================================
 void setLightState(bool state, bool saveToFlash) {
-  // FIX v9.2: always record what the user explicitly wants
-  userForcedOff = !state;
-
-  if (lightState == state) return;
-
-  if (lightState && !state && lightOnStart > 0) {
-    totalOnSeconds += (millis() - lightOnStart) / 1000;
-    saveOnTime(totalOnSeconds);
-    lightOnStart = 0;
-  }
-  if (!lightState && state) lightOnStart = millis();
-
-  lightState = state;
-
-  digitalWrite(LIGHT_PIN, state ? RELAY_ON : RELAY_OFF);
+  if (!relay.set(state, saveToFlash)) return;
   Serial.printf("[RELAY] %s  pin%d=%s\n",
                 state ? "ON" : "OFF",
                 LIGHT_PIN,
                 state ? "LOW" : "HIGH");
 
-  if (saveToFlash) saveLightState(state);
+  // Publishing belongs to the network task — just flag it
+  if (!apMode) reportPending.store(true);
+}
 
-  if (!apMode && mqtt.connected()) {
-    publishState();
-    publishTelemetry();
+// ============================================================
+//  COMMAND QUEUE — producers enqueue, control task applies
+// ============================================================
+bool queueCommand(SpscQueue<LightCmd, 16>& q, CmdType type, bool state,
+                  uint32_t seq, uint64_t originMs, int64_t rxUs, uint32_t deferUs) {
+  LightCmd cmd = { type, state, seq, originMs, rxUs ? rxUs : esp_timer_get_time(),
+                   &q == &webCmdQ ? EVS_LAN : EVS_NET, deferUs };
+  if (!q.push(cmd)) {
+    Serial.println("[CTRL] Command queue full — dropped");
+    return false;
+  }
+  if (ctrlTaskHandle) xTaskNotifyGive(ctrlTaskHandle);
+  return true;
+}
+
+void controlTask(void* arg) {
+  esp_task_wdt_add(NULL);
+  LightCmd cmd;
+  for (;;) {
+    esp_task_wdt_reset();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    while (netCmdQ.pop(cmd) || webCmdQ.pop(cmd) || timerCmdQ.pop(cmd)) {
+      if (cmd.type == CMD_FAILSAFE) { forceLight(true);         continue; }
+      if (cmd.type == CMD_FLUSH) {
+        persistFlush();
+        if (cmd.state && netTaskHandle) xTaskNotifyGive(netTaskHandle);   // controlledRestart() waits on it
+        continue;
+      }
+      if (cmd.type == CMD_SCHEDULE) { scheduleLight(cmd.state); continue; }
+
+      // a deferred group switch loses to anything applied after it arrived
+      if (!setOrder.admit(cmd.rxUs, cmd.deferUs != 0)) { spreadSuperseded++; continue; }
+
+      bool changed = relay.on() != cmd.state;
+      setLightState(cmd.state);
+      schedSetOwnsOff(false);            // a hand-given command takes over
+      if (changed) logEvent(EV_RELAY, cmd.state | cmd.src << 1);
+      int64_t  doneUs = changed ? relay.lastRelayUs() : esp_timer_get_time();
+      uint32_t devUs  = (uint32_t)(doneUs - cmd.rxUs) - cmd.deferUs;
+      cmdLatencyAdd(devUs);
+      if (cmd.seq) {
+        CmdAck ack = { cmd.seq, devUs, cmd.originMs, cmd.state, changed };
+        if (!ackQ.push(ack)) ackDropped++;
+      }
+    }
+    relay.tick();
   }
 }
 
 // ============================================================
 //  MQTT PUBLISH
 // ============================================================
+// Every JsonWriter payload goes through here: 0 = overflowed, dropped
+bool publishJson(const char* topic, const char* buf, size_t n, bool retain) {
+  if (!n) {
+    Serial.printf("[MQTT] %s: JSON overflow — not published\n", topic);
+    return false;
+  }
+  return mqtt.publish(topic, (const uint8_t*)buf, n, retain);
+}
+
 void publishState() {
-  if (!mqtt.connected()) return;
-  mqtt.publish(TOPIC_STATE, lightState ? "ON" : "OFF", true);
+  if (!mqtt.connected() || !provisioned) return;
+  cloudMqtt.publish(TOPIC_STATE, relay.on() ? "ON" : "OFF", true);
 }
 
 void publishTelemetry() {
   if (!mqtt.connected()) return;
-  StaticJsonDocument<300> doc;
-  doc["light_state"]  = lightState;
-  doc["row"]          = ROW_INDEX;
-  doc["light"]        = LIGHT_INDEX;
-  doc["on_seconds"]   = getOnSeconds();
-  doc["off_seconds"]  = getOffSeconds();
-  doc["kwh_used"]     = getKwh();
-  doc["rssi"]         = WiFi.RSSI();
-  doc["uptime_s"]     = (millis() - sessionStartMs) / 1000;
-  doc["wattage"]      = WATTAGE;
-  doc["voltage"]      = VOLTAGE;
-  doc["current_amps"] = WATTAGE / VOLTAGE;
-  doc["firmware"]     = FIRMWARE_VERSION;
-  char buf[300];
-  serializeJson(doc, buf);
-  mqtt.publish(TOPIC_TELE, buf);
+  StageTimer timer(ST_TELEMETRY);
+  lastTelemetryMs = millis();
+  lastTeleRssi    = WiFi.RSSI();
+  teleBeatSchedule(lastTelemetryMs);
+  if (TELE_FORMAT != TELE_FMT_CBOR) {
+    char   buf[STATUS_JSON_MAX];
+    size_t n = writeStatusJson(buf, sizeof(buf), VIEW_TELEMETRY);
+    if (publishJson(TOPIC_TELE, buf, n, false)) bootTimesSent = true;
+  }
+  if (TELE_FORMAT != TELE_FMT_JSON) {
+    uint8_t bin[CBOR_TELE_MAX];
+    size_t  n = writeStatusCbor(bin, sizeof(bin));
+    if (n) mqtt.publish(TOPIC_TELE_CBOR, bin, n, false);
+  }
+}
+
+// One JSON receipt per traced command (see writeAckJson)
+void publishAcks() {
+  CmdAck ack;
+  while (mqttOnline && ackQ.pop(ack)) {
+    char buf[128];
+    publishJson(TOPIC_ACK, buf, writeAckJson(buf, sizeof(buf), ack), false);
+  }
+}
+
+// Retained, once per connect — constants the samples no longer carry
+void publishInfo() {
+  if (!mqtt.connected()) return;
+  char   buf[STATUS_JSON_MAX];
+  size_t n = writeStatusJson(buf, sizeof(buf), VIEW_INFO);
+  publishJson(TOPIC_INFO, buf, n, true);
+}
+
+// ============================================================
+//  TELEMETRY POLICY — on-change + deadband + heartbeat
+// ============================================================
+// Heartbeats land on this device's phase of the heartbeat grid
+// rather than "heartbeat after the last publish", so lights that
+// reconnected together spread out within one period.
+void teleBeatSchedule(unsigned long from) {
+  teleNextBeatMs = devPhase.nextOnGrid(from, telePolicy.heartbeatMs, telePolicy.heartbeatMs / 2, PH_TELE);
+}
+
+bool telemetryDue() {
+  unsigned long now   = millis();
+  unsigned long since = now - lastTelemetryMs;
+  if ((long)(now - teleNextBeatMs) >= 0) return true;
+  if (since < telePolicy.minGapMs)     return false;
+
+  if (now - lastTeleSampleMs < TELE_SAMPLE_MS) return false;
+  lastTeleSampleMs = now;
+  int delta = (int)WiFi.RSSI() - lastTeleRssi;
+  return abs(delta) >= telePolicy.rssiDeadband;
+}
+
+// Payload: {"heartbeat_s":60,"min_gap_s":2,"rssi_deadband":6,
+//           "mem_min_free":20000,"mem_min_block":12000}
+// Missing keys keep their value. Publish it retained so the
+// device picks it up again on every connect.
+void applyDeviceConfig(byte* payload, unsigned int len) {
+  StaticJsonDocument<192> doc;
+  if (deserializeJson(doc, payload, len)) {
+    Serial.println("[CFG] Bad config JSON — ignored");
+    return;
+  }
+  memGuard.minFree  = doc["mem_min_free"]  | memGuard.minFree;
+  memGuard.minBlock = doc["mem_min_block"] | memGuard.minBlock;
+
+  uint32_t hb  = doc["heartbeat_s"]   | telePolicy.heartbeatMs / 1000;
+  uint32_t gap = doc["min_gap_s"]     | telePolicy.minGapMs / 1000;
+  uint32_t db  = doc["rssi_deadband"] | (uint32_t)telePolicy.rssiDeadband;
+
+  hb  = constrain(hb,  5, 3600);
+  gap = constrain(gap, 1, hb);
+  db  = constrain(db,  1, 40);
+  telePolicy.heartbeatMs  = hb * 1000;
+  telePolicy.minGapMs     = gap * 1000;
+  telePolicy.rssiDeadband = db;
+  teleBeatSchedule(lastTelemetryMs);
+  Serial.printf("[CFG] heartbeat=%lus gap=%lus deadband=%lddB mem_min_free=%lu mem_min_block=%lu\n",
+                (unsigned long)hb, (unsigned long)gap, (long)db,
+                (unsigned long)memGuard.minFree, (unsigned long)memGuard.minBlock);
+  publishInfo();
+}
+
+// ============================================================
+//  MEMORY HEALTH — heap / fragmentation / stack high-water marks
+// ============================================================
+void memGuardTick() {
+  unsigned long now = millis();
+  if (now - lastMemSampleMs < MEM_SAMPLE_MS) return;
+  lastMemSampleMs = now;
+
+  memStats.freeHeap = ESP.getFreeHeap();
+  memStats.maxBlock = ESP.getMaxAllocHeap();
+  memStats.minFree  = ESP.getMinFreeHeap();
+  TaskHandle_t tasks[3] = { netTaskHandle, ctrlTaskHandle, httpTaskHandle };
+  for (int i = 0; i < 3; i++)
+    memStats.stackHwm[i] = tasks[i] ? uxTaskGetStackHighWaterMark(tasks[i]) : 0;
+
+  bool low = (memGuard.minFree  && memStats.freeHeap < memGuard.minFree) ||
+             (memGuard.minBlock && memStats.maxBlock < memGuard.minBlock);
+  memStats.lowStreak = low ? memStats.lowStreak + 1 : 0;
+  if (low) {
+    Serial.printf("[MEM] Low heap: free=%lu block=%lu (%u/%u)\n",
+                  (unsigned long)memStats.freeHeap, (unsigned long)memStats.maxBlock,
+                  memStats.lowStreak, MEM_GUARD_STREAK);
+  }
+  // a download legitimately holds a second TLS session — don't
+  // restart in the middle of writing the inactive partition
+  if (memStats.lowStreak >= MEM_GUARD_STREAK && otaState != OTA_DOWNLOADING) {
+    rtcGuardRestart = GUARD_MAGIC;
+    controlledRestart("heap");
+  }
+}
+
+// Runs in the network task between stages, so no handshake or
+// publish is in flight. Light state and on-time are committed
+// first; the clean disconnect keeps the broker from firing LWT.
+void controlledRestart(const char* why) {
+  Serial.printf("[SYS] Controlled restart (%s)\n", why);
+  logEvent(EV_RESTART, 0);
+  evTick();                              // network task: the record is on flash before we go
+  ulTaskNotifyTake(pdTRUE, 0);           // drop any stale notification
+  if (queueCommand(netCmdQ, CMD_FLUSH, true) && !ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500)))
+    Serial.println("[SYS] Flush not confirmed in 500 ms — restarting anyway");
+
+  if (mqtt.connected()) {
+    publishState();
+    mqtt.disconnect();
+  }
+  ESP.restart();
+}
+
+// ============================================================
+//  STORE-AND-FORWARD BACKLOG
+//  Batch on .../telemetry/backlog (CBOR map):
+//    0: now uptime_s   1: boot of records   2: current boot
+//    3: dropped since last batch
+//    4: [[kind, uptime_s, state, on_s, rssi], ...]
+// ============================================================
+void initBacklog() {
+  tqPrefs.begin("tq", false);
+  bootNo     = tqPrefs.getUShort("boot", 0) + 1;
+  spillHead  = tqPrefs.getUChar("h", 0);
+  spillCount = tqPrefs.getUChar("c", 0);
+  if (spillHead >= TELE_SPILL_SLOTS || spillCount > TELE_SPILL_SLOTS) spillHead = spillCount = 0;
+  tqPrefs.putUShort("boot", bootNo);
+  nvsWrites++;
+  if (spillCount) Serial.printf("[TQ] %u spilled block(s) from earlier outage\n", spillCount);
+}
+
+void bufferRecord(TeleRecKind kind) {
+  lastTelemetryMs = millis();
+  teleBeatSchedule(lastTelemetryMs);
+  if (teleRing.full()) spillOldest();
+
+  TeleRecord r;
+  r.uptimeS   = (uint32_t)(uptimeMs() / 1000);
+  r.onSeconds = getOnSeconds();
+  r.rssi      = (wifiPhase == WIFI_PH_UP) ? WiFi.RSSI() : 0;
+  r.kind      = kind;
+  r.state     = relay.on();
+  r.pad       = 0;
+  teleRing.push(r);
+}
+
+void spillOldest() {
+  if (TELE_SPILL_SLOTS == 0) {           // ring push will overwrite
+    teleDropped++;
+    return;
+  }
+  if (spillCount == TELE_SPILL_SLOTS) {  // flash full too — lose oldest slot
+    char key[4];
+    snprintf(key, sizeof(key), "b%u", spillHead);
+    tqPrefs.remove(key);
+    if (drainLoaded) { drainLoaded = false; drainPos = 0; }
+    spillHead = (spillHead + 1) % TELE_SPILL_SLOTS;
+    spillCount--;
+    teleDropped += SPILL_BLOCK;
+  }
+
+  static SpillSlot out;                  // 772 B — keep off the task stack
+  out.boot = bootNo;
+  out.n    = SPILL_BLOCK;
+  for (uint16_t i = 0; i < SPILL_BLOCK; i++) out.recs[i] = teleRing.at(i);
+
+  uint8_t slot = (spillHead + spillCount) % TELE_SPILL_SLOTS;
+  char    key[4];
+  snprintf(key, sizeof(key), "b%u", slot);
+  tqPrefs.putBytes(key, &out, sizeof(out));
+  spillCount++;
+  tqPrefs.putUChar("h", spillHead);
+  tqPrefs.putUChar("c", spillCount);
+  nvsWrites += 3;
+  teleRing.drop(SPILL_BLOCK);
+}
+
+bool publishBacklog(const TeleRecord* recs, uint16_t n, uint16_t boot) {
+  uint8_t    bin[24 + DRAIN_BATCH * 20];
+  CborWriter c(bin, sizeof(bin));
+  c.map(5);
+  c.uint(0); c.uint((uint32_t)(uptimeMs() / 1000));
+  c.uint(1); c.uint(boot);
+  c.uint(2); c.uint(bootNo);
+  c.uint(3); c.uint(teleDropped);
+  c.uint(4); c.array(n);
+  for (uint16_t i = 0; i < n; i++) {
+    c.array(5);
+    c.uint(recs[i].kind);
+    c.uint(recs[i].uptimeS);
+    c.boolean(recs[i].state);
+    c.uint(recs[i].onSeconds);
+    c.sint(recs[i].rssi);
+  }
+  size_t len = c.length();
+  if (!len || !mqtt.publish(TOPIC_BACKLOG, bin, len, false)) return false;
+  teleDropped = 0;
+  return true;
+}
+
+// Oldest first: NVS slots, then the RAM ring. One batch per
+// DRAIN_INTERVAL_MS so the drain never hogs the TLS link or
+// delays mqtt.loop() command handling.
+void drainBacklog() {
+  if (millis() - lastDrainMs < DRAIN_INTERVAL_MS) return;
+  if (spillCount == 0 && teleRing.size() == 0) return;
+  lastDrainMs = millis();
+
+  if (spillCount) {
+    char key[4];
+    snprintf(key, sizeof(key), "b%u", spillHead);
+    if (!drainLoaded) {
+      drainLoaded = tqPrefs.getBytes(key, &drainSlot, sizeof(drainSlot)) == sizeof(drainSlot) &&
+                    drainSlot.n <= SPILL_BLOCK;
+      drainPos = 0;
+      if (!drainLoaded) drainSlot.n = 0;   // unreadable slot — skip it
+    }
+    uint16_t n = drainSlot.n - drainPos;
+    if (n > DRAIN_BATCH) n = DRAIN_BATCH;
+    if (n && !publishBacklog(&drainSlot.recs[drainPos], n, drainSlot.boot)) return;
+    drainPos += n;
+    if (drainPos >= drainSlot.n) {
+      tqPrefs.remove(key);
+      spillHead   = (spillHead + 1) % TELE_SPILL_SLOTS;
+      spillCount--;
+      drainLoaded = false;
+      tqPrefs.putUChar("h", spillHead);
+      tqPrefs.putUChar("c", spillCount);
+      nvsWrites += 3;
+    }
+    return;
+  }
+
+  TeleRecord batch[DRAIN_BATCH];
+  uint16_t   n = teleRing.size();
+  if (n > DRAIN_BATCH) n = DRAIN_BATCH;
+  for (uint16_t i = 0; i < n; i++) batch[i] = teleRing.at(i);
+  if (publishBacklog(batch, n, bootNo)) teleRing.drop(n);
+}
+
+// Live publish when connected, buffer when not — nothing is lost
+// to a broker outage.
+// A state change is reported once, REPORT_SETTLE_MS after the relay
+// moved (plus a per-light offset after an unspread group switch):
+// state + telemetry together, and the NVS commit pulled forward to
+// the same moment. Toggles inside the window merge into one report.
+void serviceTelemetry() {
+  if (apMode || !provisioned) return;    // no topics to report on yet
+  unsigned long now = millis();
+  if (reportPending.exchange(false) && !reportArmed) {
+    bool fanOut = groupAtMs && now - groupAtMs < 1000;   // this change came from it
+    reportArmed = true;
+    reportDueMs = now + REPORT_SETTLE_MS + (fanOut ? devPhase.offset(GROUP_REPORT_SPREAD_MS, PH_REPORT) : 0);
+    groupAtMs   = 0;
+  }
+  bool changed = reportArmed && (long)(now - reportDueMs) >= 0;
+  if (changed) {
+    reportArmed = false;
+    queueCommand(netCmdQ, CMD_FLUSH, false);
+  }
+  if (gwRole == GW_MEMBER || gwRole == GW_ELECT) {
+    if (changed) gwBeaconNow = true;     // the gateway publishes it for us
+    return;
+  }
+
+  if (mqttOnline) {
+    publishAcks();                       // before state: the ack is the faster path
+    if (changed) {
+      publishState();
+      publishTelemetry();
+    } else if (telemetryDue()) {
+      publishTelemetry();
+    }
+    drainBacklog();
+  } else if (changed) {
+    bufferRecord(REC_STATE);
+  } else if ((long)(now - teleNextBeatMs) >= 0) {
+    bufferRecord(REC_SAMPLE);
+  }
+}
+
+// ============================================================
+//  OTA — streaming HTTPS pull, SHA-256 verified, self-rollback
+//  otaRequest() (network task) parks the job and spawns otaTask,
+//  which waits for its fleet slot, then streams the image into the
+//  inactive partition while hashing it. Relay control and MQTT keep
+//  running throughout; only the network task publishes or restarts.
+// ============================================================
+bool parseSha256Hex(const char* hex, uint8_t* out) {
+  if (strlen(hex) != 64) return false;
+  for (int i = 0; i < 32; i++) {
+    char pair[3] = { hex[2 * i], hex[2 * i + 1], 0 };
+    if (!isxdigit((unsigned char)pair[0]) || !isxdigit((unsigned char)pair[1])) return false;
+    out[i] = (uint8_t)strtoul(pair, NULL, 16);
+  }
+  return true;
+}
+
+void otaSetState(OtaState s) {
+  otaState  = s;
+  otaReport = true;
+}
+
+void otaFail(const char* why) {
+  otaError = why;
+  Serial.printf("[OTA] Failed: %s\n", why);
+  otaSetState(OTA_FAILED);
+}
+
+// Payload: {"url":"https://…/fw.bin","version":"v9.3","sha256":"<64 hex>",
+//           "stagger_s":10}
+// Row/all topics start each light in its own slot, stagger_s apart.
+void otaRequest(byte* payload, unsigned int len, CmdTopic via) {
+  if (otaState == OTA_WAITING || otaState == OTA_DOWNLOADING ||
+      otaState == OTA_READY   || otaState == OTA_TRIAL) {
+    Serial.println("[OTA] Busy — request ignored");
+    return;
+  }
+  StaticJsonDocument<384> doc;
+  if (deserializeJson(doc, payload, len)) {
+    Serial.println("[OTA] Bad JSON — ignored");
+    return;
+  }
+  const char* url     = doc["url"]       | "";
+  const char* version = doc["version"]   | "";
+  const char* sha     = doc["sha256"]    | "";
+  uint32_t    stagger = doc["stagger_s"] | OTA_STAGGER_S;
+
+  if (strcmp(version, FIRMWARE_VERSION) == 0) return;   // retained request, already applied
+  if (strcmp(version, otaBadVersion) == 0) {
+    Serial.printf("[OTA] %s was rolled back before — ignored\n", version);
+    return;
+  }
+  if (!*version || strlen(version) >= sizeof(otaJob.version) || strpbrk(version, "\"\\") ||
+      strncmp(url, "https://", 8) != 0 || strlen(url) >= sizeof(otaJob.url) ||
+      !parseSha256Hex(sha, otaJob.sha256)) {
+    Serial.println("[OTA] Need https url, version and sha256 — ignored");
+    return;
+  }
+  strcpy(otaJob.url, url);
+  strcpy(otaJob.version, version);
+
+  uint32_t slot = via == CT_OTA_ALL ? fleetSlot()
+                : via == CT_OTA_ROW ? lightIndex
+                : 0;
+  otaJob.startAtMs = millis() + slot * stagger * 1000UL;
+  otaPct   = 0;
+  otaError = "";
+  otaSetState(OTA_WAITING);
+  Serial.printf("[OTA] %s → %s in %lus (slot %lu)\n", FIRMWARE_VERSION, version,
+                (unsigned long)(slot * stagger), (unsigned long)slot);
+
+  if (xTaskCreatePinnedToCore(otaTask, "ota", OTA_STACK, NULL,
+                              OTA_PRIO, &otaTaskHandle, NET_CORE) != pdPASS)
+    otaFail("no memory for OTA task");
+}
+
+void otaTask(void* arg) {
+  while ((long)(millis() - otaJob.startAtMs) < 0) vTaskDelay(pdMS_TO_TICKS(500));
+
+  esp_task_wdt_add(NULL);
+  otaSetState(OTA_DOWNLOADING);
+  const char* err = otaDownload();
+  esp_task_wdt_delete(NULL);
+
+  if (err) otaFail(err);
+  else     otaSetState(OTA_READY);     // network task arms the trial and restarts
+  otaTaskHandle = NULL;
+  vTaskDelete(NULL);
+}
+
+// Returns NULL on success. Nothing is buffered beyond one chunk;
+// the boot partition only switches once the hash matches.
+const char* otaDownload() {
+  WiFiClientSecure tls;
+  tls.setCACert(OTA_CA_PEM);
+  tls.setHandshakeTimeout(15);         // seconds
+  HTTPClient http;
+  http.setTimeout(OTA_STALL_MS);
+  if (!http.begin(tls, otaJob.url)) return "bad url";
+
+  int code = http.GET();
+  if (code != HTTP_CODE_OK) {
+    Serial.printf("[OTA] HTTP %d\n", code);
+    http.end();
+    return "http error";
+  }
+  int total = http.getSize();
+  if (total <= 0) { http.end(); return "no content-length"; }
+  if (!Update.begin(total))       { http.end(); return Update.errorString(); }
+  Serial.printf("[OTA] Streaming %d bytes\n", total);
+
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+
+  uint8_t       buf[OTA_CHUNK];
+  WiFiClient*   in     = http.getStreamPtr();
+  size_t        got    = 0;
+  unsigned long lastRx = millis();
+  const char*   err    = NULL;
+  while (!err && got < (size_t)total) {
+    esp_task_wdt_reset();
+    int avail = in->available();
+    if (avail <= 0) {
+      if (!http.connected())                 err = "connection lost";
+      else if (millis() - lastRx > OTA_STALL_MS) err = "stalled";
+      else vTaskDelay(pdMS_TO_TICKS(5));
+      continue;
+    }
+    size_t want = min((size_t)avail, min(OTA_CHUNK, (size_t)total - got));
+    int    n    = in->read(buf, want);
+    if (n <= 0) continue;
+    mbedtls_sha256_update_ret(&sha, buf, n);
+    if (Update.write(buf, n) != (size_t)n) err = Update.errorString();
+    got   += n;
+    lastRx = millis();
+
+    uint8_t pct = (uint8_t)((uint64_t)got * 100 / total);
+    if (pct / 10 != otaPct / 10) otaReport = true;   // status every 10 %
+    otaPct = pct;
+    vTaskDelay(1);                      // let the network task keep MQTT alive
+  }
+
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  http.end();
+
+  if (!err && memcmp(digest, otaJob.sha256, sizeof(digest)) != 0) err = "sha256 mismatch";
+  if (err) {
+    Update.abort();
+    return err;
+  }
+  if (!Update.end()) return Update.errorString();
+  return NULL;
+}
+
+// Network task: status publishing, restart into the new image,
+// trial timeout for an image that never reaches the broker.
+void otaTick() {
+  if (mqttOnline && otaReport.exchange(false)) publishOtaStatus();
+
+  if (otaState == OTA_READY) {
+    Preferences p;
+    p.begin("ota", false);
+    p.putUChar("trial", 1);             // first boot of the new image is trial 1
+    p.end();
+    nvsWrites++;
+    publishOtaStatus();
+    controlledRestart("ota");
+  } else if (otaState == OTA_TRIAL && millis() > OTA_TRIAL_MS) {
+    otaRollback("no MQTT connect");
+  }
+}
+
+// Called from setup() before the tasks start. "trial" counts boots
+// of an unconfirmed image; a crash loop rolls back like a timeout.
+void otaBootCheck() {
+  Preferences p;
+  p.begin("ota", false);
+  strlcpy(otaBadVersion, p.getString("bad", "").c_str(), sizeof(otaBadVersion));
+  uint8_t boots = p.getUChar("trial", 0);
+  if (boots && boots <= OTA_TRIAL_BOOTS) {
+    p.putUChar("trial", boots + 1);
+    nvsWrites++;
+    otaState = OTA_TRIAL;
+    Serial.printf("[OTA] Trial boot %u/%u of %s\n", boots, OTA_TRIAL_BOOTS, FIRMWARE_VERSION);
+  }
+  p.end();
+  if (boots > OTA_TRIAL_BOOTS) otaRollback("boot loop");
+}
+
+// First successful MQTT connect of a trial image
+void otaConfirm() {
+  if (otaState != OTA_TRIAL) return;
+  Preferences p;
+  p.begin("ota", false);
+  p.putUChar("trial", 0);
+  p.end();
+  nvsWrites++;
+  esp_ota_mark_app_valid_cancel_rollback();   // only matters if the bootloader tracks it
+  Serial.printf("[OTA] %s confirmed\n", FIRMWARE_VERSION);
+  otaSetState(OTA_IDLE);
+}
+
+void otaRollback(const char* why) {
+  Serial.printf("[OTA] %s failed trial (%s)\n", FIRMWARE_VERSION, why);
+  Preferences p;
+  p.begin("ota", false);
+  p.putUChar("trial", 0);
+  p.putString("bad", FIRMWARE_VERSION);
+  p.end();
+  nvsWrites += 2;
+  if (!Update.rollBack()) {
+    Serial.println("[OTA] No bootable previous image — staying on this one");
+    otaSetState(OTA_IDLE);
+    return;
+  }
+  if (netTaskHandle) controlledRestart("ota-rollback");
+  ESP.restart();                        // from setup(): nothing to flush yet
+}
+
+void publishOtaStatus() {
+  if (!mqtt.connected() || !provisioned) return;
+  char       buf[192];
+  JsonWriter w(buf, sizeof(buf));
+  w.addStr ("state",   OTA_STATE_NAMES[otaState]);
+  w.addStr ("running", FIRMWARE_VERSION);
+  w.addStr ("target",  otaJob.version);
+  w.addUInt("pct",     otaPct);
+  w.addStr ("error",   otaError);
+  size_t n = w.finish();
+  publishJson(TOPIC_OTA_STATUS, buf, n, true);
 }
 
 // ============================================================
 //  MQTT CALLBACK
+//  Zero-heap: topic → enum via precomputed length/hash, payload
+//  parsed in place from PubSubClient's buffer.
 // ============================================================
-void mqttCallback(char* topic, byte* payload, unsigned int len) {
-  String topicStr = String(topic);
-  String msg = "";
-  for (unsigned int i = 0; i < len; i++) msg += (char)payload[i];
-  msg.trim();
+uint32_t fnv1a32(const char* s, size_t n) {
+  uint32_t h = 2166136261u;
+  while (n--) { h ^= (uint8_t)*s++; h *= 16777619u; }
+  return h;
+}
 
-  bool desired = (msg == "ON" || msg == "on" || msg == "1" || msg == "true");
-  Serial.printf("[MQTT RX] %s → %s\n", topic, desired ? "ON" : "OFF");
+CmdTopic matchCmdTopic(const char* topic) {
+  size_t   n = strlen(topic);
+  uint32_t h = fnv1a32(topic, n);
+  for (const TopicKey& k : cmdTopics) {
+    if (k.len == n && k.hash == h && memcmp(k.str, topic, n) == 0) return k.id;
+  }
+  return CT_NONE;
+}
 
-  if (topicStr == String(TOPIC_CMD_SINGLE) ||
-      topicStr == String(TOPIC_CMD_ROW)    ||
-      topicStr == String(TOPIC_CMD_ALL)) {
-    setLightState(desired);
+// Scene — one publish sets any subset of the grid, every light
+// decodes only its own bit, so the whole floor switches together.
+//   [0]     flags   bit0 = care mask follows
+//   [1..2]  seq     big-endian, 0 = none; a repeat of the last seq is
+//                   a QoS 1 redelivery and is dropped
+//   [3..]   state   N = ceil(lights / 8) bytes, bit i = slot i, LSB first
+//   [..]    care    optional N bytes; 0 bit = leave that light alone
+// Lights whose slot lies past the mask are untouched.
+const uint8_t SCENE_HDR       = 3;
+const uint8_t SCENE_FLAG_CARE = 0x01;
+uint16_t      lastSceneSeq    = 0;
+
+void applyScene(const byte* p, unsigned int len, int64_t rxUs) {
+  if (len < SCENE_HDR + 1) {
+    Serial.println("[SCENE] Too short — ignored");
+    return;
+  }
+  bool         care = p[0] & SCENE_FLAG_CARE;
+  uint16_t     seq  = ((uint16_t)p[1] << 8) | p[2];
+  unsigned int n    = care ? (len - SCENE_HDR) / 2 : len - SCENE_HDR;
+  if (care && (len - SCENE_HDR) % 2) {
+    Serial.println("[SCENE] Odd state/care length — ignored");
+    return;
+  }
+  if (seq && seq == lastSceneSeq) return;
+  lastSceneSeq = seq;
+
+  uint16_t slot = fleetSlot();
+  uint8_t  bit  = 1 << (slot % 8);
+  if (slot / 8 >= n) return;
+  if (care && !(p[SCENE_HDR + n + slot / 8] & bit)) return;
+
+  bool desired = p[SCENE_HDR + slot / 8] & bit;
+  Serial.printf("[SCENE] seq %u → %s\n", seq, desired ? "ON" : "OFF");
+  queueCommand(netCmdQ, CMD_SET, desired, seq, 0, rxUs);
+}
+
+// Desired state — server.js keeps one retained {"v","state"} per light,
+// v = its clock in ms, bumped with every command it sends. A v at or
+// below the last one applied was already acted on (or superseded by a
+// LAN/mesh/schedule change since), so only a newer one moves the relay.
+// The version is saved in the flush that saves the relay state, so a
+// power cut loses both or neither: a replay after reboot can't undo a
+// local change that made it to NVS.
+void applyDesired(const byte* payload, unsigned int len, int64_t rxUs) {
+  StaticJsonDocument<96> doc;
+  if (!len) return;                      // retained desired cleared
+  if (deserializeJson(doc, payload, len)) {
+    Serial.println("[DESIRED] Bad JSON — ignored");
+    return;
+  }
+  uint64_t v = doc["v"] | (uint64_t)0;
+  JsonVariant s = doc["state"];
+  bool desired;
+  if      (s.is<bool>())        desired = s.as<bool>();
+  else if (s.is<const char*>()) desired = parseOnOff((const uint8_t*)s.as<const char*>(), strlen(s.as<const char*>()));
+  else return;
+  if (v <= relay.desiredVersion()) return;
+  if (restartPending) return;            // retained: replayed after the restart
+
+  relay.setDesiredVersion(v);            // flushed with the relay state it leads to
+  if (desired != relay.on()) {
+    Serial.printf("[DESIRED] v%llu → %s (resync)\n", (unsigned long long)v, desired ? "ON" : "OFF");
+    desiredResyncs++;
+  }
+  // server.js updates desired right after a group command; a spread
+  // switch to the same state is already on its way — don't jump it
+  if (spreadPending(desired)) return;
+  queueCommand(netCmdQ, CMD_SET, desired, 0, 0, rxUs);
+}
+
+// ============================================================
+//  GROUP SWITCHING — row/all commands, optionally spread
+//    aipl/row/R/command  {"state":"ON","spread_ms":3000}
+//  Light i of the row switches at i/6 of the window (aipl/all:
+//  fleet slot / 36), so 36 relays never close together. One
+//  esp_timer holds the pending switch: a newer group command
+//  replaces it, any other command applied meanwhile cancels it.
+// ============================================================
+// esp_timer task — same producer as the schedule
+void spreadTimerCb(void* arg) {
+  spreadLock.lock();
+  LightCmd c = spreadCmd;
+  spreadLock.unlock();
+  queueCommand(timerCmdQ, CMD_SET, c.state, c.seq, c.originMs, c.rxUs, c.deferUs);
+}
+
+uint32_t spreadOffsetMs(uint32_t spreadMs, bool fleet) {
+  uint16_t slots = fleet ? GRID_ROWS * LIGHTS_PER_ROW : LIGHTS_PER_ROW;
+  uint16_t i     = !provisioned ? 0xFFFF : fleet ? fleetSlot() : lightIndex;
+  return devPhase.spreadOffset(spreadMs, i, slots);
+}
+
+bool spreadPending(bool state) {
+  return spreadDueUs && esp_timer_get_time() < spreadDueUs && spreadState == state;
+}
+
+// Network task (MQTT callback, mesh)
+void groupCommand(bool state, uint32_t spreadMs, bool fleet, uint32_t seq, uint64_t originMs, int64_t rxUs) {
+  if (spreadMs > SPREAD_MAX_MS) spreadMs = SPREAD_MAX_MS;
+  uint32_t offMs = spreadMs ? spreadOffsetMs(spreadMs, fleet) : 0;
+  if (!spreadTimer) {
+    esp_timer_create_args_t args = {};
+    args.callback = spreadTimerCb;
+    args.name     = "spread";
+    esp_timer_create(&args, &spreadTimer);
+  }
+  esp_timer_stop(spreadTimer);           // the newest group command wins
+  spreadDueUs = 0;
+  if (!offMs) {
+    if (!spreadMs) groupAtMs = millis() | 1;   // no window: at least spread the reports
+    queueCommand(netCmdQ, CMD_SET, state, seq, originMs, rxUs);
+    return;
+  }
+  spreadLock.lock();
+  spreadCmd = { CMD_SET, state, seq, originMs, rxUs, EVS_NET, offMs * 1000 };
+  spreadLock.unlock();
+  spreadState = state;
+  spreadDueUs = esp_timer_get_time() + (int64_t)offMs * 1000;
+  spreadDeferred++;
+  esp_timer_start_once(spreadTimer, (uint64_t)offMs * 1000);
+  Serial.printf("[GROUP] %s in %lu ms (spread %lu ms)\n", state ? "ON" : "OFF",
+                (unsigned long)offMs, (unsigned long)spreadMs);
+}
+
+void mqttCallback(char* topic, byte* payload, unsigned int len) {
+  int64_t  rxUs  = esp_timer_get_time();
+  CmdTopic which = matchCmdTopic(topic);
+  if (which == CT_CONFIG)    { applyDeviceConfig(payload, len); return; }
+  if (which == CT_PROVISION) { applyProvisioning(payload, len); return; }
+  if (which == CT_OTA || which == CT_OTA_ROW || which == CT_OTA_ALL) {
+    otaRequest(payload, len, which);
+    return;
+  }
+  if (which == CT_GATEWAY)   { gwApplyConfig(payload, len); return; }
+  if (which == CT_SCHEDULE)  { schedApply(payload, len); return; }
+  if (which == CT_DESIRED)   { applyDesired(payload, len, rxUs); return; }
+  if (which == CT_SCENE) {
+    applyScene(payload, len, rxUs);
+    gwRelay(MK_SCENE, 0, false, payload, len);
+    return;
+  }
+
+  bool     desired;
+  uint32_t seq;
+  uint64_t originMs;
+  uint32_t spreadMs;
+  if (!parseCommand(payload, len, desired, seq, originMs, &spreadMs)) {
+    Serial.printf("[MQTT RX] %s → bad command JSON — ignored\n", topic);
+    return;
+  }
+  Serial.printf("[MQTT RX] %s → %s", topic, desired ? "ON" : "OFF");
+  if (seq) Serial.printf("  seq %lu", (unsigned long)seq);
+  if (spreadMs) Serial.printf("  spread %lu ms", (unsigned long)spreadMs);
+  Serial.println();
+
+  uint8_t member;
+  if (which == CT_NONE && gwMemberTopic(topic, member)) {
+    gwRelay(MK_LIGHT, member, desired, NULL, 0);
+    return;
+  }
+  bool group = which == CT_ROW || which == CT_ALL;
+  if (group)                 groupCommand(desired, spreadMs, which == CT_ALL, seq, originMs, rxUs);
+  else if (which != CT_NONE) queueCommand(netCmdQ, CMD_SET, desired, seq, originMs, rxUs);
+  // aipl/all only reaches the row gateways — each re-scopes it to its row,
+  // keeping the fleet-wide offsets
+  if (group) {
+    MeshSpread sp = { (uint16_t)(std::min<uint32_t>(spreadMs, SPREAD_MAX_MS) / 10), which == CT_ALL };
+    gwRelay(MK_ROW, 0, desired, (const byte*)&sp, spreadMs ? sizeof(sp) : 0);
   }
 }
 
@@ -317,186 +2159,1444 @@ void mqttCallback(char* topic, byte* payload, unsigned int len) {
 //  FIX v9.2: fail-safe only triggers if user did NOT force OFF
 // ============================================================
 void mqttReconnect() {
-  if (mqtt.connected() || apMode) return;
-  static unsigned long lastTry = 0;
-  if (millis() - lastTry < 5000) return;
-  lastTry = millis();
+  if (mqtt.connected() || apMode || !gwCloudAllowed()) return;
+  // First attempt after boot or a drop waits for this device's phase of
+  // the retry window — a fleet that lost the broker together comes back
+  // spread out, not as one burst. Failures then back off per class.
+  unsigned long now = millis();
+  if (!mqttLink.phased) {
+    mqttLink.nextTryMs = now + devPhase.offset(MQTT_RETRY_MS, PH_MQTT);
+    mqttLink.phased    = true;
+  }
+  if ((long)(now - mqttLink.nextTryMs) < 0) return;
+  mqttLink.attempts++;
+  StageTimer timer(ST_MQTT_RECONNECT);   // real attempts only, not throttled calls
 
   // FIX v9.2: respect user OFF intent during MQTT outage
-  if (!lightState && !userForcedOff) {
+  if (!relay.on() && !relay.userForcedOff()) {
     Serial.println("[FAIL-SAFE] MQTT down → forcing light ON");
-    forceLight(true);
+    logEvent(EV_FAILSAFE, FS_MQTT);
+    queueCommand(netCmdQ, CMD_FAILSAFE, true);
   }
 
   char clientId[40];
-  snprintf(clientId, sizeof(clientId), "aipl-r%d-l%d-%04X",
-           ROW_INDEX, LIGHT_INDEX, (uint16_t)(ESP.getEfuseMac() & 0xFFFF));
+  if (provisioned)
+    snprintf(clientId, sizeof(clientId), "aipl-r%u-l%u-%04X",
+             rowIndex, lightIndex, (uint16_t)(ESP.getEfuseMac() & 0xFFFF));
+  else
+    snprintf(clientId, sizeof(clientId), "aipl-new-%s", macHex);
 
   Serial.printf("[MQTT] Connecting as %s ...", clientId);
 
-  if (mqtt.connect(clientId,
-                   HIVEMQ_USERNAME, HIVEMQ_PASSWORD,
-                   TOPIC_STATE, 1, true, "ON")) {
-    Serial.println(" OK");
-    mqtt.subscribe(TOPIC_CMD_SINGLE, 1);
+  bool ok = provisioned
+    ? mqtt.connect(clientId, HIVEMQ_USERNAME, HIVEMQ_PASSWORD, TOPIC_STATE, 1, true, "ON",
+                   false)   // persistent session: QoS 1 commands queue while we're away
+    : mqtt.connect(clientId, HIVEMQ_USERNAME, HIVEMQ_PASSWORD);
+  if (ok) {
+    Serial.printf(" OK  tls=%lums %s\n", (unsigned long)tlsClient.lastHandshakeMs(),
+                  tlsClient.lastResumed() ? "(resumed)" : "(full)");
+    logEvent(EV_MQTT_UP, (uint16_t)std::min<uint32_t>(tlsClient.lastHandshakeMs(), 0xFFFF));
+    if (!bootTimes.mqttMs) bootTimes.mqttMs = sinceResetMs();
+    mqttLink.streak    = 0;              // success resets the backoff
+    mqttLink.backoffMs = 0;
+    mqttLink.phased    = false;          // the next drop is phased again
+    mqtt.subscribe(TOPIC_PROVISION, 1);
+    char ann[96];
+    snprintf(ann, sizeof(ann), "{\"mac\":\"%s\",\"row\":%d,\"light\":%d,\"firmware\":\"%s\"}",
+             macHex, provisioned ? rowIndex : -1, provisioned ? lightIndex : -1, FIRMWARE_VERSION);
+    mqtt.publish(TOPIC_ANNOUNCE, ann);
+    otaConfirm();
+    if (!provisioned) {
+      Serial.printf("[MQTT] Unprovisioned — waiting on %s\n", TOPIC_PROVISION);
+      return;
+    }
+    // the gateway's wildcard already covers its own command topic; the
+    // session outlives a role change, so drop whichever one we don't want
+    mqtt.unsubscribe(gwRole == GW_GATEWAY ? TOPIC_CMD_SINGLE : TOPIC_GW_LIGHTS);
+    mqtt.subscribe(gwRole == GW_GATEWAY ? TOPIC_GW_LIGHTS : TOPIC_CMD_SINGLE, 1);
     mqtt.subscribe(TOPIC_CMD_ROW,    1);
     mqtt.subscribe(TOPIC_CMD_ALL,    1);
+    mqtt.subscribe(TOPIC_CONFIG,     1);
+    mqtt.subscribe(TOPIC_OTA,        1);
+    mqtt.subscribe(TOPIC_OTA_ROW,    1);
+    mqtt.subscribe(TOPIC_OTA_ALL,    1);
+    mqtt.subscribe(TOPIC_SCENE,      1);
+    mqtt.subscribe(TOPIC_GW_CFG,     1);
+    mqtt.subscribe(TOPIC_SCHEDULE,   1);
+    mqtt.subscribe(TOPIC_DESIRED,    1);   // retained → arrives now, resyncs in one message
     Serial.println("[MQTT] Subscribed");
+    gwOnConnect();
+    publishInfo();
+    meshReconcile();
     publishState();
     publishTelemetry();
   } else {
-    Serial.printf(" FAIL rc=%d\n", mqtt.state());
+    mqttBackoff(now);
+  }
+}
+
+// PubSubClient rc (+ WiFi / TLS detail for rc -2) → failure class
+MqttFail mqttClassify(int rc) {
+  if (WiFi.status() != WL_CONNECTED) return MF_NETWORK;
+  switch (rc) {
+    case 1: case 2: case 4: case 5: return MF_AUTH;     // protocol, client id, credentials
+    case 3:                         return MF_BROKER;   // server unavailable
+    case -2:                                            // TCP or TLS never came up
+      return (tlsClient.lastError() && tlsClient.lastError() != MBEDTLS_ERR_SSL_TIMEOUT)
+             ? MF_TLS : MF_NETWORK;
+    default:                        return MF_NETWORK;  // timeout, lost, disconnected
   }
 }
 
+// delay = base · 2^(streak−1), capped, then 75–125 % by this device's jitter
+void mqttBackoff(unsigned long now) {
+  int      rc  = mqtt.state();
+  MqttFail cls = mqttClassify(rc);
+  mqttLink.failures++;
+  mqttLink.streak  = cls == mqttLink.lastClass ? mqttLink.streak + 1 : 1;
+  mqttLink.lastRc    = (int8_t)rc;
+  mqttLink.lastClass = cls;
+  logEvent(EV_MQTT_FAIL, (uint16_t)(cls << 8 | (uint8_t)rc));
+
+  const MqttBackoffClass& b = MQTT_BACKOFF[cls];
+  uint8_t  shift = mqttLink.streak - 1 < 16 ? mqttLink.streak - 1 : 16;
+  uint64_t d     = (uint64_t)b.baseMs << shift;
+  if (d > b.capMs) d = b.capMs;
+  mqttLink.backoffMs = (uint32_t)(d * 3 / 4) + devPhase.jitter((uint32_t)d / 2, PH_MQTT, mqttLink.attempts);
+  mqttLink.nextTryMs = now + mqttLink.backoffMs;
+  Serial.printf(" FAIL rc=%d (%s) tls=-0x%04X — retry in %lus\n", rc, MQTT_FAIL_NAMES[cls],
+                (unsigned)-tlsClient.lastError(), (unsigned long)(mqttLink.backoffMs / 1000));
+}
+
+// ============================================================
+//  IDENTITY + TOPIC TABLE
+// ============================================================
+void loadIdentity() {
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(macHex, sizeof(macHex), "%04X%08lX",
+           (uint16_t)(mac >> 32), (unsigned long)(uint32_t)mac);
+
+  Preferences id;
+  id.begin("id", true);
+  rowIndex   = id.getUChar("r", NO_INDEX);
+  lightIndex = id.getUChar("l", NO_INDEX);
+  id.end();
+
+  if ((rowIndex == NO_INDEX || lightIndex == NO_INDEX) && DEFAULT_ROW > 0 && DEFAULT_LIGHT > 0) {
+    rowIndex   = DEFAULT_ROW - 1;
+    lightIndex = DEFAULT_LIGHT - 1;
+    saveIdentity(rowIndex, lightIndex);
+    Serial.println("[ID] Seeded from build flags");
+  }
+  provisioned = rowIndex != NO_INDEX && lightIndex != NO_INDEX;
+}
+
+uint16_t fleetSlot() {
+  return (uint16_t)rowIndex * LIGHTS_PER_ROW + lightIndex;
+}
+
+void saveIdentity(uint8_t row, uint8_t light) {
+  Preferences id;
+  id.begin("id", false);
+  id.putUChar("r", row);
+  id.putUChar("l", light);
+  id.end();
+  Preferences ds;                        // pre-LightCore home of the version
+  ds.begin("ds", false);
+  ds.clear();
+  ds.end();
+  relay.setDesiredVersion(0);            // versions belong to the old light's topic
+  nvsWrites += 3;
+}
+
+// printf into the topic arena; strings live for the whole uptime
+const char* arenaTopic(const char* fmt, ...) {
+  char*  dst  = topicArena + topicArenaUsed;
+  size_t room = TOPIC_ARENA_SIZE - topicArenaUsed;
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(dst, room, fmt, ap);
+  va_end(ap);
+  if (n < 0 || (size_t)n >= room) {
+    Serial.println("[MQTT] Topic arena full — raise TOPIC_ARENA_SIZE");
+    return "";
+  }
+  topicArenaUsed += n + 1;
+  return dst;
+}
+
+// Payload: {"row":2,"light":5} (0-based). Stored, then a clean
+// restart rebuilds the topic table under the new identity — deferred
+// to the network loop, never from inside the MQTT callback.
+void applyProvisioning(byte* payload, unsigned int len) {
+  StaticJsonDocument<64> doc;
+  if (deserializeJson(doc, payload, len)) {
+    Serial.println("[ID] Bad provisioning JSON — ignored");
+    return;
+  }
+  int row   = doc["row"]   | -1;
+  int light = doc["light"] | -1;
+  if (row < 0 || row >= NO_INDEX || light < 0 || light >= NO_INDEX) {
+    Serial.println("[ID] row/light out of range — ignored");
+    return;
+  }
+  if (provisioned && row == rowIndex && light == lightIndex) return;   // retained echo
+  if (restartPending) return;            // already stored, restart on its way
+
+  Serial.printf("[ID] Provisioned as Row %d Light %d\n", row + 1, light + 1);
+  saveIdentity(row, light);
+  requestRestart("provisioned", 500);
+}
+
 void setupMQTT() {
-  snprintf(TOPIC_CMD_SINGLE, sizeof(TOPIC_CMD_SINGLE),
-           "aipl/row/%d/light/%d/command", ROW_INDEX, LIGHT_INDEX);
-  snprintf(TOPIC_CMD_ROW,    sizeof(TOPIC_CMD_ROW),
-           "aipl/row/%d/command", ROW_INDEX);
-  snprintf(TOPIC_STATE,      sizeof(TOPIC_STATE),
-           "aipl/row/%d/light/%d/state", ROW_INDEX, LIGHT_INDEX);
-  snprintf(TOPIC_TELE,       sizeof(TOPIC_TELE),
-           "aipl/row/%d/light/%d/telemetry", ROW_INDEX, LIGHT_INDEX);
+  TOPIC_PROVISION = arenaTopic("aipl/provision/%s", macHex);
+  if (provisioned) {
+    TOPIC_CMD_SINGLE = arenaTopic("aipl/row/%u/light/%u/command",           rowIndex, lightIndex);
+    TOPIC_CMD_ROW    = arenaTopic("aipl/row/%u/command",                    rowIndex);
+    TOPIC_STATE      = arenaTopic("aipl/row/%u/light/%u/state",             rowIndex, lightIndex);
+    TOPIC_TELE       = arenaTopic("aipl/row/%u/light/%u/telemetry",         rowIndex, lightIndex);
+    TOPIC_TELE_CBOR  = arenaTopic("aipl/row/%u/light/%u/telemetry/cbor",    rowIndex, lightIndex);
+    TOPIC_INFO       = arenaTopic("aipl/row/%u/light/%u/info",              rowIndex, lightIndex);
+    TOPIC_CONFIG     = arenaTopic("aipl/row/%u/light/%u/config",            rowIndex, lightIndex);
+    TOPIC_BACKLOG    = arenaTopic("aipl/row/%u/light/%u/telemetry/backlog", rowIndex, lightIndex);
+    TOPIC_OTA        = arenaTopic("aipl/row/%u/light/%u/ota",               rowIndex, lightIndex);
+    TOPIC_OTA_ROW    = arenaTopic("aipl/row/%u/ota",                        rowIndex);
+    TOPIC_OTA_STATUS = arenaTopic("aipl/row/%u/light/%u/ota/status",        rowIndex, lightIndex);
+    TOPIC_ACK        = arenaTopic("aipl/row/%u/light/%u/ack",               rowIndex, lightIndex);
+    TOPIC_MESH       = arenaTopic("aipl/row/%u/light/%u/mesh",              rowIndex, lightIndex);
+    TOPIC_GW_CFG     = arenaTopic("aipl/row/%u/gateway",                    rowIndex);
+    TOPIC_GW_LIGHTS  = arenaTopic("aipl/row/%u/light/+/command",            rowIndex);
+    TOPIC_GW_BATCH   = arenaTopic("aipl/row/%u/telemetry/batch",            rowIndex);
+    TOPIC_DESIRED    = arenaTopic("aipl/row/%u/light/%u/desired",           rowIndex, lightIndex);
+  }
+
+  const char*    strs[NUM_CMD_TOPICS] = { TOPIC_CMD_SINGLE, TOPIC_CMD_ROW, TOPIC_CMD_ALL, TOPIC_CONFIG,
+                                          TOPIC_PROVISION, TOPIC_OTA, TOPIC_OTA_ROW, TOPIC_OTA_ALL,
+                                          TOPIC_SCENE, TOPIC_GW_CFG, TOPIC_SCHEDULE, TOPIC_DESIRED };
+  const CmdTopic ids[NUM_CMD_TOPICS]  = { CT_SINGLE, CT_ROW, CT_ALL, CT_CONFIG,
+                                          CT_PROVISION, CT_OTA, CT_OTA_ROW, CT_OTA_ALL,
+                                          CT_SCENE, CT_GATEWAY, CT_SCHEDULE, CT_DESIRED };
+  for (int i = 0; i < NUM_CMD_TOPICS; i++) {
+    cmdTopics[i].str  = strs[i];
+    cmdTopics[i].len  = strlen(strs[i]);
+    cmdTopics[i].hash = fnv1a32(strs[i], cmdTopics[i].len);
+    cmdTopics[i].id   = (provisioned || ids[i] == CT_PROVISION) ? ids[i] : CT_NONE;
+  }
 
   Serial.println("[MQTT] Topics:");
   Serial.printf("  CMD single : %s\n", TOPIC_CMD_SINGLE);
   Serial.printf("  CMD row    : %s\n", TOPIC_CMD_ROW);
   Serial.printf("  CMD all    : %s\n", TOPIC_CMD_ALL);
+  Serial.printf("  SCENE      : %s\n", TOPIC_SCENE);
+  Serial.printf("  ACK        : %s\n", TOPIC_ACK);
+  Serial.printf("  GATEWAY    : %s  %s\n", TOPIC_GW_CFG, TOPIC_GW_BATCH);
   Serial.printf("  STATE      : %s\n", TOPIC_STATE);
   Serial.printf("  TELE       : %s\n", TOPIC_TELE);
-
-  tlsClient.setInsecure();
+  Serial.printf("  TELE cbor  : %s\n", TOPIC_TELE_CBOR);
+  Serial.printf("  INFO       : %s\n", TOPIC_INFO);
+  Serial.printf("  CONFIG     : %s\n", TOPIC_CONFIG);
+  Serial.printf("  BACKLOG    : %s\n", TOPIC_BACKLOG);
+  Serial.printf("  PROVISION  : %s\n", TOPIC_PROVISION);
+  Serial.printf("  OTA        : %s  %s  %s\n", TOPIC_OTA, TOPIC_OTA_ROW, TOPIC_OTA_ALL);
+  Serial.printf("  Arena      : %u / %u bytes\n", (unsigned)topicArenaUsed, (unsigned)TOPIC_ARENA_SIZE);
+
+  tlsClient.setCACert(HIVEMQ_CA_PEM);
+  tlsClient.setHandshakeTimeout(10000);
   mqtt.setServer(HIVEMQ_HOST, HIVEMQ_PORT);
   mqtt.setCallback(mqttCallback);
   mqtt.setBufferSize(1024);
   mqtt.setKeepAlive(30);
   mqtt.setSocketTimeout(10);
-
-  mqttReconnect();
+  // First connect happens in networkTask so setup() never blocks on TLS
 }
 
 // ============================================================
-//  AP MODE
+//  AP MODE — called from the network task, which owns WiFi
 // ============================================================
 void startAPMode() {
   WiFi.mode(WIFI_AP);
   WiFi.softAPConfig(AP_IP, AP_GW, AP_SUB);
   WiFi.softAP(AP_SSID, AP_PASSWORD);
+  apMode = true;
   Serial.println("[AP] Started @ " + WiFi.softAPIP().toString());
-  forceLight(true);
+  queueCommand(netCmdQ, CMD_FAILSAFE, true);
   Serial.println("[FAIL-SAFE] AP mode → light ON");
+  logEvent(EV_FAILSAFE, FS_AP);
 }
 
 // ============================================================
-//  WiFi HEALTH CHECK
+//  WiFi CONNECTION MANAGER
+//  Events only raise flags; wifiManagerTick() advances the
+//  phase on timestamps, so a pass costs microseconds and never
+//  blocks the network task.
 //  FIX v9.2: fail-safe only triggers if user did NOT force OFF
 // ============================================================
-void checkWiFiHealth() {
-  if (apMode) return;
-  if (millis() - lastWiFiCheckMs < WIFI_CHECK_MS) return;
-  lastWiFiCheckMs = millis();
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    wifiEvtUp.store(true);
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    wifiDiscReason = info.wifi_sta_disconnected.reason;
+    wifiEvtDown.store(true);
+  }
+}
 
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("[WiFi] Disconnected!");
+void wifiManagerTick() {
+  unsigned long now  = millis();
+  bool          up   = wifiEvtUp.exchange(false);
+  bool          down = wifiEvtDown.exchange(false);
+
+  switch (wifiPhase) {
+    case WIFI_PH_START:
+      wifiBegin(now);
+      wifiPhase  = WIFI_PH_CONNECTING;
+      wifiBootMs = now;
+      break;
+
+    case WIFI_PH_CONNECTING:
+      if (up) {
+        Serial.printf("[WiFi] %s IP: %s  (%lu ms%s)\n",
+                      wifiEverUp ? "Reconnected" : "Connected!",
+                      WiFi.localIP().toString().c_str(), now - wifiPhaseMs,
+                      wifiFastTry ? ", cached AP" : "");
+        if (!bootTimes.ipMs) { bootTimes.ipMs = sinceResetMs(); bootTimes.fastWifi = wifiFastTry; }
+        wifiCacheSave();
+        logEvent(EV_WIFI_UP, (uint16_t)std::min<unsigned long>((now - wifiPhaseMs) / 100, 0xFFFF));
+        wifiEverUp = true;
+        wifiPhase  = WIFI_PH_UP;
+      } else if (wifiFastTry && now - wifiPhaseMs >= WIFI_FAST_TIMEOUT_MS) {
+        // AP moved, channel changed or lease gone — forget it and scan
+        Serial.printf("[WiFi] Cached AP failed (reason %u) — full scan\n", wifiDiscReason);
+        wifiCacheOk = false;
+        Preferences p;
+        p.begin("wfc", false); p.clear(); p.end();
+        WiFi.disconnect();
+        wifiBegin(now);
+      } else if (!wifiEverUp && now - wifiBootMs >= WIFI_BOOT_TIMEOUT_MS) {
+        Serial.println("[WiFi] Failed — AP mode");
+        wifiPhase = WIFI_PH_START_AP;
+      } else if (now - wifiPhaseMs >= WIFI_RETRY_MS + devPhase.jitter(WIFI_RETRY_MS / 2, PH_WIFI, wifiRetries)) {
+        // auto-reconnect didn't make it — kick a fresh association
+        Serial.printf("[WiFi] Still down (reason %u) — retrying\n", wifiDiscReason);
+        WiFi.disconnect();
+        wifiBegin(now);
+        wifiRetries++;
+      }
+      break;
+
+    case WIFI_PH_UP:
+      if (down) {
+        Serial.printf("[WiFi] Disconnected! reason=%u\n", wifiDiscReason);
+        logEvent(EV_WIFI_DOWN, wifiDiscReason);
+
+        // FIX v9.2: respect user OFF intent during WiFi outage
+        if (!relay.on() && !relay.userForcedOff()) {
+          Serial.println("[FAIL-SAFE] WiFi down → forcing light ON");
+          logEvent(EV_FAILSAFE, FS_WIFI);
+          queueCommand(netCmdQ, CMD_FAILSAFE, true);
+        }
+        wifiPhase   = WIFI_PH_CONNECTING;   // auto-reconnect gets first shot
+        wifiPhaseMs = now;
+      }
+      break;
+
+    case WIFI_PH_START_AP:
+      startAPMode();
+      wifiPhase = WIFI_PH_AP;
+      break;
 
-    // FIX v9.2: respect user OFF intent during WiFi outage
-    if (!lightState && !userForcedOff) {
-      Serial.println("[FAIL-SAFE] WiFi down → forcing light ON");
-      forceLight(true);
-    }
+    case WIFI_PH_IDLE:
+    case WIFI_PH_AP:
+      break;
+  }
+}
 
-    WiFi.disconnect();
+// Cached AP first (once per boot), plain SSID join otherwise
+void wifiBegin(unsigned long now) {
+  wifiFastTry = wifiCacheOk && !wifiEverUp;
+  if (wifiFastTry) {
+    if (FAST_BOOT_STATIC_IP)
+      WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gw),
+                  IPAddress(wifiCache.mask), IPAddress(wifiCache.dns));
+    WiFi.begin(savedSSID.c_str(), savedPass.c_str(), wifiCache.channel, wifiCache.bssid);
+    Serial.printf("[WiFi] Fast connect: %s ch%u %02X:%02X:%02X:%02X:%02X:%02X\n",
+                  savedSSID.c_str(), wifiCache.channel,
+                  wifiCache.bssid[0], wifiCache.bssid[1], wifiCache.bssid[2],
+                  wifiCache.bssid[3], wifiCache.bssid[4], wifiCache.bssid[5]);
+  } else {
+    if (FAST_BOOT_STATIC_IP) WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));   // back to DHCP
     WiFi.begin(savedSSID.c_str(), savedPass.c_str());
-    unsigned long t = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - t < 10000) {
-      delay(500); Serial.print(".");
-      esp_task_wdt_reset();
-    }
-    Serial.println();
-    if (WiFi.status() == WL_CONNECTED)
-      Serial.println("[WiFi] Reconnected: " + WiFi.localIP().toString());
-    else
-      Serial.println("[WiFi] Still down — will retry");
+    Serial.println("[WiFi] Connecting to: " + savedSSID);
   }
+  wifiPhaseMs = now;
 }
 
+// setup(): before the network task starts
+void wifiCacheLoad() {
+  Preferences p;
+  p.begin("wfc", true);
+  wifiCacheOk = p.getBytes("c", &wifiCache, sizeof(wifiCache)) == sizeof(wifiCache) &&
+                wifiCache.ssidHash == fnv1a32(savedSSID.c_str(), savedSSID.length()) &&
+                wifiCache.channel >= 1 && wifiCache.channel <= 14;
+  p.end();
+}
+
+// Network task, on GOT_IP. Written only when something changed,
+// so a light that rejoins the same AP costs no flash.
+void wifiCacheSave() {
+  WifiCache c = {};
+  c.ssidHash = fnv1a32(savedSSID.c_str(), savedSSID.length());
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel  = (uint8_t)WiFi.channel();
+  c.ip       = WiFi.localIP();
+  c.gw       = WiFi.gatewayIP();
+  c.mask     = WiFi.subnetMask();
+  c.dns      = WiFi.dnsIP();
+  if (wifiCacheOk && memcmp(&c, &wifiCache, sizeof(c)) == 0) return;
+  wifiCache   = c;
+  wifiCacheOk = true;
+  Preferences p;
+  p.begin("wfc", false);
+  p.putBytes("c", &wifiCache, sizeof(wifiCache));
+  p.end();
+  nvsWrites++;
+}
+
+uint32_t sinceResetMs() { return (uint32_t)(esp_timer_get_time() / 1000); }
+
 // ============================================================
-//  WEB SERVER
+//  LAN FALLBACK — mDNS advertise + neighbour browse
+//  Each light advertises _aipl._tcp with row/light TXT and browses
+//  for the others with the non-blocking IDF query, one window per
+//  MDNS_BROWSE_MS; the network task only polls for the result.
 // ============================================================
-void setupWebServer() {
+void mdnsBegin() {
+  mdnsStarted = true;                    // one attempt per boot
+  char host[32];
+  if (provisioned) snprintf(host, sizeof(host), "aipl-r%u-l%u", rowIndex + 1, lightIndex + 1);
+  else             snprintf(host, sizeof(host), "aipl-%s", macHex);
+  if (!MDNS.begin(host)) {
+    Serial.println("[mDNS] Start failed — LAN discovery off");
+    return;
+  }
+  char row[5], light[5];
+  snprintf(row,   sizeof(row),   "%d", provisioned ? rowIndex   : -1);
+  snprintf(light, sizeof(light), "%d", provisioned ? lightIndex : -1);
+  MDNS.addService("http", "tcp", 80);
+  MDNS.addService("aipl", "tcp", 80);
+  MDNS.addServiceTxt("aipl", "tcp", "row",   row);
+  MDNS.addServiceTxt("aipl", "tcp", "light", light);
+  MDNS.addServiceTxt("aipl", "tcp", "fw",    FIRMWARE_VERSION);
+  MDNS.addServiceTxt("aipl", "tcp", "mac",   macHex);
+  MDNS.addServiceTxt("aipl", "tcp", "api",   "/api/batch");
+  Serial.printf("[mDNS] http://%s.local\n", host);
+}
+
+void neighbourSeen(const mdns_result_t* r) {
+  int row = -1, light = -1;
+  for (size_t i = 0; i < r->txt_count; i++) {
+    if (!r->txt[i].value) continue;
+    if      (strcmp(r->txt[i].key, "row")   == 0) row   = atoi(r->txt[i].value);
+    else if (strcmp(r->txt[i].key, "light") == 0) light = atoi(r->txt[i].value);
+  }
+  uint32_t ip = 0;
+  for (const mdns_ip_addr_t* a = r->addr; a && !ip; a = a->next)
+    if (a->addr.type == ESP_IPADDR_TYPE_V4) ip = a->addr.u_addr.ip4.addr;
+  if (row < 0 || light < 0 || row >= NO_INDEX || light >= NO_INDEX || !ip) return;
+  if (provisioned && row == rowIndex && light == lightIndex) return;   // ourselves
+
+  portENTER_CRITICAL(&neighbourMux);
+  int i = 0;
+  while (i < neighbourCount && !(neighbours[i].row == row && neighbours[i].light == light)) i++;
+  if (i < NEIGHBOUR_MAX) {
+    if (i == neighbourCount) neighbourCount++;
+    neighbours[i].row    = row;
+    neighbours[i].light  = light;
+    neighbours[i].ip     = ip;
+    neighbours[i].seenMs = millis();
+  }
+  portEXIT_CRITICAL(&neighbourMux);
+}
+
+void lanTick() {
+  if (apMode || wifiPhase != WIFI_PH_UP) return;
+  if (!mdnsStarted) { mdnsBegin(); return; }
+
+  unsigned long now = millis();
+  if (!mdnsBrowse) {
+    if (lastBrowseMs && now - lastBrowseMs < MDNS_BROWSE_MS) return;
+    lastBrowseMs = now;
+    mdnsBrowse = mdns_query_async_new(NULL, "_aipl", "_tcp", MDNS_TYPE_PTR,
+                                      MDNS_BROWSE_WAIT_MS, NEIGHBOUR_MAX, NULL);
+    return;
+  }
+
+  mdns_result_t* results = NULL;
+  if (!mdns_query_async_get_results(mdnsBrowse, 0, &results)) return;   // window still open
+  mdns_query_async_delete(mdnsBrowse);
+  mdnsBrowse = NULL;
+  for (const mdns_result_t* r = results; r; r = r->next) neighbourSeen(r);
+  mdns_query_results_free(results);
+
+  portENTER_CRITICAL(&neighbourMux);
+  for (int i = neighbourCount - 1; i >= 0; i--)
+    if (now - neighbours[i].seenMs > NEIGHBOUR_TTL_MS) neighbours[i] = neighbours[--neighbourCount];
+  portEXIT_CRITICAL(&neighbourMux);
+}
 
-  server.on("/", HTTP_GET, []() {
-    if (apMode) {
-      String page =
-        "<!DOCTYPE html><html><head>"
-        "<meta name='viewport' content='width=device-width,initial-scale=1'/>"
-        "<style>"
-        "*{box-sizing:border-box}"
-        "body{font-family:sans-serif;background:#06090d;color:#dde4ee;"
-        "display:flex;align-items:center;justify-content:center;min-height:100vh;margin:0}"
-        ".c{background:#0e151e;border:1px solid #182030;border-radius:16px;padding:32px;max-width:380px;width:100%}"
-        "h2{margin-bottom:20px;color:#f5c800;letter-spacing:3px}"
-        "label{font-size:12px;color:#4a6070;display:block;margin-bottom:4px;margin-top:12px}"
-        "input{width:100%;padding:10px;background:#0b1018;border:1px solid #182030;"
-        "border-radius:8px;font-size:14px;color:#dde4ee}"
-        "button{width:100%;margin-top:20px;padding:12px;background:#f5c800;"
-        "color:#06090d;border:none;border-radius:8px;font-size:14px;font-weight:700;cursor:pointer}"
-        ".note{margin-top:14px;font-size:11px;color:#334455;text-align:center}"
-        "</style></head><body><div class='c'>"
-        "<h2>AIPL SETUP</h2>"
-        "<form action='/save' method='POST'>"
-        "<label>WiFi SSID</label>"
-        "<input type='text' name='ssid' required placeholder='Network name'/>"
-        "<label>Password</label>"
-        "<input type='password' name='password' placeholder='WiFi password'/>"
-        "<button type='submit'>Save &amp; Connect</button>"
-        "</form>"
-        "<p class='note'>Row " + String(ROW_INDEX+1) +
-        " &middot; Light " + String(LIGHT_INDEX+1) +
-        " &middot; " + String(FIRMWARE_VERSION) + "</p>"
-        "</div></body></html>";
-      server.send(200, "text/html", page);
+// GET /api/neighbours — this light plus every light it has heard
+void sendNeighboursJson(AsyncWebServerRequest* req) {
+  Neighbour copy[NEIGHBOUR_MAX];
+  portENTER_CRITICAL(&neighbourMux);
+  uint8_t n = neighbourCount;
+  memcpy(copy, neighbours, n * sizeof(Neighbour));
+  portEXIT_CRITICAL(&neighbourMux);
+
+  char       buf[NEIGHBOUR_JSON_MAX];
+  char       ip[16];
+  JsonWriter w(buf, sizeof(buf));
+  ipToStr(WiFi.localIP(), ip);
+  w.addInt("row",   provisioned ? rowIndex   : -1);
+  w.addInt("light", provisioned ? lightIndex : -1);
+  w.addStr("ip",    ip);
+  w.beginArr("devices");
+  unsigned long now = millis();
+  for (int i = 0; i < n; i++) {
+    ipToStr(copy[i].ip, ip);
+    w.beginObj();
+    w.addInt ("row",   copy[i].row);
+    w.addInt ("light", copy[i].light);
+    w.addStr ("ip",    ip);
+    w.addUInt("age_s", (now - copy[i].seenMs) / 1000);
+    w.endObj();
+  }
+  w.endArr();
+  sendJson(req, buf, w.finish());
+}
+
+// ============================================================
+//  LAN BATCH API — many operations, one request, one response
+//  POST /api/batch   Content-Type: application/json
+//    {"ops":[{"op":"set","state":true},                    this light
+//            {"op":"set","state":false,"row":2},           a row   ┐
+//            {"op":"set","state":true,"row":2,"light":4},  a light ├ over the mesh
+//            {"op":"set","state":true,"all":true},         all     ┘
+//            {"op":"status"},
+//            {"op":"policy","heartbeat_s":30,"rssi_deadband":4}]}
+//  → {"results":[{"ok":true,"via":"local"},…,{"ok":true,"status":{…}}]}
+//  Results are in op order; one status snapshot per batch, a second
+//  status op gets an error. A tool that found the fleet over mDNS
+//  can drive all 36 lights through any one of them.
+// ============================================================
+void lanConfigTick() {
+  if (!lanConfigPending.load()) return;
+  applyDeviceConfig((byte*)lanConfig, lanConfigLen);
+  lanConfigPending.store(false);
+}
+
+// Body arrives in TCP-sized chunks; collect it on the request
+void batchBody(AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total) {
+  if (total > BATCH_BODY_MAX) return;    // handler answers 413
+  if (index == 0) req->_tempObject = malloc(total + 1);   // freed with the request
+  char* body = (char*)req->_tempObject;
+  if (!body) return;
+  memcpy(body + index, data, len);
+  if (index + len == total) body[total] = 0;
+}
+
+const char* batchSet(JsonObject op) {
+  bool state = op["state"] | false;
+  bool all   = op["all"]   | false;
+  int  row   = op["row"]   | -1;
+  int  light = op["light"] | -1;
+  if (!all && row < 0) {                 // no target: this light
+    return queueCommand(webCmdQ, CMD_SET, state) ? "local" : NULL;
+  }
+  if (!all && light >= 0 && provisioned && row == rowIndex && light == lightIndex)
+    return queueCommand(webCmdQ, CMD_SET, state) ? "local" : NULL;
+  if (!meshUp || row >= NO_INDEX || light >= NO_INDEX) return NULL;
+
+  MeshFrame f = {};
+  f.kind  = all ? MK_ALL : (light >= 0 ? MK_LIGHT : MK_ROW);
+  f.row   = row < 0 ? 0 : row;
+  f.light = light < 0 ? 0 : light;
+  f.state = state;
+  return meshTxQ.push(f) ? "mesh" : NULL;
+}
+
+void handleBatch(AsyncWebServerRequest* req) {
+  HttpTimer t;
+  char* body = (char*)req->_tempObject;   // ours until the request is freed
+  if (!body) { req->send(413, "application/json", "{\"error\":\"body missing or too large\"}"); return; }
+  if (apMode) { req->send(403, "application/json", "{\"error\":\"AP mode\"}"); return; }
+
+  BatchDoc    doc;                       // strings stay in body, slots only
+  JsonArray   ops;
+  const char* err = parseBatch(body, doc, ops);
+  if (err) {
+    char msg[48];
+    snprintf(msg, sizeof(msg), "{\"error\":\"%s\"}", err);
+    req->send(400, "application/json", msg);
+    return;
+  }
+
+  char       buf[BATCH_JSON_MAX];
+  JsonWriter w(buf, sizeof(buf));
+  bool       statusSent = false;
+  w.beginArr("results");
+  for (JsonObject op : ops) {
+    const char* kind = op["op"] | "";
+    w.beginObj();
+    if (strcmp(kind, "set") == 0) {
+      const char* via = batchSet(op);
+      w.addBool("ok", via != NULL);
+      if (via) w.addStr("via", via);
+      else     w.addStr("error", "queue full or no mesh");
+    } else if (strcmp(kind, "status") == 0 && statusSent) {
+      w.addBool("ok", false);
+      w.addStr ("error", "one status per batch");
+    } else if (strcmp(kind, "status") == 0) {
+      char   st[STATUS_JSON_MAX];
+      bool   ok = writeStatusJson(st, sizeof(st), VIEW_HTTP) != 0;
+      statusSent = true;
+      w.addBool("ok", ok);
+      if (ok) w.addJson("status", st);
+      else    w.addStr("error", "status too large");
+    } else if (strcmp(kind, "policy") == 0) {
+      bool ok = !lanConfigPending.load();
+      if (ok) {
+        lanConfigLen = serializeJson(op, lanConfig, sizeof(lanConfig));
+        lanConfigPending.store(true);
+      }
+      w.addBool("ok", ok);
+      if (!ok) w.addStr("error", "policy update pending");
     } else {
-      server.send(200, "application/json", getStatusJson());
+      w.addBool("ok", false);
+      w.addStr ("error", "unknown op");
+    }
+    w.endObj();
+  }
+  w.endArr();
+  sendJson(req, buf, w.finish());
+}
+
+// ============================================================
+//  ESP-NOW MESH — relay row/all/scene commands fixture to fixture
+//  Works with the AP or the broker down: every light applies a
+//  frame meant for it and rebroadcasts it with ttl − 1. The radio
+//  follows the STA channel, so the fleet (and any handheld) must
+//  sit on the AP's channel; while the AP is gone the reconnect scan
+//  hops channels briefly and a frame may miss a light — the relays
+//  from its neighbours usually cover that.
+// ============================================================
+const uint8_t MESH_BCAST[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+// WiFi task — copy out and leave
+void meshRecv(const uint8_t* mac, const uint8_t* data, int len) {
+  if (len != (int)sizeof(MeshFrame) || data[0] != MESH_MAGIC) return;
+  MeshRx rx;
+  memcpy(&rx.f, data, sizeof(MeshFrame));
+  rx.rxUs = esp_timer_get_time();
+  if (!meshRxQ.push(rx)) meshRxDropped++;
+}
+
+void meshTag(const MeshFrame& f, uint8_t* out) {
+  MeshFrame c = f;
+  c.ttl = 0;
+  uint8_t mac[32];
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                  (const unsigned char*)MESH_KEY, strlen(MESH_KEY),
+                  (const unsigned char*)&c, offsetof(MeshFrame, tag), mac);
+  memcpy(out, mac, MESH_TAG_LEN);
+}
+
+bool meshTagOk(const MeshFrame& f) {
+  uint8_t t[MESH_TAG_LEN];
+  meshTag(f, t);
+  uint8_t diff = 0;
+  for (int i = 0; i < MESH_TAG_LEN; i++) diff |= t[i] ^ f.tag[i];
+  return diff == 0;
+}
+
+// True if seq is new for its origin; the oldest origin makes room
+bool meshFresh(uint32_t origin, uint32_t seq) {
+  int i = 0;
+  while (i < meshOriginCount && meshOrigins[i].origin != origin) i++;
+  if (i < meshOriginCount) {
+    if ((int32_t)(seq - meshOrigins[i].seq) <= 0) return false;
+  } else if (meshOriginCount < MESH_ORIGINS) {
+    meshOriginCount++;
+  } else {
+    i = 0;
+    for (int j = 1; j < MESH_ORIGINS; j++)
+      if (meshOrigins[j].seenMs < meshOrigins[i].seenMs) i = j;
+  }
+  meshOrigins[i].origin = origin;
+  meshOrigins[i].seq    = seq;
+  meshOrigins[i].seenMs = millis();
+  return true;
+}
+
+void meshApply(const MeshFrame& f, int64_t rxUs) {
+  bool mine;
+  switch (f.kind) {
+    case MK_ALL:   mine = true;                                                  break;
+    case MK_ROW:   mine = provisioned && f.row == rowIndex;                       break;
+    case MK_LIGHT: mine = provisioned && f.row == rowIndex && f.light == lightIndex; break;
+    case MK_SCENE: mine = provisioned && f.sceneLen <= MESH_BODY_MAX;            break;
+    default:       mine = false;
+  }
+  if (!mine) return;
+
+  if (f.kind == MK_SCENE) {
+    applyScene(f.body, f.sceneLen, rxUs);
+  } else if (f.kind == MK_LIGHT) {
+    queueCommand(netCmdQ, CMD_SET, f.state, 0, 0, rxUs);
+  } else {
+    MeshSpread sp;
+    memcpy(&sp, f.body, sizeof(sp));
+    groupCommand(f.state, sp.spread10ms * 10u, f.kind == MK_ALL || sp.fleet, 0, 0, rxUs);
+  }
+  meshStats.applied++;
+  if (!mqttOnline) {
+    meshOffline++;
+    meshLastOrigin = f.origin;
+    meshLastSeq    = f.seq;
+  }
+}
+
+void meshSend(const MeshFrame& f) {
+  if (esp_now_send(MESH_BCAST, (const uint8_t*)&f, sizeof(f)) == ESP_OK) meshStats.tx++;
+}
+
+void meshBegin() {
+  if (esp_now_init() != ESP_OK) {
+    Serial.println("[MESH] esp_now_init failed — mesh off");
+    return;
+  }
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, MESH_BCAST, ESP_NOW_ETH_ALEN);
+  peer.channel = 0;                      // whatever STA is on
+  peer.ifidx   = WIFI_IF_STA;
+  peer.encrypt = false;
+  esp_now_add_peer(&peer);
+  esp_now_register_recv_cb(meshRecv);
+  meshUp = true;
+  Serial.println("[MESH] ESP-NOW relay up");
+}
+
+// Network task: verify, dedup, apply, relay; then sign and send
+// whatever the LAN API has queued
+void meshTick() {
+  if (!meshUp || apMode) return;
+  MeshRx rx;
+  while (meshRxQ.pop(rx)) {
+    meshStats.rx++;
+    if (!meshTagOk(rx.f))                  { meshStats.badTag++; continue; }
+    if (rx.f.kind == MK_BEACON)            { gwBeacon(rx.f);     continue; }   // status only, never relayed
+    if (!meshFresh(rx.f.origin, rx.f.seq)) { meshStats.dup++;    continue; }
+    meshApply(rx.f, rx.rxUs);
+    if (rx.f.ttl > 1) {
+      rx.f.ttl--;
+      meshSend(rx.f);
+      meshStats.relayed++;
+    }
+  }
+
+  MeshFrame f;
+  while (meshTxQ.pop(f)) {
+    meshOriginate(f, MESH_TTL);
+    meshApply(f, esp_timer_get_time());
+    Serial.printf("[MESH] Sent kind %u seq %08lX\n", f.kind, (unsigned long)f.seq);
+  }
+}
+
+// Sign and broadcast a frame from this light (network task)
+void meshOriginate(MeshFrame& f, uint8_t ttl) {
+  f.magic  = MESH_MAGIC;
+  f.ttl    = ttl;
+  f.origin = (uint32_t)ESP.getEfuseMac();
+  f.seq    = ((uint32_t)bootNo << 16) | ++meshCounter;
+  meshTag(f, f.tag);
+  meshFresh(f.origin, f.seq);             // our own frame echoed back is a dup
+  meshSend(f);
+}
+
+// On reconnect, before the retained state: tell the cloud that this
+// light changed under mesh control, so it doesn't read the new
+// state as drift. The state publish that follows is the truth.
+void meshReconcile() {
+  if (!meshOffline) return;
+  char       buf[128];
+  JsonWriter w(buf, sizeof(buf));
+  char       origin[9];
+  snprintf(origin, sizeof(origin), "%08lX", (unsigned long)meshLastOrigin);
+  w.addUInt("applied",  meshOffline);
+  w.addStr ("origin",   origin);
+  w.addUInt("seq",      meshLastSeq);
+  w.addBool("state",    relay.on());
+  size_t n = w.finish();
+  if (publishJson(TOPIC_MESH, buf, n, false)) meshOffline = 0;
+}
+
+// ============================================================
+//  ROW GATEWAY — election, relay, member reporting
+//  Election is non-preemptive: a working gateway keeps the row
+//  even when a lower light comes back, so a flapping fixture can't
+//  cause a TLS handshake storm. Two gateways (after a partition)
+//  resolve to the lower light index.
+//  Members still serve the LAN API and the mesh; per-device OTA
+//  and config topics need gateway mode off for the row.
+// ============================================================
+bool gwCloudAllowed() {
+  return gwRole == GW_OFF || gwRole == GW_GATEWAY;
+}
+
+void gwSetRole(GwRole r) {
+  if (r == gwRole) return;
+  Serial.printf("[GW] %s → %s\n", GW_ROLE_NAMES[gwRole], GW_ROLE_NAMES[r]);
+  gwRole      = r;
+  gwPhaseMs   = millis();
+  gwRounds    = 0;
+  gwBeaconNow = true;
+  if (!gwCloudAllowed() && mqtt.connected()) {
+    mqtt.disconnect();                   // the row's gateway speaks for us now
+    tlsClient.stop();
+    mqttOnline = false;
+  }
+}
+
+void gwFollow(uint8_t leader, bool cloud) {
+  gwLeader      = leader;
+  gwLeaderMs    = millis();
+  gwLeaderCloud = cloud;
+  gwSetRole(GW_MEMBER);
+}
+
+void gwSetMode(bool on) {
+  if (on == gwMode) return;
+  gwMode = on;
+  Preferences p;
+  p.begin("gw", false);
+  p.putBool("on", on);
+  p.end();
+  nvsWrites++;
+  Serial.printf("[GW] Gateway mode %s\n", on ? "on" : "off");
+  if (on) {
+    gwSetRole(GW_ELECT);
+  } else {
+    if (gwRole == GW_GATEWAY) gwAnnounceOff = millis() + GW_FAILOVER_MS;   // tell the members
+    gwSetRole(GW_OFF);
+  }
+}
+
+void gwInit() {
+  Preferences p;
+  p.begin("gw", true);
+  gwMode = p.getBool("on", false);
+  p.end();
+  for (int i = 0; i < GW_ROW_MAX; i++) gwPeers[i].published = -1;
+  if (gwMode && provisioned && meshUp) gwSetRole(GW_ELECT);
+}
+
+// Retained {"enabled":true|false} on aipl/row/R/gateway
+void gwApplyConfig(byte* payload, unsigned int len) {
+  StaticJsonDocument<64> doc;
+  if (deserializeJson(doc, payload, len)) {
+    Serial.println("[GW] Bad gateway JSON — ignored");
+    return;
+  }
+  if (!meshUp && (doc["enabled"] | false)) {
+    Serial.println("[GW] Mesh down — staying direct");
+    return;
+  }
+  gwModeWanted = (doc["enabled"] | false) ? 1 : 0;   // may drop MQTT — not from its callback
+}
+
+void gwSendBeacon() {
+  gwBeaconMs     = millis();
+  gwBeaconNow    = false;
+  gwNextBeaconMs = devPhase.nextOnGrid(gwBeaconMs, GW_BEACON_MS, GW_BEACON_MS / 2, PH_BEACON);
+  GwBeacon b;
+  b.flags    = (gwMode ? GB_MODE : 0) | (wifiPhase == WIFI_PH_UP ? GB_WIFI : 0);
+  if (gwRole == GW_GATEWAY) b.flags |= GB_GATEWAY | (mqttOnline ? GB_CLOUD : 0);
+  b.state    = relay.on();
+  b.rssi     = wifiPhase == WIFI_PH_UP ? WiFi.RSSI() : 0;
+  b.pad      = 0;
+  b.onS      = getOnSeconds();
+  b.upS      = (uint32_t)(uptimeMs() / 1000);
+  b.energyWh = (uint32_t)(getEnergyMwh() / 1000);
+
+  MeshFrame f = {};
+  f.magic  = MESH_MAGIC;
+  f.ttl    = 1;
+  f.kind   = MK_BEACON;
+  f.row    = rowIndex;
+  f.light  = lightIndex;
+  f.origin = (uint32_t)ESP.getEfuseMac();
+  memcpy(f.body, &b, sizeof(b));
+  meshTag(f, f.tag);
+  meshSend(f);
+}
+
+// Lowest light index heard recently (or us) that could hold the session
+uint8_t gwBestCandidate() {
+  unsigned long now  = millis();
+  uint8_t       best = wifiPhase == WIFI_PH_UP ? lightIndex : NO_INDEX;
+  for (uint8_t l = 0; l < GW_ROW_MAX && l < best; l++) {
+    const GwPeer& p = gwPeers[l];
+    if (p.seenMs && now - p.seenMs <= GW_FAILOVER_MS && (p.b.flags & GB_MODE) && (p.b.flags & GB_WIFI))
+      best = l;
+  }
+  return best;
+}
+
+void gwPublishMember(uint8_t light) {
+  GwPeer& p = gwPeers[light];
+  if (!mqttOnline || p.published == (int8_t)p.b.state) return;
+  char topic[40];
+  snprintf(topic, sizeof(topic), "aipl/row/%u/light/%u/state", rowIndex, light);
+  if (mqtt.publish(topic, p.b.state ? "ON" : "OFF", true)) p.published = p.b.state;
+}
+
+// {"gateway":L,"members":[{"light","state","rssi","on_s","up_s","energy_wh","age_s"},…]}
+void gwPublishBatch() {
+  gwBatchMs     = millis();
+  gwNextBatchMs = devPhase.nextOnGrid(gwBatchMs, telePolicy.heartbeatMs, telePolicy.heartbeatMs / 2, PH_BATCH);
+  char       buf[768];
+  JsonWriter w(buf, sizeof(buf));
+  w.addUInt("gateway", lightIndex);
+  w.beginArr("members");
+  for (uint8_t l = 0; l < GW_ROW_MAX; l++) {
+    const GwPeer& p = gwPeers[l];
+    if (!p.seenMs || l == lightIndex) continue;
+    w.beginObj();
+    w.addUInt("light",     l);
+    w.addBool("state",     p.b.state);
+    w.addInt ("rssi",      p.b.rssi);
+    w.addUInt("on_s",      p.b.onS);
+    w.addUInt("up_s",      p.b.upS);
+    w.addUInt("energy_wh", p.b.energyWh);
+    w.addUInt("age_s",     (gwBatchMs - p.seenMs) / 1000);
+    w.endObj();
+  }
+  w.endArr();
+  size_t n = w.finish();
+  publishJson(TOPIC_GW_BATCH, buf, n, false);
+}
+
+void gwOnConnect() {
+  if (gwRole != GW_GATEWAY) return;
+  for (uint8_t l = 0; l < GW_ROW_MAX; l++) {
+    gwPeers[l].published = -1;           // republish everyone's retained state
+    if (gwPeers[l].seenMs && l != lightIndex) gwPublishMember(l);
+  }
+  gwNextBatchMs = millis();              // batch now, then on this light's phase
+  gwBeaconNow   = true;                  // members see GB_CLOUD at once
+}
+
+void gwBeacon(const MeshFrame& f) {
+  if (!provisioned || f.row != rowIndex || f.light == lightIndex || f.light >= GW_ROW_MAX) return;
+  GwPeer& p = gwPeers[f.light];
+  memcpy(&p.b, f.body, sizeof(GwBeacon));
+  p.seenMs = millis() | 1;
+  bool leader = p.b.flags & GB_GATEWAY;
+  bool cloud  = p.b.flags & GB_CLOUD;
+
+  switch (gwRole) {
+    case GW_ELECT:
+      if (leader) gwFollow(f.light, cloud);
+      break;
+    case GW_MEMBER:
+      if (!leader) break;
+      if (!(p.b.flags & GB_MODE)) { gwSetMode(false); break; }   // row switched back to direct
+      if (gwLeaderCloud && !cloud && !relay.on() && !relay.userForcedOff()) {
+        Serial.println("[FAIL-SAFE] Row gateway lost the cloud → forcing light ON");
+        logEvent(EV_FAILSAFE, FS_GATEWAY);
+        queueCommand(netCmdQ, CMD_FAILSAFE, true);
+      }
+      gwLeader      = f.light;           // may be a new one after failover
+      gwLeaderMs    = p.seenMs;
+      gwLeaderCloud = cloud;
+      break;
+    case GW_GATEWAY:
+      if (leader && f.light < lightIndex) { gwFollow(f.light, cloud); break; }
+      if (!leader) gwPublishMember(f.light);
+      break;
+    default:
+      break;
+  }
+}
+
+// Gateway only: re-issue a cloud command to the row over the mesh
+void gwRelay(MeshKind kind, uint8_t light, bool state, const byte* body, unsigned int len) {
+  if (gwRole != GW_GATEWAY || !meshUp) return;
+  MeshFrame f = {};
+  f.kind  = kind;
+  f.row   = rowIndex;
+  f.light = light;
+  f.state = state;
+  if (body) {
+    if (len > MESH_BODY_MAX) {
+      Serial.println("[GW] Scene too long to relay");
+      return;
+    }
+    memcpy(f.body, body, len);
+    f.sceneLen = len;
+  }
+  meshOriginate(f, GW_RELAY_TTL);
+  gwRelayed++;
+}
+
+// aipl/row/<ours>/light/<L>/command for some other light L
+bool gwMemberTopic(const char* topic, uint8_t& light) {
+  if (gwRole != GW_GATEWAY) return false;
+  unsigned r, l;
+  char     tail[9];
+  if (sscanf(topic, "aipl/row/%u/light/%u/%8s", &r, &l, tail) != 3) return false;
+  if (r != rowIndex || l == lightIndex || l >= NO_INDEX || strcmp(tail, "command") != 0) return false;
+  light = l;
+  return true;
+}
+
+void gwTick() {
+  if (!meshUp || apMode || !provisioned) return;
+  if (gwModeWanted >= 0) {
+    gwSetMode(gwModeWanted);
+    gwModeWanted = -1;
+  }
+  unsigned long now = millis();
+  bool announcing = gwRole == GW_OFF && gwAnnounceOff && (long)(gwAnnounceOff - now) > 0;
+  if ((gwRole != GW_OFF || announcing) && (gwBeaconNow || (long)(now - gwNextBeaconMs) >= 0))
+    gwSendBeacon();
+
+  switch (gwRole) {
+    case GW_ELECT:
+      if (now - gwPhaseMs < GW_ELECT_MS) break;
+      gwPhaseMs = now;
+      // the best candidate gets one extra window to claim the row
+      if (wifiPhase == WIFI_PH_UP && (gwBestCandidate() == lightIndex || ++gwRounds >= 2)) {
+        Serial.printf("[GW] Claiming row %u\n", rowIndex + 1);
+        gwSetRole(GW_GATEWAY);
+      }
+      break;
+    case GW_MEMBER:
+      if (now - gwLeaderMs > GW_FAILOVER_MS) {
+        Serial.printf("[GW] Gateway light %u silent — re-electing\n", gwLeader + 1);
+        gwFailovers++;
+        gwLeader = NO_INDEX;
+        gwSetRole(GW_ELECT);
+      }
+      break;
+    case GW_GATEWAY:
+      if (mqttOnline && (long)(now - gwNextBatchMs) >= 0) gwPublishBatch();
+      break;
+    default:
+      break;
+  }
+}
+
+// ============================================================
+//  SCHEDULE — on-device shift switching from NTP time
+//  Rules arrive retained on aipl/all/schedule and live in NVS,
+//  so the floor still switches on time with the cloud down.
+//  The network task owns rules, TZ and the clock; it arms one
+//  esp_timer for the next event, whose callback queues the
+//  change straight to the control task — nothing is polled.
+// ============================================================
+// esp_timer task — same path as any other producer, own queue
+void schedTimerCb(void* arg) {
+  queueCommand(timerCmdQ, CMD_SCHEDULE, schedNextState.load());
+  schedDue   = true;
+  schedRearm = true;
+}
+
+// lwIP task — every SNTP sync may step the clock
+void schedOnTimeSync(struct timeval* tv) {
+  schedRearm = true;
+  if (!evClockLogged.exchange(true)) logEvent(EV_CLOCK, 0);
+}
+
+void schedBegin() {
+  Preferences p;
+  p.begin("sch", true);
+  if (p.getBytesLength("b") != sizeof(sched) || p.getBytes("b", &sched, sizeof(sched)) != sizeof(sched) ||
+      sched.count > SCHED_MAX_RULES) {
+    memset(&sched, 0, sizeof(sched));
+    strcpy(sched.tz, "UTC0");
+  }
+  p.end();
+  sched.tz[SCHED_TZ_MAX - 1] = 0;
+
+  esp_timer_create_args_t args = {};
+  args.callback = schedTimerCb;
+  args.name     = "sched";
+  esp_timer_create(&args, &schedTimer);
+  sntp_set_time_sync_notification_cb(schedOnTimeSync);
+  configTzTime(sched.tz, NTP_SERVER_1, NTP_SERVER_2);
+  Serial.printf("[SCHED] v%lu, %u rule(s), TZ %s — waiting for NTP\n",
+                (unsigned long)sched.version, sched.count, sched.tz);
+}
+
+// Network task (MQTT callback)
+void schedApply(const byte* payload, unsigned int len) {
+  Schedule s;
+  if (len == 0) {                        // retained message cleared
+    memset(&s, 0, sizeof(s));
+    strcpy(s.tz, sched.tz);
+  } else if (!parseSchedule(payload, len, rowIndex, lightIndex, s)) {
+    Serial.println("[SCHED] Bad schedule JSON — ignored");
+    return;
+  }
+  // Retained redelivery on every reconnect — no NVS write, no rearm
+  if (memcmp(&s, &sched, sizeof(s)) == 0) return;
+
+  bool tzChanged = strcmp(s.tz, sched.tz) != 0;
+  sched = s;
+  Preferences p;
+  p.begin("sch", false);
+  p.putBytes("b", &sched, sizeof(sched));
+  p.end();
+  nvsWrites++;
+  if (tzChanged) { setenv("TZ", sched.tz, 1); tzset(); }
+  schedRearm = true;
+  Serial.printf("[SCHED] v%lu: %u rule(s) for this light, TZ %s\n",
+                (unsigned long)sched.version, sched.count, sched.tz);
+}
+
+// Network task: (re)compute the next event and arm the timer
+void schedTick() {
+  if (!schedTimer || !schedRearm.load()) return;
+  time_t now = time(NULL);
+  if (now < SCHED_TIME_VALID) return;    // keep the rearm pending until NTP
+  schedRearm = false;
+  // The timer may run a hair ahead of the RTC — never re-find the event it just fired
+  if (schedDue.exchange(false) && schedNextAt > now) now = schedNextAt;
+
+  esp_timer_stop(schedTimer);            // fails harmlessly if not armed
+  schedNextAt = 0;
+  bool     state = false;
+  time_t   at    = scheduleNextAt(sched, now, state);
+  if (!at) return;
+  uint32_t in    = (uint32_t)(at - now);
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  int64_t us = (int64_t)(now + in - tv.tv_sec) * 1000000LL - tv.tv_usec;
+  schedNextState = state;
+  schedNextAt    = now + in;
+  esp_timer_start_once(schedTimer, us > 0 ? (uint64_t)us : 1);
+  Serial.printf("[SCHED] Next: %s in %lus\n", state ? "ON" : "OFF", (unsigned long)in);
+}
+
+// Control task. A scheduled OFF counts as the user's OFF, so the
+// fail-safe keeps the floor dark overnight; a scheduled ON is only
+// refused if someone switched the light off by hand since the
+// schedule last did (FIX v9.2 intent survives automation).
+void schedSetOwnsOff(bool v) {
+  if (v == schedOwnsOff) return;
+  schedOwnsOff = v;
+  lsNvs.putBool("so", v);               // a power cut overnight must not lose it
+  nvsWrites++;
+}
+
+void scheduleLight(bool state) {
+  if (state && relay.userForcedOff() && !schedOwnsOff) {
+    schedSkipped++;
+    Serial.println("[SCHED] ON skipped — user commanded OFF, respecting intent");
+    return;
+  }
+  schedFired++;
+  if (relay.on() != state) logEvent(EV_RELAY, state | EVS_SCHEDULE << 1);
+  setLightState(state);
+  schedSetOwnsOff(!state);
+  Serial.printf("[SCHED] Light %s (schedule)\n", state ? "ON" : "OFF");
+}
+
+// ============================================================
+//  EVENT LOG — state changes, fail-safes, link and boot events
+//  on flash (event_log.h), read back over HTTP:
+//    GET /api/events?from=<seq>&to=<seq>&since=<unix>&until=<unix>&limit=N
+//  One NDJSON line per record, oldest first, streamed in chunks
+//  straight from flash — the range is never held in RAM:
+//    {"seq":812,"t":1718000000,"up":3605,"type":"relay","v":3}
+//  t = 0 before the first NTP sync; a boot's "clock" record gives
+//  t - up for dating them. since/until skip undated records.
+// ============================================================
+void evBegin() {
+  bool ok = evFlash.begin() && eventLog.begin();
+  if (ok) Serial.printf("[EVLOG] %lu record(s), next seq %lu\n",
+                        (unsigned long)eventLog.count(), (unsigned long)eventLog.nextSeq());
+  else    Serial.println("[EVLOG] No evlog partition — events not recorded (flash partitions.csv over USB)");
+}
+
+// Any task; never blocks on flash
+void logEvent(EvType type, uint16_t value) {
+  time_t       now = time(NULL);
+  PendingEvent e   = { now >= SCHED_TIME_VALID ? (uint32_t)now : 0,
+                       (uint32_t)(esp_timer_get_time() / 1000000), (uint8_t)type, value };
+  evLock.lock();
+  if (evPendCount < EV_PENDING_MAX && eventLog.ready()) {
+    evPending[(evPendHead + evPendCount) % EV_PENDING_MAX] = e;
+    evPendCount++;
+  } else {
+    evDropped++;
+  }
+  evLock.unlock();
+}
+
+// Network task: the only one that writes the partition
+void evTick() {
+  for (;;) {
+    PendingEvent e;
+    evLock.lock();
+    bool have = evPendCount > 0;
+    if (have) {
+      e          = evPending[evPendHead];
+      evPendHead = (evPendHead + 1) % EV_PENDING_MAX;
+      evPendCount--;
+    }
+    evLock.unlock();
+    if (!have) return;
+    eventLog.append(e.type, e.value, e.epoch, e.upS);
+  }
+}
+
+// Cursor for one streamed response, owned by its filler callback
+struct EvStream {
+  uint32_t seq;                 // next record to read
+  uint32_t toSeq;               // exclusive, fixed at request time
+  uint32_t since, until;        // 0 = open
+  uint32_t left;                // lines still allowed (limit)
+  uint32_t base = 0;            // seq of recs[0]
+  EvRecord recs[EV_READ_BATCH];
+  uint8_t  n = 0, i = 0;
+  char     line[112];           // one formatted record — may straddle chunks
+  uint8_t  len = 0, pos = 0;
+};
+
+// async_tcp: copy out whatever fits, 0 once the range is done
+size_t evFill(EvStream& s, uint8_t* buf, size_t maxLen) {
+  size_t out = 0;
+  while (out < maxLen) {
+    if (s.pos < s.len) {
+      size_t k = std::min<size_t>(maxLen - out, s.len - s.pos);
+      memcpy(buf + out, s.line + s.pos, k);
+      out += k; s.pos += k;
+      continue;
+    }
+    if (!s.left) break;
+    if (s.i == s.n) {
+      if (s.seq < eventLog.oldestSeq()) s.seq = eventLog.oldestSeq();   // recycled under us
+      if (s.seq >= s.toSeq) break;
+      s.base = s.seq;
+      s.n    = eventLog.read(s.seq, s.recs, std::min<uint32_t>(EV_READ_BATCH, s.toSeq - s.seq));
+      s.i    = 0;
+      if (!s.n) break;
+      s.seq += s.n;
+    }
+    const EvRecord& r = s.recs[s.i];
+    uint32_t        q = s.base + s.i++;
+    if (!EventLog::valid(r, q)) continue;                 // torn, or erased while we read
+    if (s.since && r.epoch < s.since) continue;
+    if (s.until && (!r.epoch || r.epoch > s.until)) continue;
+    int n = snprintf(s.line, sizeof(s.line),
+                     "{\"seq\":%lu,\"t\":%lu,\"up\":%lu,\"type\":\"%s\",\"v\":%u}\n",
+                     (unsigned long)r.seq, (unsigned long)r.epoch, (unsigned long)r.upS,
+                     EV_TYPE_NAMES[r.type], r.value);
+    s.len = (uint8_t)std::min<int>(n, sizeof(s.line) - 1);
+    s.pos = 0;
+    s.left--;
+  }
+  return out;
+}
+
+void sendEvents(AsyncWebServerRequest* req) {
+  if (!eventLog.ready()) { req->send(503, "application/json", "{\"error\":\"no evlog partition\"}"); return; }
+  std::shared_ptr<EvStream> s(new (std::nothrow) EvStream);
+  if (!s) { req->send(503, "application/json", "{\"error\":\"low memory\"}"); return; }
+  uint32_t next = eventLog.nextSeq();
+  s->seq   = req->hasArg("from")  ? (uint32_t)req->arg("from").toInt()      : eventLog.oldestSeq();
+  s->toSeq = req->hasArg("to")    ? (uint32_t)req->arg("to").toInt() + 1    : next;
+  s->since = req->hasArg("since") ? (uint32_t)req->arg("since").toInt()     : 0;
+  s->until = req->hasArg("until") ? (uint32_t)req->arg("until").toInt()     : 0;
+  s->left  = req->hasArg("limit") ? (uint32_t)req->arg("limit").toInt()     : EV_QUERY_LIMIT;
+  if (s->toSeq > next) s->toSeq = next;
+
+  AsyncWebServerResponse* res = req->beginChunkedResponse("application/x-ndjson",
+    [s](uint8_t* buf, size_t maxLen, size_t index) -> size_t { return evFill(*s, buf, maxLen); });
+  res->addHeader("X-Log-Oldest", String(eventLog.oldestSeq()));
+  res->addHeader("X-Log-Next",   String(next));
+  req->send(res);
+}
+
+// POST /api/mesh  target=all|row|light|scene  row= light= (0-based)
+//                 state=1|0   scene=<hex, as on aipl/all/scene>
+bool meshFrameFromRequest(AsyncWebServerRequest* req, MeshFrame& f) {
+  memset(&f, 0, sizeof(f));
+  String target = req->arg("target");
+  f.row   = (uint8_t)req->arg("row").toInt();
+  f.light = (uint8_t)req->arg("light").toInt();
+  f.state = (req->arg("state") == "1" || req->arg("state") == "true");
+  if (target == "all" || target == "row") {
+    f.kind = target == "all" ? MK_ALL : MK_ROW;
+    long       ms = std::max<long>(0, req->arg("spread_ms").toInt());
+    MeshSpread sp = { (uint16_t)(std::min<uint32_t>(ms, SPREAD_MAX_MS) / 10),
+                      target == "all" };
+    memcpy(f.body, &sp, sizeof(sp));
+  }
+  else if (target == "light") f.kind = MK_LIGHT;
+  else if (target == "scene") {
+    f.kind = MK_SCENE;
+    String hex = req->arg("scene");
+    if (hex.length() % 2 || hex.length() / 2 > MESH_BODY_MAX || hex.length() < 2 * (SCENE_HDR + 1))
+      return false;
+    for (unsigned i = 0; i < hex.length() / 2; i++) {
+      char pair[3] = { hex[2 * i], hex[2 * i + 1], 0 };
+      if (!isxdigit((unsigned char)pair[0]) || !isxdigit((unsigned char)pair[1])) return false;
+      f.body[i] = (uint8_t)strtoul(pair, NULL, 16);
     }
+    f.sceneLen = hex.length() / 2;
+  }
+  else return false;
+  return true;
+}
+
+// ============================================================
+//  WEB SERVER — async, pages gzipped in flash
+// ============================================================
+// Static pages: no per-request building, ETag → 304 on revisit
+void sendAsset(AsyncWebServerRequest* req, const WebAsset& a) {
+  AsyncWebHeader* inm = req->getHeader("If-None-Match");
+  AsyncWebServerResponse* res = (inm && inm->value() == a.etag)
+    ? req->beginResponse(304)
+    : req->beginResponse_P(200, a.type, a.gz, a.len);
+  res->addHeader("Content-Encoding", "gzip");
+  res->addHeader("ETag",             a.etag);
+  res->addHeader("Cache-Control",    "no-cache");   // always revalidate, body rarely resent
+  req->send(res);
+}
+
+void requestRestart(const char* why, unsigned long delayMs) {
+  restartWhy     = why;
+  restartAtMs    = millis() + delayMs;
+  restartPending = true;
+}
+
+// Network task: flush + clean MQTT disconnect via controlledRestart()
+void restartTick() {
+  if (restartPending && (long)(millis() - restartAtMs) >= 0) controlledRestart(restartWhy);
+}
+
+void setupWebServer() {
+
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    if (apMode)             sendAsset(req, ASSET_SETUP_HTML);
+    else if (dashboardOnFs) req->redirect("/ui/");
+    else                    sendStatusJson(req);
+  });
+
+  // LAN dashboard from LittleFS; serveStatic picks index.html.gz
+  // and answers If-None-Match itself
+  server.serveStatic("/ui/", LittleFS, "/www/")
+        .setDefaultFile("index.html")
+        .setCacheControl("no-cache");
+
+  server.on("/api/neighbours", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    sendNeighboursJson(req);
   });
 
-  server.on("/save", HTTP_POST, []() {
+  server.on("/favicon.svg", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    sendAsset(req, ASSET_FAVICON_SVG);
+  });
+
+  server.on("/save", HTTP_POST, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
     prefs.begin("wifi", false);
-    prefs.putString("ssid",     server.arg("ssid"));
-    prefs.putString("password", server.arg("password"));
+    prefs.putString("ssid",     req->arg("ssid"));
+    prefs.putString("password", req->arg("password"));
     prefs.end();
-    server.send(200, "text/html",
-      "<html><body style='font-family:sans-serif;text-align:center;"
-      "padding:40px;background:#06090d;color:#f5c800'>"
-      "<h2>&#10003; Saved! Restarting...</h2></body></html>");
-    delay(2000);
-    ESP.restart();
+    int row   = req->arg("row").toInt();       // 1-based on the form
+    int light = req->arg("light").toInt();
+    if (row >= 1 && row < NO_INDEX && light >= 1 && light < NO_INDEX)
+      saveIdentity(row - 1, light - 1);
+    sendAsset(req, ASSET_SAVED_HTML);
+    requestRestart("wifi saved", 2000);
+  });
+
+  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    sendStatusJson(req);
   });
 
-  server.on("/api/status", HTTP_GET, []() {
-    server.send(200, "application/json", getStatusJson());
+  server.on("/api/metrics", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    sendMetricsJson(req);
   });
 
-  server.on("/api/set", HTTP_POST, []() {
-    if (apMode) { server.send(403, "application/json", "{\"error\":\"AP mode\"}"); return; }
-    bool desired = (server.arg("state") == "1" || server.arg("state") == "true");
-    setLightState(desired);
-    server.send(200, "application/json", getStatusJson());
+  server.on("/api/events", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    sendEvents(req);
   });
 
-  server.on("/on",  HTTP_GET, []() { setLightState(true);  server.send(200, "text/plain", "Light ON");  });
-  server.on("/off", HTTP_GET, []() { setLightState(false); server.send(200, "text/plain", "Light OFF"); });
+  server.on("/api/set", HTTP_POST, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    if (apMode) { req->send(403, "application/json", "{\"error\":\"AP mode\"}"); return; }
+    bool desired = (req->arg("state") == "1" || req->arg("state") == "true");
+    if (!queueCommand(webCmdQ, CMD_SET, desired)) {
+      req->send(503, "application/json", "{\"error\":\"command queue full\"}");
+      return;
+    }
+    // Queued, not necessarily applied yet — answer with what was asked
+    // for; /api/status (or .../state over MQTT) shows the relay itself
+    char       buf[48];
+    JsonWriter w(buf, sizeof(buf));
+    w.addBool("state",  desired);
+    w.addBool("queued", true);
+    sendJson(req, buf, w.finish());
+  });
 
-  server.on("/reset", HTTP_GET, []() {
+  server.on("/api/batch", HTTP_POST, handleBatch, NULL, batchBody);
+
+  server.on("/api/mesh", HTTP_POST, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    MeshFrame f;
+    if (!meshUp)                          { req->send(503, "application/json", "{\"error\":\"mesh down\"}"); return; }
+    if (!meshFrameFromRequest(req, f))    { req->send(400, "application/json", "{\"error\":\"bad target\"}"); return; }
+    if (!meshTxQ.push(f))                 { req->send(429, "application/json", "{\"error\":\"busy\"}");      return; }
+    req->send(202, "application/json", "{\"queued\":true}");
+  });
+
+  server.on("/on",  HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    if (!queueCommand(webCmdQ, CMD_SET, true)) { req->send(503, "text/plain", "Busy"); return; }
+    req->send(200, "text/plain", "Light ON");
+  });
+  server.on("/off", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    if (!queueCommand(webCmdQ, CMD_SET, false)) { req->send(503, "text/plain", "Busy"); return; }
+    req->send(200, "text/plain", "Light OFF");
+  });
+
+  server.on("/reset", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
     prefs.begin("wifi", false); prefs.clear(); prefs.end();
-    server.send(200, "text/plain", "Cleared. Restarting...");
-    delay(1000); ESP.restart();
+    req->send(200, "text/plain", "Cleared. Restarting...");
+    requestRestart("wifi reset", 1000);
   });
-  server.on("/restart", HTTP_GET, []() {
-    server.send(200, "text/plain", "Restarting...");
-    delay(500); ESP.restart();
+  server.on("/restart", HTTP_GET, [](AsyncWebServerRequest* req) {
+    HttpTimer t;
+    req->send(200, "text/plain", "Restarting...");
+    requestRestart("http", 500);
+  });
+
+  // the dashboard on one light calls /api/status + /api/set on all the others
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
+
+  server.onNotFound([](AsyncWebServerRequest* req) {
+    req->send(404, "text/plain", "Not found");
   });
 }
 
@@ -505,40 +3605,57 @@ void setupWebServer() {
 // ============================================================
 void setup() {
   Serial.begin(115200);
-  delay(1000);
+
+  // ── Light first: the relay follows NVS before anything else ─
+  // FIX v9.2: restore exactly what user last commanded (the old
+  // code always booted ON). No serial-monitor delay ahead of it.
+  pinMode(LIGHT_PIN, OUTPUT);
+  lsNvs.begin();
+  otNvs.begin();
+  relay.begin();                       // restores state + on-time, drives the pin
+  bootTimes.relayMs = sinceResetMs();
+  schedOwnsOff = lsNvs.getBool("so", false);
+
+  evBegin();
+  logEvent(EV_BOOT, (uint16_t)esp_reset_reason());
+
+  loadIdentity();
+  devPhase.begin(ESP.getEfuseMac(), provisioned ? fleetSlot() : 0xFFFF, GRID_ROWS * LIGHTS_PER_ROW);
+  if (!relay.desiredVersion()) {         // saved by a build that kept it in "ds"
+    Preferences ds;
+    ds.begin("ds", true);
+    uint64_t v = ds.getULong64("v", 0);
+    ds.end();
+    if (v) relay.setDesiredVersion(v);
+  }
+  DEVICE_ID = provisioned
+    ? arenaTopic("AIPL/HighBay/Row_%u/Light_%u", rowIndex + 1, lightIndex + 1)
+    : arenaTopic("AIPL/HighBay/unprovisioned-%s", macHex);
 
   Serial.println("\n╔═══════════════════════════════════════════════╗");
-  Serial.printf ("║  AIPL High Bay %s  Row%d Light%d             ║\n",
-                  FIRMWARE_VERSION, ROW_INDEX+1, LIGHT_INDEX+1);
+  Serial.printf ("║  AIPL High Bay %s  %s\n", FIRMWARE_VERSION, DEVICE_ID);
   Serial.println("║  Relay : JQC3F-05VDC-C  (ACTIVE LOW)          ║");
   Serial.println("║  Fail-safe : ON when WiFi/MQTT drops           ║");
   Serial.println("║  FIX v9.2 : Restores last user state on boot   ║");
   Serial.println("╚═══════════════════════════════════════════════╝\n");
 
   esp_task_wdt_init(WDT_TIMEOUT_S, true);
-  esp_task_wdt_add(NULL);
-  sessionStartMs = millis();
-
-  pinMode(LIGHT_PIN, OUTPUT);
-
-  // ── FIX v9.2: Read last saved state from flash ──────────────
-  // OLD (broken): always booted ON regardless of what user set
-  //   digitalWrite(LIGHT_PIN, RELAY_ON);
-  //   lightState = true;
-  //
-  // NEW (fixed): restore exactly what user last commanded
-  lightState    = loadLightState();
-  userForcedOff = !lightState;
-
-  digitalWrite(LIGHT_PIN, lightState ? RELAY_ON : RELAY_OFF);
-  if (lightState) lightOnStart = millis();
-
-  Serial.printf("[BOOT] Restored from flash → Light %s  GPIO%d=%s\n",
-                lightState ? "ON"  : "OFF",
+  metricsReset();           // net/ctrl tasks register with the WDT themselves
+  guardRestarted  = (rtcGuardRestart == GUARD_MAGIC) && esp_reset_reason() == ESP_RST_SW;
+  rtcGuardRestart = 0;
+  if (guardRestarted) Serial.println("[MEM] Previous boot ended in a controlled low-heap restart");
+  sessionStartMs = nowMs();
+
+  Serial.printf("[BOOT] Restored from flash → Light %s  GPIO%d=%s  (%lu ms after reset)\n",
+                relay.on() ? "ON"  : "OFF",
                 LIGHT_PIN,
-                lightState ? "LOW(RELAY_ON)" : "HIGH(RELAY_OFF)");
+                relay.on() ? "LOW(RELAY_ON)" : "HIGH(RELAY_OFF)",
+                (unsigned long)bootTimes.relayMs);
+
+  otaBootCheck();
 
-  totalOnSeconds = loadOnTime();
+  dashboardOnFs = LittleFS.begin(false) && LittleFS.exists("/www/index.html.gz");
+  Serial.printf("[FS] LAN dashboard %s\n", dashboardOnFs ? "ready at /ui/" : "not uploaded (pio run -t uploadfs)");
 
   // ── Load WiFi credentials ───────────────────────────────────
   prefs.begin("wifi", false);
@@ -546,58 +3663,82 @@ void setup() {
   savedPass = prefs.getString("password", WIFI_PASSWORD);
   prefs.end();
 
-  // ── Connect WiFi ────────────────────────────────────────────
+  // ── Connect WiFi — network task drives the connection ──────
   if (savedSSID.length() > 0) {
     WiFi.mode(WIFI_STA);
     WiFi.persistent(true);
     WiFi.setAutoReconnect(true);
-    WiFi.begin(savedSSID.c_str(), savedPass.c_str());
-    Serial.print("[WiFi] Connecting to: " + savedSSID);
-
-    int tries = 0;
-    while (WiFi.status() != WL_CONNECTED && tries < 40) {
-      delay(500); Serial.print("."); tries++;
-      esp_task_wdt_reset();
-    }
-    Serial.println();
-
-    if (WiFi.status() == WL_CONNECTED) {
-      apMode = false;
-      Serial.println("[WiFi] Connected! IP: " + WiFi.localIP().toString());
-      setupMQTT();
-    } else {
-      Serial.println("[WiFi] Failed — AP mode");
-      startAPMode();
-    }
+    WiFi.onEvent(onWiFiEvent);
+    wifiCacheLoad();
+    apMode    = false;
+    wifiPhase = WIFI_PH_START;
+    setupMQTT();
   } else {
     Serial.println("[WiFi] No credentials — AP mode");
-    startAPMode();
+    wifiPhase = WIFI_PH_START_AP;
   }
 
+  // ── Start tasks — control first so it can accept commands ──
+  xTaskCreatePinnedToCore(controlTask, "ctrl", CTRL_STACK, NULL,
+                          CTRL_PRIO, &ctrlTaskHandle, CTRL_CORE);
+  xTaskCreatePinnedToCore(networkTask, "net",  NET_STACK,  NULL,
+                          NET_PRIO,  &netTaskHandle,  NET_CORE);
+  Serial.printf("[TASK] ctrl@core%d  net@core%d  http@core%d\n",
+                CTRL_CORE, NET_CORE, xPortGetCoreID());
+
   setupWebServer();
   server.begin();
-  Serial.println("[HTTP] Server ready on port 80");
+  httpTaskHandle = xTaskGetHandle("async_tcp");   // created by begin()
+  Serial.println("[HTTP] Async server ready on port 80");
   Serial.println("[READY] Waiting for MQTT commands.\n");
 }
 
 // ============================================================
-//  LOOP
+//  NETWORK TASK — WiFi manager, MQTT/TLS, telemetry (core 0)
+//  Blocking connects here never stall relay control or HTTP.
 // ============================================================
-void loop() {
-  esp_task_wdt_reset();
-  server.handleClient();
-  checkWiFiHealth();
-
-  if (!apMode) {
-    if (!mqtt.connected()) {
-      mqttReconnect();
+void networkTask(void* arg) {
+  esp_task_wdt_add(NULL);
+  initBacklog();                         // bootNo first: mesh seqs build on it
+  if (!apMode) meshBegin();
+  gwInit();                              // needs the mesh: members talk over it
+  if (!apMode) schedBegin();
+  for (;;) {
+    int64_t t0 = esp_timer_get_time();
+    esp_task_wdt_reset();
+    { StageTimer t(ST_WIFI); wifiManagerTick(); }
+
+    if (!apMode && wifiPhase == WIFI_PH_UP) {
+      if (!mqtt.connected()) {
+        mqttOnline = false;
+        mqttReconnect();
+      } else {
+        StageTimer t(ST_MQTT_LOOP);
+        mqtt.loop();
+      }
+      mqttOnline = mqtt.connected();
     } else {
-      mqtt.loop();
-    }
-
-    if (millis() - lastTelemetryMs >= TELE_INTERVAL) {
-      lastTelemetryMs = millis();
-      publishTelemetry();
+      mqttOnline = false;
     }
+    meshTick();
+    gwTick();
+    schedTick();
+    serviceTelemetry();
+    otaTick();
+    lanTick();
+    lanConfigTick();
+    restartTick();
+    memGuardTick();
+    evTick();
+    metricsIter(IT_NET, (uint32_t)(esp_timer_get_time() - t0));
+    vTaskDelay(NET_TICK);
   }
-}
\ No newline at end of file
+}
+
+// ============================================================
+//  LOOP — unused: HTTP is served by async_tcp, everything else
+//  runs in the network and control tasks
+// ============================================================
+void loop() {
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,87 @@
+#include "schedule.h"
+#include "commands.h"
+#include <ArduinoJson.h>
+#include <ctype.h>
+#include <string.h>
+
+static bool listed(JsonVariant list, uint8_t v) {
+  if (list.isNull()) return true;
+  JsonArray a = list.as<JsonArray>();
+  for (JsonVariant x : a) if ((x | -1) == (int)v) return true;
+  return false;
+}
+
+// "HH:MM" → minute of day, -1 if malformed
+static int parseAt(const char* s) {
+  if (!s || strlen(s) != 5 || s[2] != ':') return -1;
+  if (!isdigit(s[0]) || !isdigit(s[1]) || !isdigit(s[3]) || !isdigit(s[4])) return -1;
+  int h = (s[0] - '0') * 10 + (s[1] - '0');
+  int m = (s[3] - '0') * 10 + (s[4] - '0');
+  return (h < 24 && m < 60) ? h * 60 + m : -1;
+}
+
+// {"v","tz","rules":[…]}, every rule at its widest (days, at, state and
+// both filters full); copied strings can't outgrow the message itself
+const size_t SCHED_DOC_SIZE = JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(SCHED_MAX_RULES) +
+                              SCHED_MAX_RULES * (JSON_OBJECT_SIZE(5) + 2 * JSON_ARRAY_SIZE(SCHED_FILTER_MAX)) +
+                              SCHED_MSG_MAX;
+
+bool parseSchedule(const uint8_t* p, unsigned int len, uint8_t row, uint8_t light, Schedule& out) {
+  static StaticJsonDocument<SCHED_DOC_SIZE> doc;   // no heap in the MQTT callback
+  if (len > SCHED_MSG_MAX) return false;
+  if (deserializeJson(doc, p, len)) return false;
+  memset(&out, 0, sizeof(out));
+  out.version = doc["v"] | (uint32_t)0;
+  strncpy(out.tz, doc["tz"] | "UTC0", SCHED_TZ_MAX - 1);
+
+  JsonArray rules = doc["rules"].as<JsonArray>();
+  for (JsonVariant r : rules) {
+    int at = parseAt(r["at"] | (const char*)nullptr);
+    uint8_t days = r["days"] | 0;
+    if (at < 0 || !(days & 0x7F)) continue;
+    if (!listed(r["rows"], row) || !listed(r["lights"], light)) continue;
+    if (out.count == SCHED_MAX_RULES) break;
+
+    JsonVariant st = r["state"];
+    SchedRule&  dst = out.rules[out.count];
+    if      (st.is<bool>())        dst.state = st.as<bool>();
+    else if (st.is<const char*>()) dst.state = parseOnOff((const uint8_t*)st.as<const char*>(), strlen(st.as<const char*>()));
+    else continue;
+    dst.days   = days & 0x7F;
+    dst.minute = (uint16_t)at;
+    out.count++;
+  }
+  return true;
+}
+
+uint32_t scheduleNext(const Schedule& s, uint8_t wday, uint32_t secOfDay, bool& state) {
+  uint32_t best = 0;
+  for (uint8_t i = 0; i < s.count; i++) {
+    const SchedRule& r = s.rules[i];
+    // d = 7 covers a rule that fires only on today's weekday, earlier today
+    for (uint8_t d = 0; d <= 7; d++) {
+      if (!(r.days & (1 << ((wday + d) % 7)))) continue;
+      int64_t delta = (int64_t)d * 86400 + r.minute * 60 - secOfDay;
+      if (delta <= 0) continue;
+      if (!best || delta <= best) { best = (uint32_t)delta; state = r.state; }
+      break;
+    }
+  }
+  return best;
+}
+
+time_t scheduleNextAt(const Schedule& s, time_t now, bool& state) {
+  struct tm lt;
+  localtime_r(&now, &lt);
+  uint32_t sec = lt.tm_hour * 3600 + lt.tm_min * 60 + lt.tm_sec;
+  uint32_t in  = scheduleNext(s, lt.tm_wday, sec, state);
+  if (!in) return 0;
+  uint32_t t  = sec + in;                // from local midnight today
+  lt.tm_mday += t / 86400;
+  lt.tm_hour  = t % 86400 / 3600;
+  lt.tm_min   = t % 3600 / 60;
+  lt.tm_sec   = t % 60;
+  lt.tm_isdst = -1;                      // whichever offset applies on that day
+  time_t at = mktime(&lt);
+  return at > now ? at : now + in;       // fall-back hour resolved to the earlier pass
+}
@@ -0,0 +1,440 @@
+// ============================================================
+//  FLEET SIMULATOR — env:sim
+//    pio run -e sim && .pio/build/sim/program --fixtures 216
+//  Spins up N virtual fixtures on the real broker, each running
+//  the firmware's LightCore, command parser and serializers
+//  behind the real topic scheme:
+//    aipl/row/R/light/L/{command,state,telemetry,ack}
+//    aipl/row/R/command, aipl/all/command
+//  A commander client sends traced commands and times the acks;
+//  an optional outage drops every fixture at once and measures
+//  how long the reconnect storm takes to drain.
+//
+//  Rows start at --first-row (default 6) so the simulated halls
+//  sit beyond the real 6×6 grid — server.js ignores them in the
+//  grid but they still load the broker and its subscriptions.
+//  Credentials: HIVEMQ_HOST/PORT/USERNAME/PASSWORD, as server.js.
+// ============================================================
+#include <mosquitto.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "commands.h"
+#include "light_core.h"
+#include "serializers.h"
+#include "../host/host_fakes.h"
+
+// ── Options ──────────────────────────────────────────────────
+struct SimOptions {
+  uint32_t    fixtures  = 144;
+  uint32_t    perRow    = 6;
+  uint32_t    firstRow  = 6;
+  uint32_t    durationS = 120;
+  uint32_t    teleS     = 5;       // firmware heartbeat
+  double      cmdRate   = 2.0;     // traced commands / s, fleet-wide
+  uint32_t    outageAt  = 0;       // s after start, 0 = no outage
+  uint32_t    outageFor = 30;
+  uint32_t    jitterMs  = 0;       // reconnect spread after the outage
+  uint32_t    retryMs   = 5000;    // firmware MQTT retry interval
+  const char* host      = "a0d0d0e9332a4d3db7516f6125f6e677.s1.eu.hivemq.cloud";
+  int         port      = 8883;
+  const char* user      = "Highbaylight";
+  const char* pass      = "Naveen235623@@";
+  const char* capath    = "/etc/ssl/certs";
+};
+
+static SimOptions opt;
+static HostClock  simClock;         // one clock for every fixture
+
+static uint64_t nowMs() { return simClock.nowMs(); }
+static uint64_t nowUs() { return simClock.nowUs(); }
+
+// ── Fleet-wide counters ──────────────────────────────────────
+struct SimStats {
+  uint64_t pubMsgs     = 0;
+  uint64_t pubBytes    = 0;
+  uint64_t rxMsgs      = 0;
+  uint64_t connects    = 0;
+  uint64_t connFails   = 0;
+  uint64_t drops       = 0;        // unplanned disconnects
+  uint64_t cmdsSent    = 0;
+  uint64_t acks        = 0;
+  uint64_t lateAcks    = 0;        // seq no longer in the window
+};
+static SimStats stats;
+
+// ============================================================
+//  FIXTURE — one virtual light
+// ============================================================
+enum LinkState : uint8_t { LINK_DOWN, LINK_CONNECTING, LINK_UP };
+
+struct Fixture {
+  Fixture(uint8_t r, uint8_t l)
+    : row(r), light(l),
+      core({ 26, 0, 1, 150000, 2000, 60000 }, simClock, gpio, lsNvs, otNvs) {}
+
+  uint8_t      row, light;
+  CountingGpio gpio;
+  MemNvs       lsNvs, otNvs;
+  LightCore    core;
+
+  struct mosquitto* m = nullptr;
+  LinkState    link      = LINK_DOWN;
+  bool         held      = false;   // outage in progress — stay down
+  uint64_t     retryAt   = 0;
+  uint64_t     nextTele  = 0;
+  uint64_t     bootMs    = 0;
+
+  char tCmd[48], tRow[24], tState[48], tTele[48], tAck[48];
+};
+
+static std::vector<Fixture*> fleet;
+
+static bool simPublish(struct mosquitto* m, const char* topic, const void* p, size_t n, bool retain) {
+  if (mosquitto_publish(m, NULL, topic, (int)n, p, 0, retain) != MOSQ_ERR_SUCCESS) return false;
+  stats.pubMsgs++;
+  stats.pubBytes += n;
+  return true;
+}
+
+// Same keys as VIEW_TELEMETRY, dynamic fields from the core
+static void publishTelemetry(Fixture& f) {
+  char       buf[384];
+  JsonWriter w(buf, sizeof(buf));
+  uint64_t   upS = (nowMs() - f.bootMs) / 1000;
+  uint64_t   onS = f.core.onTimeMs() / 1000;
+  w.addBool ("light_state", f.core.on());
+  w.addInt  ("row",         f.row);
+  w.addInt  ("light",       f.light);
+  w.addUInt ("on_seconds",  (uint32_t)onS);
+  w.addUInt ("off_seconds", (uint32_t)(upS > onS ? upS - onS : 0));
+  w.addFixed("kwh_used",    f.core.energyMwh(), 6, 4);
+  w.addInt  ("rssi",        -55 - (int32_t)((f.row * 7 + f.light * 3) % 25));
+  w.addUInt ("uptime_s",    (uint32_t)upS);
+  w.addFloat("wattage",     150.0f, 1);
+  w.addStr  ("firmware",    "sim");
+  w.addUInt ("nvs_writes",  f.core.nvsWrites());
+  size_t n = w.finish();
+  if (n) simPublish(f.m, f.tTele, buf, n, false);
+}
+
+static void publishState(Fixture& f) {
+  const char* s = f.core.on() ? "ON" : "OFF";
+  simPublish(f.m, f.tState, s, strlen(s), false);   // not retained — keep the broker clean
+}
+
+static void onFixtureConnect(struct mosquitto* m, void* obj, int rc) {
+  Fixture& f = *static_cast<Fixture*>(obj);
+  if (rc != 0) {
+    stats.connFails++;
+    f.link    = LINK_DOWN;
+    f.retryAt = nowMs() + opt.retryMs;
+    return;
+  }
+  stats.connects++;
+  f.link = LINK_UP;
+  mosquitto_subscribe(m, NULL, f.tCmd, 1);
+  mosquitto_subscribe(m, NULL, f.tRow, 1);
+  mosquitto_subscribe(m, NULL, "aipl/all/command", 1);
+  publishState(f);
+  f.nextTele = nowMs();             // firmware publishes on connect
+}
+
+static void onFixtureDisconnect(struct mosquitto* m, void* obj, int rc) {
+  Fixture& f = *static_cast<Fixture*>(obj);
+  if (f.link == LINK_UP && !f.held) stats.drops++;
+  f.link    = LINK_DOWN;
+  f.retryAt = nowMs() + opt.retryMs;
+  f.core.force(true);               // fail-safe, refused after a user OFF
+}
+
+// Mirrors mqttCallback → control task → publishAcks
+static void onFixtureMessage(struct mosquitto* m, void* obj, const struct mosquitto_message* msg) {
+  Fixture& f  = *static_cast<Fixture*>(obj);
+  uint64_t t0 = nowUs();
+  stats.rxMsgs++;
+  bool     state;
+  uint32_t seq;
+  uint64_t ts;
+  if (!parseCommand((const uint8_t*)msg->payload, msg->payloadlen, state, seq, ts)) return;
+  bool changed = f.core.set(state);
+  if (changed) publishState(f);
+  if (seq) {
+    CmdAck ack = { seq, (uint32_t)(nowUs() - t0), ts, state, changed };
+    char   buf[128];
+    size_t n = writeAckJson(buf, sizeof(buf), ack);
+    if (n) simPublish(m, f.tAck, buf, n, false);
+  }
+}
+
+static struct mosquitto* newClient(const char* id, void* obj) {
+  struct mosquitto* m = mosquitto_new(id, true, obj);
+  if (!m) return nullptr;
+  mosquitto_username_pw_set(m, opt.user, opt.pass);
+  if (opt.port == 8883) mosquitto_tls_set(m, NULL, opt.capath, NULL, NULL, NULL);
+  return m;
+}
+
+static void fixtureConnect(Fixture& f) {
+  f.link = LINK_CONNECTING;
+  int rc = mosquitto_connect_async(f.m, opt.host, opt.port, 60);
+  if (rc != MOSQ_ERR_SUCCESS) {
+    stats.connFails++;
+    f.link    = LINK_DOWN;
+    f.retryAt = nowMs() + opt.retryMs;
+  }
+}
+
+// ============================================================
+//  COMMANDER — traced commands out, acks in, RTT percentiles
+// ============================================================
+static const uint32_t SEQ_WINDOW = 4096;   // power of 2
+
+struct Commander {
+  struct mosquitto*     m    = nullptr;
+  bool                  up   = false;
+  uint32_t              seq  = 0;
+  uint64_t              sentUs[SEQ_WINDOW] = {};
+  std::vector<uint32_t> rttUs;
+  std::vector<uint32_t> devUs;
+};
+static Commander cmdr;
+
+static void onCmdConnect(struct mosquitto* m, void* obj, int rc) {
+  if (rc != 0) { fprintf(stderr, "[SIM] Commander: %s\n", mosquitto_connack_string(rc)); return; }
+  cmdr.up = true;
+  mosquitto_subscribe(m, NULL, "aipl/row/+/light/+/ack", 0);
+}
+
+static void onCmdDisconnect(struct mosquitto* m, void* obj, int rc) { cmdr.up = false; }
+
+// Ack shares state/seq/ts with the command, so parseCommand reads it
+static void onCmdMessage(struct mosquitto* m, void* obj, const struct mosquitto_message* msg) {
+  bool     state;
+  uint32_t seq;
+  uint64_t ts;
+  if (!parseCommand((const uint8_t*)msg->payload, msg->payloadlen, state, seq, ts) || !seq) return;
+  uint64_t& sent = cmdr.sentUs[seq & (SEQ_WINDOW - 1)];
+  if (!sent || seq > cmdr.seq || cmdr.seq - seq >= SEQ_WINDOW) { stats.lateAcks++; return; }
+  stats.acks++;
+  cmdr.rttUs.push_back((uint32_t)(nowUs() - sent));
+  sent = 0;
+  const char* d = strstr((const char*)msg->payload, "\"dev_us\":");
+  if (d) cmdr.devUs.push_back((uint32_t)strtoul(d + 9, NULL, 10));
+}
+
+static void sendCommand(std::mt19937& rng) {
+  Fixture& f = *fleet[rng() % fleet.size()];
+  if (f.link != LINK_UP) return;
+  char buf[96];
+  uint32_t seq = ++cmdr.seq;
+  int n = snprintf(buf, sizeof(buf), "{\"state\":\"%s\",\"seq\":%lu,\"ts\":%llu}",
+                   (rng() & 1) ? "ON" : "OFF", (unsigned long)seq, (unsigned long long)nowMs());
+  cmdr.sentUs[seq & (SEQ_WINDOW - 1)] = nowUs();
+  if (simPublish(cmdr.m, f.tCmd, buf, n, false)) stats.cmdsSent++;
+}
+
+static uint32_t pct(std::vector<uint32_t>& v, double p) {
+  if (v.empty()) return 0;
+  size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+// ============================================================
+//  MAIN
+// ============================================================
+static void usage() {
+  fprintf(stderr,
+    "usage: sim [--fixtures N] [--per-row N] [--first-row R] [--duration S]\n"
+    "           [--tele-s S] [--cmd-rate HZ] [--outage-at S] [--outage-for S]\n"
+    "           [--jitter-ms MS] [--retry-ms MS] [--capath DIR]\n");
+}
+
+static bool parseArgs(int argc, char** argv) {
+  if (const char* e = getenv("HIVEMQ_HOST"))     opt.host = e;
+  if (const char* e = getenv("HIVEMQ_PORT"))     opt.port = atoi(e);
+  if (const char* e = getenv("HIVEMQ_USERNAME")) opt.user = e;
+  if (const char* e = getenv("HIVEMQ_PASSWORD")) opt.pass = e;
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!v) return false;
+    if      (!strcmp(a, "--fixtures"))   opt.fixtures  = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--per-row"))    opt.perRow    = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--first-row"))  opt.firstRow  = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--duration"))   opt.durationS = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--tele-s"))     opt.teleS     = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--cmd-rate"))   opt.cmdRate   = atof(v);
+    else if (!strcmp(a, "--outage-at"))  opt.outageAt  = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--outage-for")) opt.outageFor = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--jitter-ms"))  opt.jitterMs  = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--retry-ms"))   opt.retryMs   = strtoul(v, NULL, 10);
+    else if (!strcmp(a, "--capath"))     opt.capath    = v;
+    else return false;
+    i++;
+  }
+  return opt.fixtures && opt.perRow && opt.teleS && opt.firstRow + opt.fixtures / opt.perRow < 256;
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) { usage(); return 2; }
+  mosquitto_lib_init();
+  std::mt19937 rng(12345);
+
+  unsigned pid = (unsigned)getpid();
+  for (uint32_t i = 0; i < opt.fixtures; i++) {
+    Fixture* f = new Fixture(opt.firstRow + i / opt.perRow, i % opt.perRow);
+    snprintf(f->tCmd,   sizeof(f->tCmd),   "aipl/row/%u/light/%u/command",   f->row, f->light);
+    snprintf(f->tRow,   sizeof(f->tRow),   "aipl/row/%u/command",            f->row);
+    snprintf(f->tState, sizeof(f->tState), "aipl/row/%u/light/%u/state",     f->row, f->light);
+    snprintf(f->tTele,  sizeof(f->tTele),  "aipl/row/%u/light/%u/telemetry", f->row, f->light);
+    snprintf(f->tAck,   sizeof(f->tAck),   "aipl/row/%u/light/%u/ack",       f->row, f->light);
+    char id[40];
+    snprintf(id, sizeof(id), "aipl-sim-%u-%u-%04x", f->row, f->light, pid & 0xFFFF);
+    f->m = newClient(id, f);
+    if (!f->m) { fprintf(stderr, "[SIM] mosquitto_new failed at fixture %u\n", i); return 1; }
+    mosquitto_connect_callback_set(f->m, onFixtureConnect);
+    mosquitto_disconnect_callback_set(f->m, onFixtureDisconnect);
+    mosquitto_message_callback_set(f->m, onFixtureMessage);
+    mosquitto_will_set(f->m, f->tState, 2, "ON", 1, false);
+    f->core.begin();
+    f->bootMs = nowMs();
+    fleet.push_back(f);
+  }
+
+  char id[32];
+  snprintf(id, sizeof(id), "aipl-sim-cmd-%04x", pid & 0xFFFF);
+  cmdr.m = newClient(id, nullptr);
+  mosquitto_connect_callback_set(cmdr.m, onCmdConnect);
+  mosquitto_disconnect_callback_set(cmdr.m, onCmdDisconnect);
+  mosquitto_message_callback_set(cmdr.m, onCmdMessage);
+  mosquitto_connect_async(cmdr.m, opt.host, opt.port, 60);
+
+  printf("[SIM] %u fixtures, rows %u..%u, telemetry every %us, %.1f cmd/s → %s:%d\n",
+         opt.fixtures, opt.firstRow, opt.firstRow + (opt.fixtures - 1) / opt.perRow,
+         opt.teleS, opt.cmdRate, opt.host, opt.port);
+
+  uint64_t t0         = nowMs();
+  uint64_t end        = t0 + opt.durationS * 1000ULL;
+  uint64_t outageAt   = opt.outageAt ? t0 + opt.outageAt * 1000ULL : 0;
+  uint64_t outageEnd  = outageAt + opt.outageFor * 1000ULL;
+  uint64_t stormStart = 0, stormMs = 0;
+  bool     outage     = false, storm = false;
+  uint64_t nextCmd    = t0 + 2000;
+  uint64_t nextReport = t0 + 10000;
+  uint64_t cmdRetryAt = t0 + opt.retryMs;
+  SimStats last       = stats;
+
+  // Initial connects are a storm too — spread by --jitter-ms
+  stormStart = t0;
+  storm      = true;
+  for (Fixture* f : fleet) { f->held = true; f->retryAt = t0 + (opt.jitterMs ? rng() % opt.jitterMs : 0); }
+
+  while (nowMs() < end) {
+    uint64_t now = nowMs();
+
+    // ── Outage injection ──
+    if (outageAt && !outage && now >= outageAt && now < outageEnd) {
+      printf("[SIM] Outage: dropping %u fixtures for %us\n", opt.fixtures, opt.outageFor);
+      outage = true;
+      for (Fixture* f : fleet) {
+        f->held = true;
+        if (f->link != LINK_DOWN) mosquitto_disconnect(f->m);
+        f->link = LINK_DOWN;
+        f->core.force(true);
+      }
+    }
+    if (outage && now >= outageEnd) {
+      printf("[SIM] Outage over: reconnecting\n");
+      outage     = false;
+      storm      = true;
+      stormStart = now;
+      for (Fixture* f : fleet) f->retryAt = now + (opt.jitterMs ? rng() % opt.jitterMs : 0);
+    }
+
+    // ── Fixtures ──
+    uint32_t up = 0;
+    for (Fixture* f : fleet) {
+      if (f->held && storm && now >= f->retryAt) f->held = false;
+      if (!f->held && f->link == LINK_DOWN && now >= f->retryAt) fixtureConnect(*f);
+      if (f->link != LINK_DOWN) {
+        int rc = mosquitto_loop(f->m, 0, 1);
+        if (rc != MOSQ_ERR_SUCCESS && f->link != LINK_DOWN) {
+          if (f->link == LINK_CONNECTING) stats.connFails++;
+          else                            stats.drops++;
+          f->link    = LINK_DOWN;
+          f->retryAt = now + opt.retryMs;
+          f->core.force(true);
+        }
+      }
+      if (f->link == LINK_UP) {
+        up++;
+        if (now >= f->nextTele) { publishTelemetry(*f); f->nextTele = now + opt.teleS * 1000ULL; }
+      }
+      f->core.tick();
+    }
+
+    if (storm && up == fleet.size()) {
+      stormMs = now - stormStart;
+      storm   = false;
+      printf("[SIM] All %u fixtures connected in %llu ms\n", up, (unsigned long long)stormMs);
+    }
+
+    // ── Commander ──
+    if (mosquitto_loop(cmdr.m, 0, 1) != MOSQ_ERR_SUCCESS && now >= cmdRetryAt) {
+      mosquitto_reconnect_async(cmdr.m);
+      cmdRetryAt = now + opt.retryMs;
+    }
+    if (cmdr.up && opt.cmdRate > 0 && now >= nextCmd) {
+      sendCommand(rng);
+      nextCmd += (uint64_t)(1000.0 / opt.cmdRate);
+      if (nextCmd < now) nextCmd = now;
+    }
+
+    // ── Periodic report ──
+    if (now >= nextReport) {
+      double s = 10.0;
+      printf("[SIM] t=%3llus up=%u/%u  pub %.1f msg/s %.1f kB/s  rx %.1f msg/s  acks %llu  drops %llu\n",
+             (unsigned long long)((now - t0) / 1000), up, opt.fixtures,
+             (stats.pubMsgs - last.pubMsgs) / s, (stats.pubBytes - last.pubBytes) / s / 1024.0,
+             (stats.rxMsgs - last.rxMsgs) / s, (unsigned long long)stats.acks,
+             (unsigned long long)stats.drops);
+      last        = stats;
+      nextReport += 10000;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // ── Summary ──
+  double runS = (nowMs() - t0) / 1000.0;
+  printf("\n[SIM] Summary over %.0f s\n", runS);
+  printf("  published      %llu msgs, %.1f msg/s, %.1f kB/s\n", (unsigned long long)stats.pubMsgs,
+         stats.pubMsgs / runS, stats.pubBytes / runS / 1024.0);
+  printf("  received       %llu msgs\n", (unsigned long long)stats.rxMsgs);
+  printf("  connects       %llu ok, %llu failed, %llu unplanned drops\n",
+         (unsigned long long)stats.connects, (unsigned long long)stats.connFails,
+         (unsigned long long)stats.drops);
+  if (storm) printf("  reconnect storm still draining after %llu ms\n",
+                    (unsigned long long)(nowMs() - stormStart));
+  else       printf("  last reconnect storm %llu ms\n", (unsigned long long)stormMs);
+  printf("  commands       %llu sent, %llu acked, %llu late\n", (unsigned long long)stats.cmdsSent,
+         (unsigned long long)stats.acks, (unsigned long long)stats.lateAcks);
+  printf("  cmd RTT ms     p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+         pct(cmdr.rttUs, 0.50) / 1000.0, pct(cmdr.rttUs, 0.90) / 1000.0,
+         pct(cmdr.rttUs, 0.99) / 1000.0, pct(cmdr.rttUs, 1.0) / 1000.0);
+  printf("  device us      p50 %u  p99 %u\n", pct(cmdr.devUs, 0.50), pct(cmdr.devUs, 0.99));
+
+  for (Fixture* f : fleet) { mosquitto_disconnect(f->m); mosquitto_destroy(f->m); delete f; }
+  mosquitto_disconnect(cmdr.m);
+  mosquitto_destroy(cmdr.m);
+  mosquitto_lib_cleanup();
+  return 0;
+}
@@ -0,0 +1,284 @@
+#include "tls_session_client.h"
+#include <esp_attr.h>
+#include <mbedtls/ssl_internal.h>   // handshake->resume (mbedTLS 2.x)
+
+// ============================================================
+//  RTC SESSION CACHE — survives software resets (WDT, OTA,
+//  restart). Garbage after power-on, hence magic + checksum.
+// ============================================================
+static const uint32_t TLS_RTC_MAGIC = 0x544C5331;   // "TLS1"
+static const size_t   TLS_RTC_BYTES = 2048;          // leaf cert + ticket fit
+
+struct RtcTlsSession {
+  uint32_t magic;
+  uint32_t len;
+  uint32_t sum;
+  uint8_t  data[TLS_RTC_BYTES];
+};
+RTC_NOINIT_ATTR static RtcTlsSession rtcTls;
+
+static uint32_t fnv1a(const uint8_t* p, size_t n) {
+  uint32_t h = 2166136261u;
+  while (n--) { h ^= *p++; h *= 16777619u; }
+  return h;
+}
+
+// ============================================================
+//  LIFECYCLE
+// ============================================================
+TlsSessionClient::TlsSessionClient() {
+  mbedtls_ssl_init(&_ssl);
+  mbedtls_ssl_config_init(&_conf);
+  mbedtls_ctr_drbg_init(&_drbg);
+  mbedtls_entropy_init(&_entropy);
+  mbedtls_x509_crt_init(&_ca);
+  mbedtls_ssl_session_init(&_session);
+}
+
+TlsSessionClient::~TlsSessionClient() {
+  stop();
+  mbedtls_ssl_session_free(&_session);
+  mbedtls_x509_crt_free(&_ca);
+  mbedtls_entropy_free(&_entropy);
+  mbedtls_ctr_drbg_free(&_drbg);
+  mbedtls_ssl_config_free(&_conf);
+  mbedtls_ssl_free(&_ssl);
+}
+
+// Parse CA, seed DRBG and build the config exactly once —
+// reconnects only reset the SSL context.
+bool TlsSessionClient::warmUp() {
+  if (_warm) return true;
+  if (!_caPem) {
+    Serial.println("[TLS] No CA pinned — refusing to connect");
+    return false;
+  }
+
+  static const char PERS[] = "aipl-tls";
+  int ret = mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy,
+                                  (const unsigned char*)PERS, sizeof(PERS) - 1);
+  if (ret == 0)
+    ret = mbedtls_x509_crt_parse(&_ca, (const unsigned char*)_caPem, strlen(_caPem) + 1);
+  if (ret == 0)
+    ret = mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM,
+                                      MBEDTLS_SSL_PRESET_DEFAULT);
+  if (ret == 0) {
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&_conf, &_ca, NULL);
+    mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+    ret = mbedtls_ssl_setup(&_ssl, &_conf);
+  }
+  if (ret != 0) {
+    _lastError = ret;
+    Serial.printf("[TLS] Init failed -0x%04X\n", -ret);
+    return false;
+  }
+
+  mbedtls_ssl_set_bio(&_ssl, this, bioSend, bioRecv, NULL);
+  loadRtcSession();
+  _warm = true;
+  return true;
+}
+
+// ============================================================
+//  CONNECT / HANDSHAKE
+// ============================================================
+int TlsSessionClient::connect(const char* host, uint16_t port) {
+  stop();
+  _lastError = 0;                         // 0 after a failure = TCP never connected
+  if (!warmUp()) return 0;
+  return handshake(host, port, _tcp.connect(host, port));
+}
+
+int TlsSessionClient::connect(IPAddress ip, uint16_t port) {
+  stop();
+  _lastError = 0;
+  if (!warmUp()) return 0;
+  return handshake(NULL, port, _tcp.connect(ip, port));   // no SNI/CN check
+}
+
+int TlsSessionClient::handshake(const char* host, uint16_t port, bool tcpOk) {
+  if (!tcpOk) {
+    Serial.printf("[TLS] TCP connect to %s:%u failed\n", host ? host : "ip", port);
+    return 0;
+  }
+
+  mbedtls_ssl_session_reset(&_ssl);
+  mbedtls_ssl_set_hostname(&_ssl, host);
+  if (_haveSession) mbedtls_ssl_set_session(&_ssl, &_session);
+
+  unsigned long t0      = millis();
+  bool          resumed = false;
+  while (_ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    int ret = mbedtls_ssl_handshake_step(&_ssl);
+    // resume is set once ServerHello accepts our session; the params
+    // block is freed at wrap-up, so sample it while stepping
+    if (_ssl.handshake && _ssl.handshake->resume) resumed = true;
+    if (ret == 0) continue;
+
+    if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+        millis() - t0 >= _handshakeTimeoutMs) {
+      _lastError = (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+                   ? MBEDTLS_ERR_SSL_TIMEOUT : ret;
+      Serial.printf("[TLS] Handshake failed -0x%04X verify=0x%X\n",
+                    -_lastError, (unsigned)mbedtls_ssl_get_verify_result(&_ssl));
+      if (_haveSession) clearSession();   // don't keep offering a session that fails
+      _tcp.stop();
+      return 0;
+    }
+    vTaskDelay(1);
+  }
+
+  _lastHandshakeMs = millis() - t0;
+  _lastResumed     = resumed;
+  if (resumed) _resumedCount++; else _fullCount++;
+  _open   = true;
+  _peeked = -1;
+  cacheSession();
+  return 1;
+}
+
+// ============================================================
+//  SESSION CACHE
+// ============================================================
+void TlsSessionClient::cacheSession() {
+  mbedtls_ssl_session_free(&_session);
+  mbedtls_ssl_session_init(&_session);
+  _haveSession = (mbedtls_ssl_get_session(&_ssl, &_session) == 0);
+  if (_haveSession) saveRtcSession();
+}
+
+void TlsSessionClient::clearSession() {
+  mbedtls_ssl_session_free(&_session);
+  mbedtls_ssl_session_init(&_session);
+  _haveSession = false;
+  rtcTls.magic = 0;
+}
+
+void TlsSessionClient::saveRtcSession() {
+  size_t olen = 0;
+  if (mbedtls_ssl_session_save(&_session, rtcTls.data, TLS_RTC_BYTES, &olen) != 0) {
+    rtcTls.magic = 0;   // too big for RTC — RAM cache still works
+    return;
+  }
+  rtcTls.len   = olen;
+  rtcTls.sum   = fnv1a(rtcTls.data, olen);
+  rtcTls.magic = TLS_RTC_MAGIC;
+}
+
+void TlsSessionClient::loadRtcSession() {
+  if (rtcTls.magic != TLS_RTC_MAGIC || rtcTls.len == 0 || rtcTls.len > TLS_RTC_BYTES ||
+      rtcTls.sum != fnv1a(rtcTls.data, rtcTls.len)) {
+    rtcTls.magic = 0;
+    return;
+  }
+  _haveSession = (mbedtls_ssl_session_load(&_session, rtcTls.data, rtcTls.len) == 0);
+  if (!_haveSession) clearSession();
+  else Serial.println("[TLS] Session restored from RTC memory");
+}
+
+// ============================================================
+//  BIO — mbedTLS record layer over the plain WiFiClient socket
+// ============================================================
+int TlsSessionClient::bioSend(void* ctx, const unsigned char* buf, size_t len) {
+  WiFiClient& tcp = static_cast<TlsSessionClient*>(ctx)->_tcp;
+  int n = tcp.write(buf, len);
+  if (n > 0) return n;
+  return tcp.connected() ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_SSL_CONN_EOF;
+}
+
+int TlsSessionClient::bioRecv(void* ctx, unsigned char* buf, size_t len) {
+  WiFiClient& tcp = static_cast<TlsSessionClient*>(ctx)->_tcp;
+  int avail = tcp.available();
+  if (avail <= 0)
+    return tcp.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_SSL_CONN_EOF;
+  int n = tcp.read(buf, len < (size_t)avail ? len : (size_t)avail);
+  return n > 0 ? n : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+// ============================================================
+//  STREAM
+// ============================================================
+size_t TlsSessionClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t TlsSessionClient::write(const uint8_t* buf, size_t size) {
+  if (!_open) return 0;
+  size_t        sent = 0;
+  unsigned long t0   = millis();
+  while (sent < size) {
+    int ret = mbedtls_ssl_write(&_ssl, buf + sent, size - sent);
+    if (ret > 0) { sent += ret; continue; }
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      _lastError = ret;
+      stop();
+      break;
+    }
+    if (millis() - t0 >= _handshakeTimeoutMs) break;
+    vTaskDelay(1);
+  }
+  return sent;
+}
+
+int TlsSessionClient::available() {
+  if (!_open) return 0;
+  // zero-length read pumps the record layer without consuming data
+  int ret = mbedtls_ssl_read(&_ssl, NULL, 0);
+  if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    _lastError = ret;
+    stop();
+    return 0;
+  }
+  return (int)mbedtls_ssl_get_bytes_avail(&_ssl) + (_peeked >= 0 ? 1 : 0);
+}
+
+int TlsSessionClient::read(uint8_t* buf, size_t size) {
+  if (!_open || size == 0) return -1;
+  size_t off = 0;
+  if (_peeked >= 0) {
+    buf[off++] = (uint8_t)_peeked;
+    _peeked    = -1;
+    if (off == size) return off;
+  }
+  int ret = mbedtls_ssl_read(&_ssl, buf + off, size - off);
+  if (ret > 0) return off + ret;
+  if (ret == 0 || (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)) {
+    _lastError = ret;
+    stop();
+  }
+  return off ? (int)off : -1;
+}
+
+int TlsSessionClient::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int TlsSessionClient::peek() {
+  if (_peeked < 0) {
+    uint8_t b;
+    if (read(&b, 1) == 1) _peeked = b;
+  }
+  return _peeked;
+}
+
+void TlsSessionClient::flush() {
+  // WiFiClient::flush() discards RX bytes — fatal mid-record, so no-op
+}
+
+void TlsSessionClient::stop() {
+  if (_open) mbedtls_ssl_close_notify(&_ssl);
+  _tcp.stop();
+  _open   = false;
+  _peeked = -1;
+}
+
+uint8_t TlsSessionClient::connected() {
+  if (!_open) return 0;
+  return _tcp.connected() || mbedtls_ssl_get_bytes_avail(&_ssl) > 0;
+}
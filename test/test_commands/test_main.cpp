@@ -0,0 +1,157 @@
+// ============================================================
+//  parseOnOff / parseCommand / writeAckJson — payload edge cases
+//    pio test -e native
+// ============================================================
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "commands.h"
+
+void setUp() {}
+void tearDown() {}
+
+static bool parse(const char* s, bool& state, uint32_t& seq, uint64_t& ts, uint32_t* spreadMs = nullptr) {
+  return parseCommand((const uint8_t*)s, strlen(s), state, seq, ts, spreadMs);
+}
+
+void test_on_off_accept_set() {
+  const char* on[]  = { "ON", "on", "1", "true", "  ON\r\n" };
+  const char* off[] = { "OFF", "off", "0", "false", "On", "TRUE", "ONN", "" };
+  for (const char* s : on)  TEST_ASSERT_TRUE (parseOnOff((const uint8_t*)s, strlen(s)));
+  for (const char* s : off) TEST_ASSERT_FALSE(parseOnOff((const uint8_t*)s, strlen(s)));
+}
+
+void test_plain_payload() {
+  bool state = false; uint32_t seq = 7; uint64_t ts = 7;
+  TEST_ASSERT_TRUE(parse("ON", state, seq, ts));
+  TEST_ASSERT_TRUE(state);
+  TEST_ASSERT_EQUAL(0, seq);                    // untraced: reset, not left over
+  TEST_ASSERT_EQUAL_UINT64(0, ts);
+}
+
+void test_empty_payload_is_off() {
+  bool state = true; uint32_t seq; uint64_t ts;
+  TEST_ASSERT_TRUE(parseCommand((const uint8_t*)"", 0, state, seq, ts));
+  TEST_ASSERT_FALSE(state);
+}
+
+void test_traced_payload() {
+  bool state = false; uint32_t seq; uint64_t ts;
+  TEST_ASSERT_TRUE(parse("{\"state\":\"ON\",\"seq\":42,\"ts\":1718000000123}", state, seq, ts));
+  TEST_ASSERT_TRUE(state);
+  TEST_ASSERT_EQUAL(42, seq);
+  TEST_ASSERT_EQUAL_UINT64(1718000000123ULL, ts);
+}
+
+void test_bool_state_and_leading_space() {
+  bool state = true; uint32_t seq; uint64_t ts;
+  TEST_ASSERT_TRUE(parse("  {\"state\":false}", state, seq, ts));
+  TEST_ASSERT_FALSE(state);
+}
+
+void test_spread_ms() {
+  bool state; uint32_t seq, spread = 1; uint64_t ts;
+  TEST_ASSERT_TRUE(parse("{\"state\":\"ON\",\"spread_ms\":3000}", state, seq, ts, &spread));
+  TEST_ASSERT_EQUAL(3000, spread);
+  TEST_ASSERT_TRUE(parse("ON", state, seq, ts, &spread));
+  TEST_ASSERT_EQUAL(0, spread);
+}
+
+void test_all_members_fit_the_document() {
+  bool state = false; uint32_t seq, spread; uint64_t ts;
+  TEST_ASSERT_TRUE(parse("{\"state\":\"ON\",\"seq\":4294967295,\"ts\":1718000000123,\"spread_ms\":60000}",
+                         state, seq, ts, &spread));
+  TEST_ASSERT_EQUAL_UINT32(4294967295u, seq);
+  TEST_ASSERT_EQUAL(60000, spread);
+}
+
+void test_bad_json_rejected() {
+  bool state; uint32_t seq; uint64_t ts;
+  TEST_ASSERT_FALSE(parse("{\"state\":", state, seq, ts));
+  TEST_ASSERT_FALSE(parse("{\"seq\":1}", state, seq, ts));        // no state
+  TEST_ASSERT_FALSE(parse("{\"state\":1}", state, seq, ts));      // neither bool nor string
+}
+
+void test_ack_json() {
+  char   buf[96];
+  CmdAck ack = { 42, 850, 1718000000123ULL, true, false };
+  size_t n = writeAckJson(buf, sizeof(buf), ack);
+  TEST_ASSERT_EQUAL_STRING(
+    "{\"seq\":42,\"ts\":1718000000123,\"state\":true,\"changed\":false,\"dev_us\":850}", buf);
+  TEST_ASSERT_EQUAL(strlen(buf), n);
+  TEST_ASSERT_EQUAL(0, writeAckJson(buf, 32, ack));
+}
+
+// 16 ops at their widest, a policy op among them, under BATCH_BODY_MAX
+static size_t fullBatch(char* body, size_t cap, int ops) {
+  size_t n = snprintf(body, cap, "{\"ops\":[");
+  for (int i = 0; i < ops; i++) {
+    if (i == 3)
+      n += snprintf(body + n, cap - n, "%s{\"op\":\"policy\",\"heartbeat_s\":30,\"min_gap_s\":2,"
+                    "\"rssi_deadband\":4,\"mem_min_free\":20000,\"mem_min_block\":12000}", i ? "," : "");
+    else
+      n += snprintf(body + n, cap - n, "%s{\"op\":\"set\",\"state\":true,\"row\":%d,\"light\":%d,\"all\":false}",
+                    i ? "," : "", i % 6, i % 6);
+  }
+  n += snprintf(body + n, cap - n, "]}");
+  return n;
+}
+
+void test_batch_full_size_parses() {
+  char body[BATCH_BODY_MAX + 1];
+  TEST_ASSERT_TRUE(fullBatch(body, sizeof(body), BATCH_OPS_MAX) <= BATCH_BODY_MAX);
+  BatchDoc  doc;
+  JsonArray ops;
+  TEST_ASSERT_TRUE(parseBatch(body, doc, ops) == NULL);
+  TEST_ASSERT_EQUAL(BATCH_OPS_MAX, ops.size());
+  TEST_ASSERT_EQUAL_STRING("policy", ops[3]["op"].as<const char*>());
+  TEST_ASSERT_EQUAL(12000, ops[3]["mem_min_block"].as<int>());
+  TEST_ASSERT_EQUAL(5, ops[BATCH_OPS_MAX - 1]["light"].as<int>());
+}
+
+void test_batch_rejects() {
+  char      body[2 * BATCH_BODY_MAX];
+  BatchDoc  doc;
+  JsonArray ops;
+  fullBatch(body, sizeof(body), BATCH_OPS_MAX + 1);
+  TEST_ASSERT_TRUE(parseBatch(body, doc, ops) != NULL);
+  strcpy(body, "{\"ops\":[{\"op\":\"set\"}");
+  TEST_ASSERT_TRUE(parseBatch(body, doc, ops) != NULL);
+  strcpy(body, "{\"op\":\"set\"}");
+  TEST_ASSERT_TRUE(parseBatch(body, doc, ops) != NULL);
+}
+
+// Group switch received at 100, spread timer fires later; a LAN set
+// received at 200 and applied meanwhile cancels it
+void test_later_command_cancels_pending_switch() {
+  SetOrder order;
+  TEST_ASSERT_TRUE (order.admit(200, false));
+  TEST_ASSERT_FALSE(order.admit(100, true));              // stale spread switch dropped
+  TEST_ASSERT_TRUE (order.admit(300, true));              // a newer group command still lands
+  TEST_ASSERT_FALSE(order.admit(250, true));
+}
+
+void test_undeferred_sets_always_apply() {
+  SetOrder order;
+  TEST_ASSERT_TRUE(order.admit(500, true));
+  TEST_ASSERT_TRUE(order.admit(400, false));              // immediate commands are never dropped
+  TEST_ASSERT_TRUE(order.admit(450, true));               // …and become the reference
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_on_off_accept_set);
+  RUN_TEST(test_plain_payload);
+  RUN_TEST(test_empty_payload_is_off);
+  RUN_TEST(test_traced_payload);
+  RUN_TEST(test_bool_state_and_leading_space);
+  RUN_TEST(test_spread_ms);
+  RUN_TEST(test_all_members_fit_the_document);
+  RUN_TEST(test_bad_json_rejected);
+  RUN_TEST(test_ack_json);
+  RUN_TEST(test_batch_full_size_parses);
+  RUN_TEST(test_batch_rejects);
+  RUN_TEST(test_later_command_cancels_pending_switch);
+  RUN_TEST(test_undeferred_sets_always_apply);
+  return UNITY_END();
+}
@@ -0,0 +1,169 @@
+// ============================================================
+//  EventLog — wrap, torn writes, head recovery at begin()
+//    pio test -e native
+//  Three 64-byte sectors = 12 slots, 4 per sector, on the NOR
+//  fake: erase sets 0xFF, a write can only clear bits.
+// ============================================================
+#include <unity.h>
+#include "event_log.h"
+#include "../../src/host/host_fakes.h"
+
+static const uint32_t SECTOR = 4 * EventLog::REC_SIZE;
+
+static MemFlash* flash;
+
+void setUp()    { flash = new MemFlash(3 * SECTOR, SECTOR); }
+void tearDown() { delete flash; }
+
+static void fill(EventLog& log, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) log.append(EV_RELAY, i & 1, 1718000000 + i, i);
+}
+
+// Every seq in [from, to) reads back valid, in order
+static bool readable(EventLog& log, uint32_t from, uint32_t to) {
+  for (uint32_t seq = from; seq < to; seq++) {
+    EvRecord r;
+    if (log.read(seq, &r, 1) != 1 || !EventLog::valid(r, seq)) return false;
+  }
+  return true;
+}
+
+void test_empty_region() {
+  EventLog log(*flash);
+  TEST_ASSERT_TRUE(log.begin());
+  TEST_ASSERT_EQUAL(12, log.capacity());
+  TEST_ASSERT_EQUAL(0, log.count());
+  TEST_ASSERT_EQUAL(1, log.nextSeq());
+  TEST_ASSERT_EQUAL(1, log.oldestSeq());
+}
+
+void test_too_small_region_unusable() {
+  MemFlash one(SECTOR, SECTOR);
+  EventLog log(one);
+  TEST_ASSERT_FALSE(log.begin());
+  TEST_ASSERT_FALSE(log.ready());
+  TEST_ASSERT_FALSE(log.append(EV_BOOT, 0, 0, 0));
+}
+
+void test_append_and_read_batch() {
+  EventLog log(*flash);
+  log.begin();
+  fill(log, 5);
+  EvRecord recs[8];
+  TEST_ASSERT_EQUAL(5, log.read(1, recs, 8));   // clipped at the head
+  for (uint32_t i = 0; i < 5; i++) TEST_ASSERT_TRUE(EventLog::valid(recs[i], 1 + i));
+  TEST_ASSERT_EQUAL(1718000004, recs[4].epoch);
+  TEST_ASSERT_EQUAL(0, log.read(6, recs, 1));   // not written yet
+}
+
+void test_wrap_keeps_newest() {
+  EventLog log(*flash);
+  log.begin();
+  fill(log, 20);                                // head back on a sector boundary
+  TEST_ASSERT_EQUAL(21, log.nextSeq());
+  TEST_ASSERT_EQUAL(8, log.count());            // the head sector is about to be erased
+  TEST_ASSERT_EQUAL(13, log.oldestSeq());
+  TEST_ASSERT_TRUE(readable(log, 13, 21));
+  EvRecord r;
+  TEST_ASSERT_EQUAL(0, log.read(12, &r, 1));    // recycled
+  fill(log, 1);
+  TEST_ASSERT_EQUAL(9, log.count());
+  TEST_ASSERT_TRUE(readable(log, 13, 22));
+}
+
+void test_begin_recovers_head_after_wrap() {
+  EventLog log(*flash);
+  log.begin();
+  fill(log, 23);
+  EventLog rebooted(*flash);
+  TEST_ASSERT_TRUE(rebooted.begin());
+  TEST_ASSERT_EQUAL(log.nextSeq(),   rebooted.nextSeq());
+  TEST_ASSERT_EQUAL(log.oldestSeq(), rebooted.oldestSeq());
+  TEST_ASSERT_TRUE(readable(rebooted, rebooted.oldestSeq(), rebooted.nextSeq()));
+  rebooted.append(EV_BOOT, 1, 0, 0);
+  TEST_ASSERT_TRUE(readable(rebooted, 24, 25));
+}
+
+// Power cut half-way through the last record: only its seq is lost
+void test_torn_last_slot_skipped() {
+  EventLog log(*flash);
+  log.begin();
+  fill(log, 5);                                 // seq 1..5, slots 0..4
+  EvRecord torn = { 6, 1718000005, 5, EV_RELAY, 0, 1 };
+  flash->write(5 * EventLog::REC_SIZE, &torn, 6);   // seq + 2 bytes, no CRC
+
+  EventLog rebooted(*flash);
+  TEST_ASSERT_TRUE(rebooted.begin());
+  TEST_ASSERT_EQUAL(7, rebooted.nextSeq());     // torn slot keeps its seq
+  TEST_ASSERT_TRUE(readable(rebooted, 1, 6));
+  EvRecord r;
+  TEST_ASSERT_EQUAL(1, rebooted.read(6, &r, 1));
+  TEST_ASSERT_FALSE(EventLog::valid(r, 6));
+  TEST_ASSERT_TRUE(rebooted.append(EV_BOOT, 1, 0, 0));
+  TEST_ASSERT_TRUE(readable(rebooted, 7, 8));
+}
+
+// Torn first write of a fresh sector: that sector is not the newest,
+// the next append erases it again and reuses the seq
+void test_torn_sector_head_reerased() {
+  EventLog log(*flash);
+  log.begin();
+  fill(log, 4);                                 // sector 0 full
+  EvRecord torn = { 5, 0, 0, EV_RELAY, 0, 0 };
+  flash->erase(SECTOR, SECTOR);
+  flash->write(SECTOR, &torn, 4);
+
+  EventLog rebooted(*flash);
+  TEST_ASSERT_TRUE(rebooted.begin());
+  TEST_ASSERT_EQUAL(5, rebooted.nextSeq());
+  TEST_ASSERT_TRUE(rebooted.append(EV_BOOT, 1, 0, 0));
+  TEST_ASSERT_TRUE(readable(rebooted, 1, 6));
+}
+
+// Writer runs while a reader is inside the flash read: the slots it
+// recycled come back blank instead of as stale records
+class AppendDuringRead : public hal::Flash {
+public:
+  explicit AppendDuringRead(MemFlash& f) : _f(f) {}
+  uint32_t size() override       { return _f.size(); }
+  uint32_t sectorSize() override { return _f.sectorSize(); }
+  bool read(uint32_t off, void* dst, uint32_t len) override {
+    bool ok = _f.read(off, dst, len);
+    if (log && appends) { uint32_t n = appends; appends = 0; fill(*log, n); }
+    return ok;
+  }
+  bool write(uint32_t off, const void* src, uint32_t len) override { return _f.write(off, src, len); }
+  bool erase(uint32_t off, uint32_t len) override                  { return _f.erase(off, len); }
+  EventLog* log     = nullptr;
+  uint32_t  appends = 0;
+
+private:
+  MemFlash& _f;
+};
+
+void test_read_drops_recycled_slots() {
+  AppendDuringRead f(*flash);
+  EventLog log(f);
+  log.begin();
+  fill(log, 11);                                // oldest 1, head one short of the wrap
+  f.log     = &log;
+  f.appends = 2;                                // wraps, then erases sector 0
+  EvRecord recs[4];
+  TEST_ASSERT_EQUAL(4, log.read(1, recs, 4));
+  for (uint32_t i = 0; i < 4; i++) TEST_ASSERT_FALSE(EventLog::valid(recs[i], 1 + i));
+  TEST_ASSERT_EQUAL(5, log.oldestSeq());
+  TEST_ASSERT_TRUE(readable(log, 5, 14));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_region);
+  RUN_TEST(test_too_small_region_unusable);
+  RUN_TEST(test_append_and_read_batch);
+  RUN_TEST(test_wrap_keeps_newest);
+  RUN_TEST(test_begin_recovers_head_after_wrap);
+  RUN_TEST(test_torn_last_slot_skipped);
+  RUN_TEST(test_torn_sector_head_reerased);
+  RUN_TEST(test_read_drops_recycled_slots);
+  return UNITY_END();
+}
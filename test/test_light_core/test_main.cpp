@@ -0,0 +1,187 @@
+// ============================================================
+//  LightCore — coalesced persistence, fail-safe force(), on-time
+//    pio test -e native
+// ============================================================
+#include <unity.h>
+#include "light_core.h"
+#include "../../src/host/host_fakes.h"
+
+static const LightCore::Config CFG = {
+  4, 0, 1,          // pin, active LOW
+  150000,           // 150 W
+  2000,             // coalesceMs
+  60000,            // journalMs
+};
+
+static ManualClock  clk;
+static CountingGpio gpio;
+static MemNvs*      stateNvs;
+static MemNvs*      onNvs;
+static LightCore*   core;
+
+void setUp() {
+  clk      = ManualClock();
+  gpio     = CountingGpio();
+  stateNvs = new MemNvs();
+  onNvs    = new MemNvs();
+  core     = new LightCore(CFG, clk, gpio, *stateNvs, *onNvs);
+}
+
+void tearDown() {
+  delete core;
+  delete stateNvs;
+  delete onNvs;
+}
+
+void test_begin_defaults_on() {
+  core->begin();
+  TEST_ASSERT_TRUE(core->on());
+  TEST_ASSERT_FALSE(core->userForcedOff());
+  TEST_ASSERT_EQUAL(CFG.levelOn, gpio.lastLevel);
+}
+
+void test_begin_restores_user_off() {
+  stateNvs->putBool("l1", false);
+  core->begin();
+  TEST_ASSERT_FALSE(core->on());
+  TEST_ASSERT_TRUE(core->userForcedOff());
+  TEST_ASSERT_EQUAL(CFG.levelOff, gpio.lastLevel);
+}
+
+void test_burst_of_toggles_is_one_write() {
+  core->begin();
+  core->set(false);
+  clk.advanceMs(100);
+  core->set(true);
+  clk.advanceMs(100);
+  core->set(false);
+  core->tick();
+  TEST_ASSERT_EQUAL(0, stateNvs->puts);         // still inside the window
+
+  clk.advanceMs(CFG.coalesceMs);
+  core->tick();
+  TEST_ASSERT_EQUAL(1, stateNvs->puts);
+  TEST_ASSERT_FALSE(stateNvs->getBool("l1", true));
+}
+
+void test_toggle_back_writes_nothing() {
+  core->begin();
+  core->set(false);
+  core->set(true);
+  clk.advanceMs(CFG.coalesceMs);
+  core->tick();
+  TEST_ASSERT_EQUAL(0, stateNvs->puts);         // NVS already holds ON
+}
+
+void test_set_same_state_does_not_move_relay() {
+  core->begin();
+  uint32_t writes = gpio.writes;
+  TEST_ASSERT_FALSE(core->set(true));
+  TEST_ASSERT_EQUAL(writes, gpio.writes);
+}
+
+void test_flush_commits_now() {
+  core->begin();
+  core->set(false);
+  core->flush();
+  TEST_ASSERT_EQUAL(1, stateNvs->puts);
+  TEST_ASSERT_FALSE(stateNvs->getBool("l1", true));
+}
+
+void test_force_on_refused_after_user_off() {
+  core->begin();
+  core->set(false);
+  TEST_ASSERT_FALSE(core->force(true));
+  TEST_ASSERT_FALSE(core->on());
+  TEST_ASSERT_EQUAL(CFG.levelOff, gpio.lastLevel);
+}
+
+void test_force_does_not_persist() {
+  core->begin();
+  TEST_ASSERT_TRUE(core->force(false));
+  TEST_ASSERT_FALSE(core->on());
+  clk.advanceMs(CFG.coalesceMs);
+  core->tick();
+  TEST_ASSERT_EQUAL(0, stateNvs->puts);
+  TEST_ASSERT_FALSE(core->userForcedOff());     // fail-safe may switch it back on
+  TEST_ASSERT_TRUE(core->force(true));
+  TEST_ASSERT_TRUE(core->on());
+}
+
+void test_force_stamps_relay_time() {
+  core->begin();
+  clk.advanceMs(1234);
+  core->force(false);
+  TEST_ASSERT_EQUAL_INT64(1234000, core->lastRelayUs());
+  clk.advanceMs(10);
+  core->force(false);                           // no move, no new stamp
+  TEST_ASSERT_EQUAL_INT64(1234000, core->lastRelayUs());
+}
+
+void test_on_time_from_clock_zero() {
+  core->begin();                                // ON interval opens at t = 0
+  clk.advanceMs(5000);
+  TEST_ASSERT_EQUAL_UINT64(5000, core->onTimeMs());
+  core->set(false);
+  clk.advanceMs(5000);
+  TEST_ASSERT_EQUAL_UINT64(5000, core->onTimeMs());
+  core->force(true);
+  TEST_ASSERT_FALSE(core->on());                // user OFF holds
+  core->set(true);
+  clk.advanceMs(1000);
+  TEST_ASSERT_EQUAL_UINT64(6000, core->onTimeMs());
+}
+
+void test_on_time_journaled_while_on() {
+  core->begin();
+  clk.advanceMs(CFG.journalMs);
+  core->tick();
+  TEST_ASSERT_EQUAL_UINT64(CFG.journalMs, onNvs->getU64("ms", 0));
+}
+
+void test_desired_version_flushed_with_state() {
+  core->begin();
+  core->setDesiredVersion(41);
+  core->setDesiredVersion(42);
+  core->set(false);
+  core->tick();
+  TEST_ASSERT_EQUAL(0, stateNvs->puts);
+  clk.advanceMs(CFG.coalesceMs);
+  core->tick();
+  TEST_ASSERT_EQUAL(2, stateNvs->puts);         // l1 + dv, one flush
+  TEST_ASSERT_EQUAL_UINT64(42, stateNvs->getU64("dv", 0));
+
+  LightCore rebooted(CFG, clk, gpio, *stateNvs, *onNvs);
+  rebooted.begin();
+  TEST_ASSERT_EQUAL_UINT64(42, rebooted.desiredVersion());
+  TEST_ASSERT_FALSE(rebooted.on());
+}
+
+void test_desired_version_unchanged_not_rewritten() {
+  core->begin();
+  core->setDesiredVersion(7);
+  core->flush();
+  uint32_t puts = stateNvs->puts;
+  core->setDesiredVersion(7);
+  clk.advanceMs(CFG.coalesceMs);
+  core->tick();
+  TEST_ASSERT_EQUAL(puts, stateNvs->puts);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_defaults_on);
+  RUN_TEST(test_begin_restores_user_off);
+  RUN_TEST(test_burst_of_toggles_is_one_write);
+  RUN_TEST(test_toggle_back_writes_nothing);
+  RUN_TEST(test_set_same_state_does_not_move_relay);
+  RUN_TEST(test_flush_commits_now);
+  RUN_TEST(test_force_on_refused_after_user_off);
+  RUN_TEST(test_force_does_not_persist);
+  RUN_TEST(test_force_stamps_relay_time);
+  RUN_TEST(test_on_time_from_clock_zero);
+  RUN_TEST(test_on_time_journaled_while_on);
+  RUN_TEST(test_desired_version_flushed_with_state);
+  RUN_TEST(test_desired_version_unchanged_not_rewritten);
+  return UNITY_END();
+}
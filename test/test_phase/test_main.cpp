@@ -0,0 +1,128 @@
+// ============================================================
+//  DevicePhase — slot spacing, MAC fallback, jitter, grid,
+//  group-switch spread offsets
+//    pio test -e native
+// ============================================================
+#include <unity.h>
+#include "phase.h"
+
+static const uint64_t MAC   = 0x24A16057F3C8ULL;
+static const uint16_t SLOTS = 36;
+
+void setUp() {}
+void tearDown() {}
+
+void test_offsets_within_period() {
+  DevicePhase p;
+  for (uint16_t slot = 0; slot <= SLOTS; slot++) {         // SLOTS itself = past the grid
+    p.begin(MAC + slot, slot, SLOTS);
+    for (uint8_t salt = PH_MQTT; salt <= PH_REPORT; salt++) {
+      TEST_ASSERT_TRUE(p.offset(1000, salt) < 1000);
+      TEST_ASSERT_TRUE(p.offset(1, salt) == 0);
+    }
+  }
+  TEST_ASSERT_EQUAL(0, p.offset(0, PH_MQTT));
+}
+
+void test_slots_spread_evenly() {
+  DevicePhase p;
+  bool seen[SLOTS] = {};
+  for (uint16_t slot = 0; slot < SLOTS; slot++) {
+    p.begin(MAC, slot, SLOTS);
+    uint32_t off = p.offset(36000, PH_TELE);
+    TEST_ASSERT_EQUAL(0, off % 1000);                     // exactly on a 1/36 step
+    TEST_ASSERT_FALSE(seen[off / 1000]);
+    seen[off / 1000] = true;
+  }
+}
+
+void test_same_identity_same_phase() {
+  DevicePhase a, b;
+  a.begin(MAC, 0xFFFF, SLOTS);                            // unprovisioned: MAC hash
+  b.begin(MAC, 0xFFFF, SLOTS);
+  TEST_ASSERT_EQUAL(a.offset(60000, PH_WIFI), b.offset(60000, PH_WIFI));
+  TEST_ASSERT_EQUAL(a.jitter(5000, PH_MQTT, 3), b.jitter(5000, PH_MQTT, 3));
+  b.begin(MAC + 1, 0xFFFF, SLOTS);
+  TEST_ASSERT_TRUE(a.offset(60000, PH_WIFI) != b.offset(60000, PH_WIFI));
+}
+
+void test_salts_rotate_slot_order() {
+  DevicePhase p;
+  p.begin(MAC, 0, SLOTS);
+  TEST_ASSERT_TRUE(p.offset(36000, PH_MQTT) != p.offset(36000, PH_WIFI));
+}
+
+void test_jitter_varies_per_event() {
+  DevicePhase p;
+  p.begin(MAC, 0xFFFF, SLOTS);
+  uint32_t distinct = 0, last = 0xFFFFFFFF;
+  for (uint32_t n = 0; n < 32; n++) {
+    uint32_t j = p.jitter(1000, PH_MQTT, n);
+    TEST_ASSERT_TRUE(j < 1000);
+    if (j != last) distinct++;
+    last = j;
+  }
+  TEST_ASSERT_TRUE(distinct > 24);
+  TEST_ASSERT_EQUAL(0, p.jitter(0, PH_MQTT, 1));
+}
+
+void test_next_on_grid() {
+  DevicePhase p;
+  p.begin(MAC, 9, SLOTS);
+  uint32_t off = p.offset(36000, PH_TELE);
+  uint32_t now = 1000000;
+  for (int i = 0; i < 50; i++) {
+    uint32_t at = p.nextOnGrid(now, 36000, 2000, PH_TELE);
+    TEST_ASSERT_TRUE(at >= now + 2000 && at < now + 2000 + 36000);
+    TEST_ASSERT_EQUAL(off, at % 36000);                   // spacing kept however we drift
+    now = at + (uint32_t)i * 137;
+  }
+  TEST_ASSERT_EQUAL(now + 500, p.nextOnGrid(now, 0, 500, PH_TELE));
+}
+
+// Group spread: row = light index / 6, fleet = slot / 36 of spread_ms
+void test_spread_row_offsets() {
+  DevicePhase p;
+  p.begin(MAC, 0, SLOTS);
+  for (uint16_t light = 0; light < 6; light++)
+    TEST_ASSERT_EQUAL(light * 500, p.spreadOffset(3000, light, 6));
+}
+
+void test_spread_fleet_offsets_within_window() {
+  DevicePhase p;
+  p.begin(MAC, 0, SLOTS);
+  const uint32_t windows[] = { 1, 35, 3000, 60000 };
+  for (uint32_t spread : windows) {
+    uint32_t prev = 0;
+    for (uint16_t slot = 0; slot < SLOTS; slot++) {
+      uint32_t off = p.spreadOffset(spread, slot, SLOTS);
+      TEST_ASSERT_TRUE(off < spread);
+      TEST_ASSERT_TRUE(off >= prev);                      // a ramp, in slot order
+      prev = off;
+    }
+  }
+  TEST_ASSERT_EQUAL(35 * 60000 / 36, p.spreadOffset(60000, 35, SLOTS));
+}
+
+void test_spread_off_grid_uses_own_phase() {
+  DevicePhase p;
+  p.begin(MAC, 0xFFFF, SLOTS);                            // unprovisioned
+  uint32_t off = p.spreadOffset(3000, 0xFFFF, 6);
+  TEST_ASSERT_TRUE(off < 3000);
+  TEST_ASSERT_EQUAL(p.offset(3000, PH_SWITCH), off);
+  TEST_ASSERT_EQUAL(0, p.spreadOffset(0, 0xFFFF, 6));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_offsets_within_period);
+  RUN_TEST(test_slots_spread_evenly);
+  RUN_TEST(test_same_identity_same_phase);
+  RUN_TEST(test_salts_rotate_slot_order);
+  RUN_TEST(test_jitter_varies_per_event);
+  RUN_TEST(test_next_on_grid);
+  RUN_TEST(test_spread_row_offsets);
+  RUN_TEST(test_spread_fleet_offsets_within_window);
+  RUN_TEST(test_spread_off_grid_uses_own_phase);
+  return UNITY_END();
+}
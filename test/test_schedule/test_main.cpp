@@ -0,0 +1,162 @@
+// ============================================================
+//  Schedule — parsing, next-event search, midnight and DST
+//    pio test -e native
+// ============================================================
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schedule.h"
+
+static const uint8_t EVERY_DAY = 0x7F;
+static const uint8_t WED = 3, THU = 4;
+
+static Schedule sched;
+
+void setUp() {
+  memset(&sched, 0, sizeof(sched));
+  setenv("TZ", "UTC0", 1);
+  tzset();
+}
+void tearDown() {}
+
+static void rule(uint8_t days, uint8_t h, uint8_t m, bool state) {
+  SchedRule& r = sched.rules[sched.count++];
+  r.days   = days;
+  r.minute = h * 60 + m;
+  r.state  = state;
+}
+
+static bool parse(const char* json, uint8_t row, uint8_t light) {
+  return parseSchedule((const uint8_t*)json, strlen(json), row, light, sched);
+}
+
+void test_no_rules_no_event() {
+  bool state = true;
+  TEST_ASSERT_EQUAL(0, scheduleNext(sched, WED, 0, state));
+  TEST_ASSERT_EQUAL(0, scheduleNextAt(sched, 1711796400, state));
+}
+
+void test_event_strictly_after_now() {
+  bool state = false;
+  rule(EVERY_DAY, 6, 0, true);
+  TEST_ASSERT_EQUAL(3600, scheduleNext(sched, WED, 5 * 3600, state));
+  TEST_ASSERT_TRUE(state);
+  TEST_ASSERT_EQUAL(86400, scheduleNext(sched, WED, 6 * 3600, state));   // just fired
+}
+
+void test_midnight_rollover() {
+  bool state = false;
+  rule(EVERY_DAY, 0, 0, true);
+  TEST_ASSERT_EQUAL(1, scheduleNext(sched, WED, 86399, state));
+  memset(&sched, 0, sizeof(sched));
+  rule(1 << THU, 0, 10, false);
+  TEST_ASSERT_EQUAL(60 + 600, scheduleNext(sched, WED, 86400 - 60, state));
+  TEST_ASSERT_FALSE(state);
+}
+
+void test_weekly_rule_earlier_today_is_next_week() {
+  bool state = false;
+  rule(1 << WED, 6, 0, true);
+  TEST_ASSERT_EQUAL(7 * 86400 - 3600, scheduleNext(sched, WED, 7 * 3600, state));
+}
+
+void test_tie_later_rule_wins() {
+  bool state = true;
+  rule(EVERY_DAY, 22, 0, true);
+  rule(EVERY_DAY, 22, 0, false);
+  TEST_ASSERT_EQUAL(3600, scheduleNext(sched, WED, 21 * 3600, state));
+  TEST_ASSERT_FALSE(state);
+}
+
+// Central Europe: last Sunday of March 02:00 → 03:00, October 03:00 → 02:00
+static void cet() {
+  setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+  tzset();
+}
+
+void test_dst_spring_forward() {
+  cet();
+  bool state = false;
+  rule(EVERY_DAY, 6, 0, true);
+  // Sat 2024-03-30 12:00 CET → Sun 06:00 CEST is 17 h away, not 18
+  TEST_ASSERT_EQUAL(1711857600, scheduleNextAt(sched, 1711796400, state));
+  TEST_ASSERT_TRUE(state);
+}
+
+void test_dst_fall_back() {
+  cet();
+  bool state = false;
+  rule(EVERY_DAY, 6, 0, true);
+  // Sat 2024-10-26 12:00 CEST → Sun 06:00 CET is 19 h away, not 18
+  TEST_ASSERT_EQUAL(1730005200, scheduleNextAt(sched, 1729936800, state));
+}
+
+void test_parse_filters_rows_and_lights() {
+  TEST_ASSERT_TRUE(parse("{\"v\":7,\"tz\":\"IST-5:30\",\"rules\":["
+                         "{\"days\":62,\"at\":\"06:00\",\"state\":\"ON\"},"
+                         "{\"days\":62,\"at\":\"22:00\",\"state\":\"OFF\",\"rows\":[0,1]},"
+                         "{\"days\":62,\"at\":\"23:00\",\"state\":false,\"lights\":[5]}]}", 2, 5));
+  TEST_ASSERT_EQUAL(7, sched.version);
+  TEST_ASSERT_EQUAL_STRING("IST-5:30", sched.tz);
+  TEST_ASSERT_EQUAL(2, sched.count);                    // the rows [0,1] rule is not ours
+  TEST_ASSERT_EQUAL(6 * 60, sched.rules[0].minute);
+  TEST_ASSERT_EQUAL(23 * 60, sched.rules[1].minute);
+  TEST_ASSERT_FALSE(sched.rules[1].state);
+}
+
+void test_parse_empty_rules_clears() {
+  rule(EVERY_DAY, 6, 0, true);
+  TEST_ASSERT_TRUE(parse("{\"v\":8,\"rules\":[]}", 0, 0));
+  TEST_ASSERT_EQUAL(0, sched.count);
+  TEST_ASSERT_EQUAL_STRING("UTC0", sched.tz);
+}
+
+void test_parse_skips_malformed_rules() {
+  TEST_ASSERT_TRUE(parse("{\"v\":1,\"rules\":["
+                         "{\"days\":62,\"at\":\"24:00\",\"state\":\"ON\"},"
+                         "{\"days\":0,\"at\":\"06:00\",\"state\":\"ON\"},"
+                         "{\"days\":62,\"at\":\"6:00\",\"state\":\"ON\"},"
+                         "{\"days\":62,\"at\":\"06:00\"},"
+                         "{\"days\":62,\"at\":\"07:30\",\"state\":true}]}", 0, 0));
+  TEST_ASSERT_EQUAL(1, sched.count);
+  TEST_ASSERT_EQUAL(7 * 60 + 30, sched.rules[0].minute);
+}
+
+void test_parse_over_cap_keeps_first_rules() {
+  char   json[SCHED_MSG_MAX];
+  size_t n = snprintf(json, sizeof(json), "{\"v\":2,\"rules\":[");
+  for (int i = 0; i < SCHED_MAX_RULES + 4; i++)
+    n += snprintf(json + n, sizeof(json) - n, "%s{\"days\":127,\"at\":\"%02d:00\",\"state\":\"ON\"}", i ? "," : "", i);
+  n += snprintf(json + n, sizeof(json) - n, "]}");
+  TEST_ASSERT_TRUE(n < sizeof(json));
+  TEST_ASSERT_TRUE(parse(json, 0, 0));
+  TEST_ASSERT_EQUAL(SCHED_MAX_RULES, sched.count);
+  TEST_ASSERT_EQUAL((SCHED_MAX_RULES - 1) * 60, sched.rules[SCHED_MAX_RULES - 1].minute);
+}
+
+void test_parse_rejects_bad_and_oversized() {
+  TEST_ASSERT_FALSE(parse("{\"v\":1,\"rules\":[", 0, 0));
+  static char big[SCHED_MSG_MAX + 64];
+  memset(big, ' ', sizeof(big) - 1);
+  memcpy(big, "{\"v\":1,\"rules\":[]}", 18);
+  big[sizeof(big) - 1] = 0;
+  TEST_ASSERT_FALSE(parse(big, 0, 0));                  // longer than the MQTT message can be
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_rules_no_event);
+  RUN_TEST(test_event_strictly_after_now);
+  RUN_TEST(test_midnight_rollover);
+  RUN_TEST(test_weekly_rule_earlier_today_is_next_week);
+  RUN_TEST(test_tie_later_rule_wins);
+  RUN_TEST(test_dst_spring_forward);
+  RUN_TEST(test_dst_fall_back);
+  RUN_TEST(test_parse_filters_rows_and_lights);
+  RUN_TEST(test_parse_empty_rules_clears);
+  RUN_TEST(test_parse_skips_malformed_rules);
+  RUN_TEST(test_parse_over_cap_keeps_first_rules);
+  RUN_TEST(test_parse_rejects_bad_and_oversized);
+  return UNITY_END();
+}
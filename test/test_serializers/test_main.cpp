@@ -0,0 +1,89 @@
+// ============================================================
+//  JsonWriter / CborWriter — output and overflow
+//    pio test -e native
+// ============================================================
+#include <unity.h>
+#include "serializers.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_json_object() {
+  char       buf[96];
+  JsonWriter w(buf, sizeof(buf));
+  w.addStr ("id", "a");
+  w.addBool("on", true);
+  w.addInt ("rssi", -61);
+  w.addU64 ("ts", 1718000000123ULL);
+  w.addFixed("kwh", 123456, 3, 2);
+  w.beginArr("h");
+  w.item(1);
+  w.item(2);
+  w.endArr();
+  w.beginObj("o");
+  w.addUInt("n", 0);
+  w.endObj();
+  size_t n = w.finish();
+  TEST_ASSERT_TRUE(w.ok());
+  TEST_ASSERT_EQUAL_STRING(
+    "{\"id\":\"a\",\"on\":true,\"rssi\":-61,\"ts\":1718000000123,\"kwh\":123.45,\"h\":[1,2],\"o\":{\"n\":0}}", buf);
+  TEST_ASSERT_EQUAL(strlen(buf), n);
+}
+
+void test_json_exact_fit() {
+  char       buf[8];                            // {"x":1} + NUL
+  JsonWriter w(buf, sizeof(buf));
+  w.addUInt("x", 1);
+  TEST_ASSERT_EQUAL(7, w.finish());
+  TEST_ASSERT_EQUAL_STRING("{\"x\":1}", buf);
+}
+
+void test_json_one_short_overflows() {
+  char       buf[7];
+  JsonWriter w(buf, sizeof(buf));
+  w.addUInt("x", 1);
+  TEST_ASSERT_EQUAL(0, w.finish());
+  TEST_ASSERT_FALSE(w.ok());
+}
+
+void test_json_overflow_is_sticky() {
+  char       buf[16];
+  JsonWriter w(buf, sizeof(buf));
+  w.addStr("k", "0123456789");                  // does not fit
+  w.addUInt("x", 1);                            // would fit in what is left
+  TEST_ASSERT_EQUAL(0, w.finish());
+  TEST_ASSERT_FALSE(w.ok());
+  TEST_ASSERT_TRUE(strlen(buf) < sizeof(buf));  // still terminated, never overrun
+  TEST_ASSERT_TRUE(strstr(buf, "\"x\"") == NULL);
+}
+
+void test_cbor_map() {
+  uint8_t    buf[32];
+  CborWriter c(buf, sizeof(buf));
+  c.map(3);
+  c.uint(0); c.uint(500);                       // 0x19 01F4
+  c.uint(1); c.sint(-61);                       // 0x38 3C
+  c.uint(2); c.boolean(true);
+  const uint8_t want[] = { 0xA3, 0x00, 0x19, 0x01, 0xF4, 0x01, 0x38, 0x3C, 0x02, 0xF5 };
+  TEST_ASSERT_EQUAL(sizeof(want), c.length());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(want, buf, sizeof(want));
+}
+
+void test_cbor_overflow() {
+  uint8_t    buf[4];
+  CborWriter c(buf, sizeof(buf));
+  c.array(1);
+  c.uint(100000);                               // 0x1A + 4 bytes: one too many
+  TEST_ASSERT_EQUAL(0, c.length());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_json_object);
+  RUN_TEST(test_json_exact_fit);
+  RUN_TEST(test_json_one_short_overflows);
+  RUN_TEST(test_json_overflow_is_sticky);
+  RUN_TEST(test_cbor_map);
+  RUN_TEST(test_cbor_overflow);
+  return UNITY_END();
+}
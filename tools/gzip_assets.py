@@ -0,0 +1,94 @@
+"""Gzip the device web pages into include/web_assets.h (PROGMEM)
+and the LittleFS image source under data/.
+
+Runs as a PlatformIO pre-build script (see platformio.ini) or by hand:
+    python tools/gzip_assets.py
+The header is only rewritten when its content changes, so an unchanged
+page does not trigger a rebuild. The ETag is derived from the gzip
+bytes, so browsers revalidate with a 304 until a page really changes.
+"""
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 — injected by PlatformIO
+    ROOT = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# (symbol, source file, content type)
+ASSETS = [
+    ("ASSET_SETUP_HTML",  "web/setup.html",     "text/html"),
+    ("ASSET_SAVED_HTML",  "web/saved.html",     "text/html"),
+    ("ASSET_FAVICON_SVG", "public/favicon.svg", "image/svg+xml"),
+]
+
+# (source file, LittleFS path under data/) — uploaded with `pio run -t uploadfs`
+FS_ASSETS = [
+    ("web/dashboard.html", "www/index.html.gz"),
+]
+
+OUT = os.path.join(ROOT, "include", "web_assets.h")
+
+
+def c_array(data):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append("  " + ",".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "\n".join(rows)
+
+
+def write_if_changed(path, data):
+    old = None
+    if os.path.exists(path):
+        with open(path, "rb") as f:
+            old = f.read()
+    if data == old:
+        return False
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "wb") as f:
+        f.write(data)
+    return True
+
+
+def build():
+    parts = [
+        "// GENERATED by tools/gzip_assets.py from web/ and public/ — do not edit",
+        "#pragma once",
+        "#include <Arduino.h>",
+        "",
+        "struct WebAsset {",
+        "  const char*    type;",
+        "  const uint8_t* gz;     // PROGMEM, served with Content-Encoding: gzip",
+        "  size_t         len;",
+        "  const char*    etag;   // quoted, as sent on the wire",
+        "};",
+        "",
+    ]
+    for sym, src, ctype in ASSETS:
+        with open(os.path.join(ROOT, src), "rb") as f:
+            raw = f.read()
+        gz = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = hashlib.sha1(gz).hexdigest()[:12]
+        name = sym.lower()
+        parts += [
+            "// %s  %d → %d bytes" % (src, len(raw), len(gz)),
+            "static const uint8_t %s_gz[] PROGMEM = {" % name,
+            c_array(gz),
+            "};",
+            'static const WebAsset %s = { "%s", %s_gz, sizeof(%s_gz), "\\"%s\\"" };'
+            % (sym, ctype, name, name, etag),
+            "",
+        ]
+    if write_if_changed(OUT, "\n".join(parts).encode()):
+        print("web_assets.h regenerated")
+
+    for src, dst in FS_ASSETS:
+        with open(os.path.join(ROOT, src), "rb") as f:
+            gz = gzip.compress(f.read(), compresslevel=9, mtime=0)
+        if write_if_changed(os.path.join(ROOT, "data", dst), gz):
+            print("data/%s regenerated (%d bytes)" % (dst, len(gz)))
+
+
+build()